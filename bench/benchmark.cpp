@@ -0,0 +1,336 @@
+
+#include "src/battalionhandler.h"
+#include "src/noise.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Benchmark of the simulation hot paths: plays synthetic battles from 10 to
+// 100k troops and 2 to 1k battalions from the first contact on, times every
+// phase of each tick separately and prints one JSON line per scenario with
+// the time per living troop per tick. With --noise it times the terrain
+// noise instead, the SIMD rows against the scalar points. Build with
+// `make bench`.
+
+typedef std::chrono::steady_clock Clock;
+
+const Vector2 const_worldBounds = {100, 60};
+const int const_targetFPS = 60;
+// the formations march until they meet before timing starts, for at most this many ticks
+const int const_maxApproachTicks = 120 * const_targetFPS;
+// spacing of the troops in the formations sent by /api/init
+const float const_troopSpacing = 0.8f;
+
+struct BenchConfig
+{
+    int troops;
+    int battalions;
+};
+
+// time spent in each phase, in nanoseconds, and how many troops it was spent on
+struct PhaseTimes
+{
+    // filled in by BattalionHandler::step
+    TickPhaseTimes phases;
+    double tick = 0.0;
+    double activeRatio = 0.0;
+    double troopTicks = 0.0;
+    double ratioTroops = 0.0;
+};
+
+double elapsedNs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+// Probes the battalions between ticks, reaches into the private state.
+class BenchmarkAccess
+{
+public:
+    // getActiveRatio of every battalion against the center of the first
+    // enemy battalion
+    static void timeActiveRatio(const BattalionHandler &handler, PhaseTimes &times)
+    {
+        if (handler.m_attackerBattalions.empty() || handler.m_defenderBattalions.empty())
+        {
+            return;
+        }
+
+        float sink = 0.0f;
+        const Clock::time_point start = Clock::now();
+        auto probe = [&](const std::vector<Handle> &vec, const Battalion &enemy)
+        {
+            for (Handle handle : vec)
+            {
+                const Battalion *b = handler.m_battalions.get(handle);
+                sink += b->getActiveRatio(enemy.m_center, const_lookoutRange[(int)b->m_btype]);
+                times.ratioTroops += b->getTroopCount();
+            }
+        };
+        probe(handler.m_attackerBattalions, *handler.m_battalions.get(handler.m_defenderBattalions.front()));
+        probe(handler.m_defenderBattalions, *handler.m_battalions.get(handler.m_attackerBattalions.front()));
+        times.activeRatio += elapsedNs(start);
+
+        // keeps the calls from being optimized away
+        if (sink < 0.0f)
+        {
+            fprintf(stderr, "%f\n", sink);
+        }
+    }
+
+    // true once a troop of either side has an enemy troop in reach
+    static bool inContact(const BattalionHandler &handler)
+    {
+        for (const std::vector<Handle> *vec : {&handler.m_attackerBattalions, &handler.m_defenderBattalions})
+        {
+            for (Handle handle : *vec)
+            {
+                if (handler.m_battalions.get(handle)->m_troops.engagedCount > 0)
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+};
+
+// square formations of troops, battalions laid out on a grid over their half of the world
+std::vector<BattalionSpawnInfo> makeBattalions(int battalions, int troops, float left, float right, int firstId)
+{
+    const float top = 5.0f;
+    const float bottom = const_worldBounds.y - 5.0f;
+    const int columns = std::max((int)std::ceil(std::sqrt(battalions * (right - left) / (bottom - top))), 1);
+    const int rows = (battalions + columns - 1) / columns;
+    const float cellWidth = (right - left) / columns;
+    const float cellHeight = (bottom - top) / rows;
+
+    std::vector<BattalionSpawnInfo> infos(battalions);
+    for (int i = 0; i < battalions; i++)
+    {
+        // spread the remainder over the first battalions
+        const int count = troops / battalions + (i < troops % battalions ? 1 : 0);
+        const int width = std::max((int)std::ceil(std::sqrt((float)count)), 1);
+        const float spacing = std::min(const_troopSpacing, 0.9f * std::min(cellWidth, cellHeight) / width);
+        const float x0 = left + (i % columns) * cellWidth + 0.05f * cellWidth;
+        const float y0 = top + (i / columns) * cellHeight + 0.05f * cellHeight;
+
+        infos[i].id = firstId + i;
+        infos[i].btype = i % 2;
+        for (int t = 0; t < count; t++)
+        {
+            infos[i].troops.push_back(Vector2{x0 + (t % width) * spacing, y0 + (t / width) * spacing});
+        }
+    }
+    return infos;
+}
+
+void spawnScenario(BattalionHandler &handler, const BenchConfig &config)
+{
+    const int perSide = std::max(config.battalions / 2, 1);
+    const int troopsPerSide = std::max(config.troops / 2, perSide);
+
+    std::vector<BattalionSpawnInfo> attackers = makeBattalions(perSide, troopsPerSide, 5.0f, 45.0f, 0);
+    std::vector<BattalionSpawnInfo> defenders = makeBattalions(perSide, troopsPerSide, 55.0f, 90.0f, perSide);
+
+    // spawn without the mirrored copies, it then shifts attackers by 3 and
+    // mirrors defenders around the castle
+    const Vector2 castle = {const_worldBounds.x - 3, const_worldBounds.y - 2};
+    for (BattalionSpawnInfo &info : attackers)
+    {
+        for (Vector2 &v : info.troops)
+        {
+            v = Vector2{v.x - 3, v.y - 3};
+        }
+    }
+    for (BattalionSpawnInfo &info : defenders)
+    {
+        for (Vector2 &v : info.troops)
+        {
+            v = Vector2{castle.x - v.x, castle.y / 1.2f - v.y};
+        }
+    }
+
+    handler.spawn(Group::Attacker, attackers, false);
+    handler.spawn(Group::Defender, defenders, false);
+}
+
+void runConfig(const BenchConfig &config, int ticks, int warmup, int threadCount, uint64_t seed)
+{
+    BattalionHandler handler(const_worldBounds);
+    handler.setThreadCount(threadCount);
+    handler.setSeed(seed);
+    spawnScenario(handler, config);
+
+    // the formations start apart, marching costs next to nothing, so the
+    // timed ticks start at the first contact; a scenario whose armies never
+    // meet is reported with "contact": false
+    const float deltaTime = 1.0f / const_targetFPS;
+    Group winner;
+    int approach = 0;
+    for (; approach < const_maxApproachTicks && !BenchmarkAccess::inContact(handler) && !handler.isGameFinished(winner); approach++)
+    {
+        handler.step(deltaTime);
+    }
+    const bool contact = BenchmarkAccess::inContact(handler);
+    for (int i = 0; i < warmup; i++)
+    {
+        handler.step(deltaTime);
+    }
+
+    PhaseTimes times;
+    handler.setPhaseTimes(&times.phases);
+    int played = 0;
+    for (; played < ticks && !handler.isGameFinished(winner); played++)
+    {
+        times.troopTicks += handler.getTroopCount(Group::Attacker) + handler.getTroopCount(Group::Defender);
+        const Clock::time_point start = Clock::now();
+        handler.step(deltaTime);
+        times.tick += elapsedNs(start);
+        BenchmarkAccess::timeActiveRatio(handler, times);
+    }
+    handler.setPhaseTimes(nullptr);
+
+    const TickPhaseTimes &phases = times.phases;
+    // Battalion::beginUpdate and endUpdate
+    const double update = phases[TickPhase::Move] + phases[TickPhase::Turn];
+    // Battalion::planAttack and resolveAttack, and the positions they read
+    const double attack = phases[TickPhase::Positions] + phases[TickPhase::PlanAttack] + phases[TickPhase::ResolveAttack];
+
+    const double troopTicks = std::max(times.troopTicks, 1.0);
+    printf("{\"troops\": %d, \"battalions\": %d, \"threads\": %d, \"approachTicks\": %d, \"contact\": %s, "
+           "\"ticks\": %d, \"troopTicks\": %.0f, "
+           "\"nsPerTroopTick\": {\"tick\": %.2f, \"removeDead\": %.2f, \"grid\": %.2f, \"updateTargets\": %.2f, "
+           "\"update\": %.2f, \"attack\": %.2f}, \"activeRatioNsPerTroop\": %.3f, \"msPerTick\": %.4f}\n",
+           config.troops, config.battalions, threadCount, approach, contact ? "true" : "false", played, times.troopTicks,
+           times.tick / troopTicks, phases[TickPhase::RemoveDead] / troopTicks, phases[TickPhase::Grid] / troopTicks,
+           phases[TickPhase::UpdateTargets] / troopTicks, update / troopTicks, attack / troopTicks,
+           times.activeRatio / std::max(times.ratioTroops, 1.0),
+           played ? times.tick / played / 1e6 : 0.0);
+    fflush(stdout);
+}
+
+// fbmNoiseRow against fbmNoise point by point over the same rows, with the
+// frequency and octaves of WorldGen
+void runNoise(int rows, uint64_t seed)
+{
+    const int width = 1024;
+    const float frequency = 0.04f;
+    const int octaves = 6;
+    const uint32_t key = (uint32_t)seed;
+    std::vector<float> row(width);
+    std::vector<float> point(width);
+
+    double rowNs = 0.0;
+    double pointNs = 0.0;
+    long mismatches = 0;
+    for (int y = 0; y < rows; y++)
+    {
+        Clock::time_point start = Clock::now();
+        fbmNoiseRow(-width / 2, y, width, frequency, key, octaves, row.data());
+        rowNs += elapsedNs(start);
+
+        start = Clock::now();
+        for (int x = 0; x < width; x++)
+        {
+            point[x] = fbmNoise((x - width / 2) * frequency, y * frequency, key, octaves);
+        }
+        pointNs += elapsedNs(start);
+
+        mismatches += memcmp(row.data(), point.data(), width * sizeof(float)) != 0;
+    }
+
+    const double points = (double)rows * width;
+    printf("{\"noise\": {\"points\": %.0f, \"octaves\": %d, \"simdRows\": %s, \"rowNsPerPoint\": %.2f, "
+           "\"pointNsPerPoint\": %.2f, \"speedup\": %.2f, \"mismatchedRows\": %ld}}\n",
+           points, octaves, fbmNoiseRowIsSimd() ? "true" : "false", rowNs / points, pointNs / points, pointNs / std::max(rowNs, 1.0), mismatches);
+    fflush(stdout);
+}
+
+void printUsage(const char *program)
+{
+    fprintf(stderr, "usage: %s [--troops N] [--battalions N] [--ticks N] [--warmup N] [--threads N] [--seed N] [--noise]\n", program);
+}
+
+int main(int argc, char **argv)
+{
+    int troops = 0;
+    int battalions = 0;
+    int ticks = 100;
+    int warmup = 10;
+    int threadCount = 1;
+    uint64_t seed = 0;
+    bool noise = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--troops") == 0 && i + 1 < argc)
+        {
+            troops = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--battalions") == 0 && i + 1 < argc)
+        {
+            battalions = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc)
+        {
+            ticks = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+        {
+            warmup = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threadCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--noise") == 0)
+        {
+            noise = true;
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (troops < 0 || battalions < 0 || ticks <= 0 || warmup < 0 || threadCount < 0)
+    {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    if (noise)
+    {
+        // one row per tick
+        runNoise(ticks, seed);
+        return 0;
+    }
+
+    // without --troops and --battalions, sweep both
+    const std::vector<int> troopSteps = troops ? std::vector<int>{troops} : std::vector<int>{10, 100, 1000, 10000, 100000};
+    const std::vector<int> battalionSteps = battalions ? std::vector<int>{battalions} : std::vector<int>{2, 10, 100, 1000};
+
+    for (int t : troopSteps)
+    {
+        for (int b : battalionSteps)
+        {
+            // every battalion needs at least one troop
+            if (b > t)
+            {
+                continue;
+            }
+            runConfig(BenchConfig{t, b}, ticks, warmup, threadCount, seed);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,258 @@
+
+#include "src/montecarlo.h"
+#include "src/replay.h"
+#include "src/scenarioparser.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Native battle runner: plays each scenario given on the command line to the
+// end as fast as possible and prints one JSON line per scenario. With
+// --battles it instead estimates the outcome from many seeded battles.
+// --record saves a replay of the battle, --replay prints the state of a
+// saved replay at the tick given with --seek.
+
+void printUsage(const char *program)
+{
+    fprintf(stderr, "usage: %s [--fps N] [--max-ticks N] [--threads N] [--seed N] [--battles N] [--ci-width W] [--record replay.bin] scenario.json...\n"
+                    "       %s --replay replay.bin [--seek TICK]\n",
+            program, program);
+}
+
+// text as a JSON string literal, quotes included, so any path can be printed
+std::string jsonString(const char *text)
+{
+    std::string out = "\"";
+    for (const char *c = text; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            out += '\\';
+            out += *c;
+        }
+        else if ((unsigned char)*c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)*c);
+            out += escaped;
+        }
+        else
+        {
+            out += *c;
+        }
+    }
+    return out + "\"";
+}
+
+// value below which the given fraction of the sorted values lie
+int quantile(std::vector<int> values, float fraction)
+{
+    std::sort(values.begin(), values.end());
+    const int index = std::min((int)(fraction * values.size()), (int)values.size() - 1);
+    return values[index];
+}
+
+float mean(const std::vector<int> &values)
+{
+    double sum = 0.0;
+    for (int v : values)
+    {
+        sum += v;
+    }
+    return values.empty() ? 0.0f : sum / values.size();
+}
+
+void printBattle(const char *path, const BattleOutcome &outcome, const BattleSettings &settings, double seconds,
+                 const ReplayRecorder *recorder)
+{
+    const char *result = !outcome.finished ? "timeout" : outcome.attackerWon ? "attacker" : "defender";
+
+    printf("{\"scenario\": %s, \"seed\": %llu, \"winner\": \"%s\", \"ticks\": %ld, \"simSeconds\": %.2f, "
+           "\"attackerTroops\": %d, \"defenderTroops\": %d, \"castleHealth\": %.1f, \"wallHealth\": %.1f, "
+           "\"wallSeconds\": %.4f, \"ticksPerSecond\": %.0f",
+           jsonString(path).c_str(), (unsigned long long)outcome.seed, result, outcome.ticks, (double)outcome.ticks / settings.targetFPS,
+           outcome.attackerTroops, outcome.defenderTroops, outcome.castleHealth, outcome.wallHealth,
+           seconds, outcome.ticks / seconds);
+    if (recorder)
+    {
+        printf(", \"replayBytes\": %zu", recorder->getData().size());
+    }
+    printf("}\n");
+}
+
+int printReplay(const char *path, int tick)
+{
+    ReplayPlayer player;
+    std::string error;
+    if (!player.loadFile(path, error))
+    {
+        fprintf(stderr, "%s: %s\n", path, error.c_str());
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    if (!player.seek(tick < 0 ? player.getLastTick() : tick))
+    {
+        fprintf(stderr, "%s: corrupt replay\n", path);
+        return 1;
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    const ReplayFrame &frame = player.getFrame();
+    printf("{\"replay\": %s, \"seed\": %llu, \"firstTick\": %d, \"lastTick\": %d, \"tick\": %d, "
+           "\"battalions\": %zu, \"attackerTroops\": %d, \"defenderTroops\": %d, \"castleHealth\": %.1f, "
+           "\"wallHealth\": %.1f, \"seekSeconds\": %.6f}\n",
+           jsonString(path).c_str(), (unsigned long long)player.getHeader().seed, player.getFirstTick(), player.getLastTick(), frame.tick,
+           frame.battalions.size(), frame.getTroopCount(Group::Attacker), frame.getTroopCount(Group::Defender),
+           frame.getCastleHealth(), frame.getWallHealth(), elapsed.count());
+    return 0;
+}
+
+void printEstimate(const char *path, const MonteCarloResult &result, double seconds)
+{
+    printf("{\"scenario\": %s, \"battles\": %d, \"attackerWins\": %d, \"defenderWins\": %d, \"timeouts\": %d, "
+           "\"winProbability\": %.4f, \"intervalLow\": %.4f, \"intervalHigh\": %.4f, \"converged\": %s, "
+           "\"meanSeconds\": %.2f, \"attackerSurvivors\": {\"mean\": %.1f, \"p10\": %d, \"p50\": %d, \"p90\": %d}, "
+           "\"defenderSurvivors\": {\"mean\": %.1f, \"p10\": %d, \"p50\": %d, \"p90\": %d}, \"wallSeconds\": %.4f}\n",
+           jsonString(path).c_str(), result.battles, result.attackerWins, result.defenderWins, result.timeouts,
+           result.winProbability, result.intervalLow, result.intervalHigh, result.converged ? "true" : "false",
+           result.meanSeconds,
+           mean(result.attackerSurvivors), quantile(result.attackerSurvivors, 0.1f),
+           quantile(result.attackerSurvivors, 0.5f), quantile(result.attackerSurvivors, 0.9f),
+           mean(result.defenderSurvivors), quantile(result.defenderSurvivors, 0.1f),
+           quantile(result.defenderSurvivors, 0.5f), quantile(result.defenderSurvivors, 0.9f),
+           seconds);
+}
+
+int main(int argc, char **argv)
+{
+    // same world and tick rate as the web build
+    BattleSettings settings;
+    // threads per battle, or battles side by side with --battles; 0 for one per hardware thread
+    int threadCount = 1;
+    uint64_t seed = 0;
+    int battles = 0;
+    float intervalWidth = 0.05f;
+    const char *recordPath = nullptr;
+    const char *replayPath = nullptr;
+    // -1 for the last tick
+    int seekTick = -1;
+
+    std::vector<const char *> scenarios;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+        {
+            settings.targetFPS = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-ticks") == 0 && i + 1 < argc)
+        {
+            settings.maxTicks = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threadCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--battles") == 0 && i + 1 < argc)
+        {
+            battles = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--ci-width") == 0 && i + 1 < argc)
+        {
+            intervalWidth = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            recordPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+        {
+            replayPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--seek") == 0 && i + 1 < argc)
+        {
+            seekTick = atoi(argv[++i]);
+        }
+        else if (argv[i][0] == '-')
+        {
+            printUsage(argv[0]);
+            return 2;
+        }
+        else
+        {
+            scenarios.push_back(argv[i]);
+        }
+    }
+
+    if (replayPath)
+    {
+        return printReplay(replayPath, seekTick);
+    }
+
+    // a recording is only written for a single battle
+    if (recordPath && (battles > 0 || scenarios.size() != 1))
+    {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    if (scenarios.empty() || settings.targetFPS <= 0 || settings.maxTicks <= 0 || threadCount < 0 || battles < 0)
+    {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    int failures = 0;
+    for (const char *path : scenarios)
+    {
+        InitialGameState gameState;
+        std::string error;
+        if (!loadInitialGameStateFile(path, gameState, error))
+        {
+            fprintf(stderr, "%s: %s\n", path, error.c_str());
+            failures++;
+            continue;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+
+        if (battles > 0)
+        {
+            MonteCarloOptions options;
+            options.battle = settings;
+            options.firstSeed = seed;
+            options.maxBattles = battles;
+            options.minBattles = std::min(options.minBattles, battles);
+            options.maxIntervalWidth = intervalWidth;
+            options.threadCount = threadCount;
+
+            const MonteCarloResult result = estimateOutcome(gameState, options);
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            printEstimate(path, result, elapsed.count());
+        }
+        else
+        {
+            settings.threadCount = threadCount;
+            ReplayRecorder recorder;
+            const BattleOutcome outcome = runBattle(gameState, settings, seed, recordPath ? &recorder : nullptr);
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            printBattle(path, outcome, settings, elapsed.count(), recordPath ? &recorder : nullptr);
+
+            if (recordPath && !recorder.save(recordPath, error))
+            {
+                fprintf(stderr, "%s: %s\n", recordPath, error.c_str());
+                failures++;
+            }
+        }
+    }
+
+    return failures ? 1 : 0;
+}
@@ -6,12 +6,15 @@ Module.print = (...args) => {
     console.log(text);
 };
 
-Module.canvas = document.getElementById("canvas");
+// this file also runs in the worker threads, which have no page
+if (typeof document !== "undefined") {
+    Module.canvas = document.getElementById("canvas");
 
-setTimeout(() => {
-    Module.canvas.style.width = Math.floor(Module.canvas.width / window.devicePixelRatio) + 'px';
-    Module.canvas.style.height = Math.floor(Module.canvas.height / window.devicePixelRatio) + 'px';
-}, 300);
+    setTimeout(() => {
+        Module.canvas.style.width = Math.floor(Module.canvas.width / window.devicePixelRatio) + 'px';
+        Module.canvas.style.height = Math.floor(Module.canvas.height / window.devicePixelRatio) + 'px';
+    }, 300);
+}
 
 // used for stuff like telling the thing is being downloaded
 // if error occurs, this is chaned
@@ -26,12 +29,172 @@ Module.onerror = (event) => {
 };
 
 
+// generated worlds are cached in IndexedDB (see src/worldcache.h), the cache
+// is read into the file system before main runs
+Module.preRun = Module.preRun || [];
+Module.preRun.push(() => {
+    FS.mkdir("/worldcache");
+    FS.mount(IDBFS, {}, "/worldcache");
+    addRunDependency("worldcache");
+    FS.syncfs(true, (err) => {
+        if (err) {
+            console.warn("world cache not loaded", err);
+        }
+        removeRunDependency("worldcache");
+    });
+});
+
+// writes newly cached chunks back to IndexedDB, once for all the chunks of a second
+Module.persistWorldCacheTimer = null;
+Module.persistWorldCache = () => {
+    if (Module.persistWorldCacheTimer !== null) {
+        return;
+    }
+    Module.persistWorldCacheTimer = setTimeout(() => {
+        Module.persistWorldCacheTimer = null;
+        FS.syncfs(false, (err) => {
+            if (err) {
+                console.warn("world cache not saved", err);
+            }
+        });
+    }, 1000);
+};
+
 Module.initialGameState = null;
 
-Module.call_getInitialGameState = () => {
-    fetch("/api/init", { method: 'GET' })
-    .then(async (response) => {
-        const json = await response.json();
-        Module.initialGameState = json;
+// packs the init JSON into the typed arrays described in src/gameparser.h,
+// so the game can take it in one copy instead of troop by troop
+Module.packInitialGameState = (json) => {
+    const sides = [json.userInitData.battalions, json.aiInitData.battalions];
+    let battalionCount = 0;
+    let troopCount = 0;
+    for (const battalions of sides) {
+        for (const b of battalions) {
+            battalionCount++;
+            troopCount += b.troops.length;
+        }
+    }
+
+    const header = new Int32Array(2 + 3 * battalionCount);
+    const coords = new Float32Array(2 * troopCount);
+    header[0] = battalionCount;
+    header[1] = troopCount;
+    let h = 2;
+    let c = 0;
+    sides.forEach((battalions, side) => {
+        for (const b of battalions) {
+            header[h++] = side;
+            header[h++] = String(b.type).toLowerCase() === "warrior" ? 1 : 0;
+            header[h++] = b.troops.length;
+            for (const t of b.troops) {
+                coords[c++] = t[0];
+                coords[c++] = t[1];
+            }
+        }
     });
-}
+    return { header, coords };
+};
+
+// how the initial game state is loaded, can be overridden before the game
+// starts (e.g. to point it at a local stub server)
+Module.initLoaderOptions = Object.assign({
+    url: "/api/init",
+    // per attempt, from sending the request to the last byte of the body (not
+    // just the headers); the endpoint asks Gemini so it can take a while
+    timeoutMs: 60000,
+    maxAttempts: 5,
+    // first retry after this, doubled for every further one
+    retryDelayMs: 1000,
+    maxRetryDelayMs: 16000,
+}, Module.initLoaderOptions || {});
+
+// state of the one request for the initial game state, read by the game for its loading screen
+Module.initLoad = {
+    running: false,
+    done: false,
+    failed: false,
+    attempt: 0,
+    received: 0,
+    // -1 while the size is unknown
+    total: -1,
+};
+
+// reads the response body, counting the bytes for the loading screen
+Module.readInitResponse = async (response) => {
+    const load = Module.initLoad;
+    const length = Number(response.headers.get("Content-Length"));
+    load.total = length > 0 ? length : -1;
+    if (!response.body) {
+        return response.json();
+    }
+
+    const reader = response.body.getReader();
+    const chunks = [];
+    while (true) {
+        const { done, value } = await reader.read();
+        if (done) {
+            break;
+        }
+        chunks.push(value);
+        load.received += value.length;
+    }
+
+    const bytes = new Uint8Array(load.received);
+    let offset = 0;
+    for (const chunk of chunks) {
+        bytes.set(chunk, offset);
+        offset += chunk.length;
+    }
+    return JSON.parse(new TextDecoder().decode(bytes));
+};
+
+// loads the initial game state with a single request in flight, retrying
+// failed or timed out attempts with exponential backoff, then calls
+// onDone(true) once Module.initialGameState holds it, or onDone(false)
+Module.loadInitialGameState = async (onDone) => {
+    const load = Module.initLoad;
+    if (load.running || load.done) {
+        return;
+    }
+    const options = Module.initLoaderOptions;
+    load.running = true;
+    load.failed = false;
+
+    for (load.attempt = 1; load.attempt <= options.maxAttempts; load.attempt++) {
+        load.received = 0;
+        load.total = -1;
+        // a fresh timer for every attempt, it aborts the fetch and the body read alike
+        const controller = new AbortController();
+        const timeout = setTimeout(() => controller.abort(), options.timeoutMs);
+        try {
+            const response = await fetch(options.url, { method: 'GET', signal: controller.signal });
+            if (!response.ok) {
+                throw new Error("HTTP " + response.status);
+            }
+            const json = await Module.readInitResponse(response);
+            clearTimeout(timeout);
+
+            Module.initialGameState = Module.packInitialGameState(json);
+            load.running = false;
+            load.done = true;
+            onDone(true);
+            return;
+        } catch (err) {
+            clearTimeout(timeout);
+            // an abort can surface from fetch or from reading the body, both mean the timer ran out
+            const reason = controller.signal.aborted ? "timed out after " + options.timeoutMs + " ms" : err;
+            console.warn("loading the initial game state failed (attempt " + load.attempt + ")", reason);
+        }
+
+        if (load.attempt < options.maxAttempts) {
+            // jitter keeps many clients that failed together from retrying together
+            const delay = Math.min(options.retryDelayMs * 2 ** (load.attempt - 1), options.maxRetryDelayMs);
+            await new Promise((resolve) => setTimeout(resolve, delay * (0.5 + Math.random() / 2)));
+        }
+    }
+
+    load.attempt = options.maxAttempts;
+    load.running = false;
+    load.failed = true;
+    onDone(false);
+};
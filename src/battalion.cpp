@@ -1,183 +1,184 @@
 
 #include "src/battalion.h"
-#include <raylib/raymath.h>
+#include "src/counterrng.h"
 #include <algorithm>
+#include <cmath>
+#include <limits>
 
-const float const_attackRange[] = {3.0f, 10.0f};      
-const float const_lookoutRange[] = {18.0f, 25.0f}; 
-const float const_speed[] = {5.0f, 3.0f};           
-const float const_health[] = {22.5f, 15.0f};         
-const float const_damage[] = {10.0f, 13.5f};        
-const float const_accuracy[] = {0.69f, 0.9f};         
-const float const_cooldown[] = {0.7f, 2.0f};         
-const float const_rotation[] = {90.0f, 70.0f};
-
-const Color const_colors[2][2] = {
-    {Color{140, 0, 0, 255}, Color{220, 20, 60, 255}},
-    {Color{0, 0, 140, 255}, Color{60, 20, 220, 255}},
-};
+// incremental center updates after which the center is summed up from the
+// troops again, so rounding errors cannot pile up
+const int const_maxCenterDrift = 64;
 
 Battalion::Battalion(int id, Group group, BType btype, const std::vector<Vector2> troopPositions)
     : m_id(id), m_group(group), m_btype(btype)
 {
     m_rotation = 0.0;
+    m_cooldown = 0.0;
+    m_wallsUp = true;
+    movedToCastle = false;
 
-    Vector2 sum = {0.0f, 0.0f};
+    m_troops.reserve(troopPositions.size());
     for (const Vector2 &position : troopPositions)
     {
-        Troop troop = {
-            .position = position,
-            .health = const_health[(int)m_btype],
-            .currentFrame = 0,
-            .state = TroopState::IDLE,
-            .frameCounter = 0.0f,
-            .flipHorizontal = false,
-        };
-        m_troops.push_back(troop);
-        sum = Vector2Add(sum, position);
+        m_troops.push(position, const_health[(int)m_btype]);
     }
 
     m_initialTroopCount = getTroopCount();
-    m_center = Vector2Scale(sum, 1.0f / m_initialTroopCount);
+    m_center = Vector2Scale(m_troops.positionSum(), 1.0f / m_initialTroopCount);
+    m_troops.setOrigin(m_center);
+    m_startCenter = m_center;
+    m_prevCenter = m_center;
 }
 
 float Battalion::getActiveRatio(const Vector2 &position, float range) const
 {
-    const float rangeSqr = range * range;
-    auto predicate = [&](const Troop &troop)
+    // the bounds settle battalions that are wholly in or out of range
+    int count = m_troops.countInRangeByBounds(position, range);
+    if (count < 0)
     {
-        const float distSqr = Vector2DistanceSqr(troop.position, position);
-        return distSqr < rangeSqr;
-    };
-
-    const int count = std::count_if(m_troops.begin(), m_troops.end(), predicate);
+        count = m_troops.countInRange(position, range);
+    }
     return (float)count / getTroopCount();
 }
 
 float Battalion::getLookoutRatio() const
 {
-    if (auto target = m_target.lock())
+    if (const Battalion *target = getTarget())
     {
-        return getActiveRatio(target->m_center, const_lookoutRange[(int)m_btype]);
+        return getLookoutRatio(*target);
     }
     return 0.0;
 }
 
-float Battalion::getLookoutRatio(std::shared_ptr<Battalion> battalion) const
+float Battalion::getLookoutRatio(const Battalion &battalion) const
 {
-    return getActiveRatio(battalion->m_center, const_lookoutRange[(int)m_btype]);
-}
+    // retargeting asks for the same ratio more than once per tick, it only
+    // changes when one of the two battalions moves or loses troops
+    const bool cacheable = m_gridFresh && battalion.m_gridFresh && battalion.m_tick == m_tick;
+    if (cacheable && m_lookoutTick == m_tick && m_lookoutTarget == battalion.m_handle)
+    {
+        return m_lookoutRatio;
+    }
 
-Rectangle GetFrameRectangle(int startX, int startY, int frameWidth, int frameHeight, int frameIndex)
-{
-    return Rectangle{(float)(startX + frameIndex * frameWidth), (float)startY, (float)frameWidth, (float)frameHeight};
+    const float ratio = getActiveRatio(battalion.m_center, const_lookoutRange[(int)m_btype]);
+    if (cacheable)
+    {
+        m_lookoutTarget = battalion.m_handle;
+        m_lookoutTick = m_tick;
+        m_lookoutRatio = ratio;
+    }
+    return ratio;
 }
 
-int GetStartingYPosition(Group group, BType btype, TroopState state)
+float Battalion::getLookoutReach() const
 {
-    const int baseY = (group == Group::Attacker) ? 48 : 208;
-    return baseY + (state == TroopState::ATTACKING ? 48 : 0);
+    // the troops are all inside the bounds, so none is farther from the
+    // center than the farthest corner; grown a little against rounding
+    const Rectangle bounds = m_troops.getBounds(false);
+    const float farX = std::max(fabsf(bounds.x - m_center.x), fabsf(bounds.x + bounds.width - m_center.x));
+    const float farY = std::max(fabsf(bounds.y - m_center.y), fabsf(bounds.y + bounds.height - m_center.y));
+    const float reach = const_lookoutRange[(int)m_btype] + sqrtf(farX * farX + farY * farY);
+    return reach * 1.001f + 1e-3f;
 }
 
-void Battalion::draw(bool selected, Texture2D spritesheet) const
+void Battalion::beginUpdate(float deltaTime, HandlePool<Wall> &walls, HandlePool<Castle> &castles, Handle castle, bool wallsUp)
 {
-    const Color color = const_colors[(int)m_group][(int)m_btype];
-    const uint8_t alpha = selected ? 20 : 2;
-
-    const Rectangle rect = {m_center.x, m_center.y, (float)getTroopCount(), 1.0};
-    const Vector2 origin = {(float)getTroopCount() / 2, 0.5};
-    DrawRectanglePro(rect, origin, m_rotation, {color.r, color.g, color.b, alpha});
-
-    const float desiredWidth = 1.0f;  // Desired width of the troop sprite
-    const float desiredHeight = 1.0f; // Desired height of the troop sprite
-
-    const int frameWidth = 16;
-    const int frameHeight = 16;
+    m_cooldown -= deltaTime;
+    m_walls = &walls;
+    m_castles = &castles;
+    m_target_castle = castle;
+    m_wallsUp = wallsUp;
 
-    // m_center Debug
-    DrawCircleV(m_center, const_attackRange[(int)m_btype], {color.r, color.g, color.b, alpha});
-    DrawCircleV(m_center, const_lookoutRange[(int)m_btype], {color.r, color.g, color.b, alpha});
+    move(deltaTime);
 
-    for (const auto &troop : m_troops)
+    m_attackKind = AttackKind::None;
+    m_attackTarget = nullptr;
+    if (m_cooldown > 0.0)
     {
-        const int startY = GetStartingYPosition(m_group, m_btype, troop.state);
-        const int startX = (m_btype == BType::Archer) ? 0 : 96;
-        Rectangle sourceRec = GetFrameRectangle(startX, startY, frameWidth, frameHeight, troop.currentFrame);
+        return;
+    }
 
-        if (troop.flipHorizontal)
+    // a battalion target first, then the wall, then the castle
+    if (Battalion *target = getTarget())
+    {
+        m_attackKind = AttackKind::Troops;
+        m_attackTarget = target;
+    }
+    else if (getTargetWall() || getTargetCastle())
+    {
+        if (m_group == Group::Defender)
         {
-            sourceRec.width = -frameWidth; // Flip horizontally
+            return;
+        }
+        m_attackKind = getTargetWall() ? AttackKind::Wall : AttackKind::Castle;
+
+        // the whole formation strikes at once, the troops never break from it for this
+        const Vector2 position = (m_attackKind == AttackKind::Wall) ? getTargetWall()->position : getTargetCastle()->position;
+        const float attackRange = const_attackRange[(int)m_btype];
+        const bool inRange = Vector2DistanceSqr(m_center, position) < attackRange * attackRange;
+        m_troops.rejoin();
+        m_troops.setState(inRange ? TroopState::ATTACKING : TroopState::IDLE);
+        if (inRange && m_attackKind == AttackKind::Wall)
+        {
+            m_troops.setFlip(Vector2Subtract(m_center, position).x < 0.0f);
         }
-
-        const Rectangle destRec = {troop.position.x, troop.position.y, desiredWidth, desiredHeight}; // Scale to desired size
-        const Vector2 origin = {desiredWidth / 2, desiredHeight / 2};                                // Center the sprite
-        DrawTexturePro(spritesheet, sourceRec, destRec, origin, 0.0f, WHITE);
     }
+
+    m_attackPlan.resize(m_troops.size());
+    m_attackRolls.resize(m_troops.size());
+    m_cooldown = const_cooldown[(int)m_btype];
 }
 
-void Battalion::update(float deltaTime, const std::vector<std::shared_ptr<Wall>> &walls, const std::shared_ptr<Castle> &castle, bool wallsUp)
+void Battalion::endUpdate(float deltaTime)
 {
-    m_cooldown -= deltaTime;
-    removeDead();
-    m_walls = walls;
-    m_target_castle = castle;
-    m_wallsUp = wallsUp;
-
-    move(deltaTime);
-    attack(deltaTime);
     rotate(deltaTime);
 
-    for (auto &troop : m_troops)
+    if (m_attackKind == AttackKind::Troops)
     {
-        if (troop.state == TroopState::IDLE)
-        {
-            troop.currentFrame = 0;
-            troop.frameCounter = 0;
-            continue;
-        }
-
-        troop.frameCounter += deltaTime * 5; // Adjust speed of animation
-        if (troop.frameCounter >= 5)
-        { // Assuming 4 frames per animation
-            troop.frameCounter = 0;
-        }
-        troop.currentFrame = static_cast<int>(troop.frameCounter);
+        // planAttack took troops out of the formation and put others back
+        m_troops.countEngaged();
     }
+    m_troops.animate(deltaTime);
 
-    if (m_target.expired() && m_target_wall.expired())
+    if (!getTarget() && !getTargetWall())
     {
-        for (auto &troop : m_troops)
-        {
-            troop.state = TroopState::IDLE;
-        }
+        m_troops.setState(TroopState::IDLE);
     }
 }
 
+void Battalion::savePositions()
+{
+    m_prevCenter = m_center;
+    m_troops.savePositions();
+}
+
 void Battalion::removeDead()
 {
     // Remove dead troops
-    auto predicate = [&](const Troop &troop)
-    {
-        return troop.health <= 0.0;
-    };
+    const RemovedTroops removed = m_troops.removeDead();
+    const int count = m_troops.size();
 
-    auto it = std::remove_if(m_troops.begin(), m_troops.end(), predicate);
-    m_troops.erase(it, m_troops.end());
-
-    // If there are less than 2 troops, do nothing more
-    if (m_troops.size() == 1)
+    // If there are less than 2 troops, the center is the troop itself
+    if (count == 1)
     {
-        m_center = m_troops[0].position;
-        return;
+        m_center = m_troops.position(0);
     }
-
-    // Calculate the new m_center using the average of x and y positions
-    Vector2 sum = {0.0f, 0.0f};
-    for (const auto &troop : m_troops)
+    else if (count > 0 && m_centerDrift >= const_maxCenterDrift)
+    {
+        // Calculate the new m_center using the average of x and y positions
+        m_center = Vector2Scale(m_troops.positionSum(), 1.0f / count);
+        m_troops.refreshAggregates();
+        m_centerDrift = 0;
+    }
+    else if (count > 0 && removed.count > 0)
     {
-        sum = Vector2Add(sum, troop.position);
+        // take the dead troops out of the average
+        const Vector2 sum = Vector2Subtract(Vector2Scale(m_center, (float)(count + removed.count)), removed.positionSum);
+        m_center = Vector2Scale(sum, 1.0f / count);
+        m_centerDrift++;
     }
-    m_center = Vector2Scale(sum, 1.0f / m_troops.size());
+
+    m_startCenter = m_center;
 }
 
 void Battalion::move(float deltaTime)
@@ -187,11 +188,11 @@ void Battalion::move(float deltaTime)
     {
         if (!(m_group == Group::Defender && movedToCastle))
         {
-            if (auto castle = m_target_castle.lock())
+            if (const Castle *castle = getTargetCastle())
             {
 
-                Vector2 movementVec = Vector2Subtract(castle->position, m_center);
-                movementVec = Vector2Normalize(movementVec);
+                const Rectangle footprint = castle->getFootprint();
+                Vector2 movementVec = getHeading(castle->position, &footprint);
                 movementVec = Vector2Scale(movementVec, const_speed[(int)m_btype] * deltaTime);
 
                 if (Vector2Distance(m_center, castle->position) < const_attackRange[(int)m_btype])
@@ -199,10 +200,7 @@ void Battalion::move(float deltaTime)
 
                     if (m_group == Group::Attacker)
                     {
-                        for (auto &troop : m_troops)
-                        {
-                            troop.state = TroopState::ATTACKING;
-                        }
+                        m_troops.setState(TroopState::ATTACKING);
                     }
                     else
                     {
@@ -212,52 +210,33 @@ void Battalion::move(float deltaTime)
                     return;
                 }
 
-                m_center = Vector2Add(m_center, movementVec);
-                for (auto &troop : m_troops)
-                {
-                    troop.position = Vector2Add(troop.position, movementVec);
-                    troop.state = TroopState::MOVING;
-
-                    // Determine horizontal flip based on movement direction
-                    if (movementVec.x < 0)
-                    {
-                        troop.flipHorizontal = true; // Moving left
-                    }
-                    else
-                    {
-                        troop.flipHorizontal = false; // Moving right
-                    }
-                }
+                translate(movementVec);
+                m_troops.setState(TroopState::MOVING);
+                // Determine horizontal flip based on movement direction
+                m_troops.setFlip(movementVec.x < 0);
             }
             return;
         }
     }
 
-    if (auto target = m_target.lock())
+    if (const Battalion *target = getTarget())
     {
-        Vector2 movementVec = Vector2Subtract(target->m_center, m_center);
+        Vector2 movementVec = Vector2Subtract(target->m_startCenter, m_center);
 
         const float moveThreshold = 0.4;
-        if (getActiveRatio(target->m_center, const_attackRange[(int)m_btype]) > moveThreshold)
+        if (getActiveRatio(target->m_startCenter, const_attackRange[(int)m_btype]) > moveThreshold)
         {
-            for (auto &troop : m_troops)
-            {
-                troop.state = TroopState::ATTACKING;
-                troop.flipHorizontal = movementVec.x < 0.0f;
-            }
+            m_troops.setState(TroopState::ATTACKING);
+            m_troops.setFlip(movementVec.x < 0.0f);
             return;
         }
 
-        movementVec = Vector2Normalize(movementVec);
+        movementVec = getHeading(target->m_startCenter);
         movementVec = Vector2Scale(movementVec, const_speed[(int)m_btype] * deltaTime);
 
-        m_center = Vector2Add(m_center, movementVec);
-        for (auto &troop : m_troops)
-        {
-            troop.position = Vector2Add(troop.position, movementVec);
-            troop.state = TroopState::MOVING;
-            troop.flipHorizontal = movementVec.x < 0.0f;
-        }
+        translate(movementVec);
+        m_troops.setState(TroopState::MOVING);
+        m_troops.setFlip(movementVec.x < 0.0f);
         return;
     }
 
@@ -266,159 +245,175 @@ void Battalion::move(float deltaTime)
         return;
     }
     // move towards closest available wall with least hp
-    if (!m_walls.empty())
+    if (!m_walls->empty())
     {
-        std::shared_ptr<Wall> targetWall = nullptr;
+        int closest = -1;
         float closestDistSqr = std::numeric_limits<float>::max();
-        for (const auto &wall : m_walls)
+        for (int i = 0; i < m_walls->size(); i++)
         {
-            const float distSqr = Vector2DistanceSqr(m_center, wall->position);
+            const float distSqr = Vector2DistanceSqr(m_center, (*m_walls)[i].position);
             if (distSqr < closestDistSqr)
             {
                 closestDistSqr = distSqr;
-                targetWall = wall;
+                closest = i;
             }
         }
 
-        if (targetWall)
+        if (closest >= 0)
         {
-            m_target_wall = targetWall;
-            Vector2 movementVec = Vector2Subtract(targetWall->position, m_center);
-            movementVec = Vector2Normalize(movementVec);
+            const Wall *targetWall = &(*m_walls)[closest];
+            m_target_wall = m_walls->getHandle(closest);
+            const Rectangle footprint = targetWall->getFootprint();
+            Vector2 movementVec = getHeading(targetWall->position, &footprint);
             movementVec = Vector2Scale(movementVec, const_speed[(int)m_btype] * deltaTime);
 
             if (Vector2Distance(m_center, targetWall->position) < const_attackRange[(int)m_btype])
             {
-                for (auto &troop : m_troops)
-                {
-                    troop.state = TroopState::ATTACKING;
-                    troop.flipHorizontal = movementVec.x < 0.0f;
-                }
+                m_troops.setState(TroopState::ATTACKING);
+                m_troops.setFlip(movementVec.x < 0.0f);
                 return;
             }
 
-            m_center = Vector2Add(m_center, movementVec);
-            for (auto &troop : m_troops)
-            {
-                troop.position = Vector2Add(troop.position, movementVec);
-                troop.state = TroopState::MOVING;
-                troop.flipHorizontal = movementVec.x < 0.0f;
-            }
+            translate(movementVec);
+            m_troops.setState(TroopState::MOVING);
+            m_troops.setFlip(movementVec.x < 0.0f);
         }
     }
 }
 
-void Battalion::attack(float deltaTime)
+Vector2 Battalion::getHeading(Vector2 goal, const Rectangle *goalArea) const
 {
-
-    if (m_cooldown > 0.0)
+    if (!m_flowFields)
     {
-        return;
+        return Vector2Normalize(Vector2Subtract(goal, m_center));
     }
+    return m_flowFields->getHeading(m_center, goal, goalArea);
+}
+
+void Battalion::planAttack(int begin, int end)
+{
+    const float attackRange = const_attackRange[(int)m_btype];
+    const float accuracy = const_accuracy[(int)m_btype];
 
-    // Check if there's a battalion target first
+    // one roll per troop, drawn whether or not the troop ends up striking so
+    // that a troop's roll never depends on what the others did
+    float *rolls = m_attackRolls.data() + begin;
+    fillUniform(m_seed, RngStream::AttackRoll, m_key, m_tick, begin, end, rolls);
 
-    if (auto target = m_target.lock())
+    if (m_attackKind == AttackKind::Troops)
     {
-        for (auto &troop : m_troops)
+        // large targets are looked up in the grid built after every battalion
+        // moved, small ones are scanned troop by troop; both measure the same
+        // positions the same way, so they find the same troop
+        const TroopStorage &targetTroops = m_attackTarget->m_troops;
+        const bool useGrid = m_grid && m_attackTarget->m_gridId >= 0;
+
+        for (int i = begin; i < end; i++)
         {
-            Troop *targetTroop = nullptr;
-            float closestDistSqr = std::numeric_limits<float>::max();
-            for (auto &other : target->m_troops)
+            int targetTroop = -1;
+            if (useGrid)
             {
-                const float distSqr = Vector2DistanceSqr(troop.position, other.position);
-                if (distSqr < closestDistSqr)
+                GridHit hit;
+                if (m_grid->nearest(m_troops.position(i), attackRange, m_attackTarget->m_gridId, hit))
                 {
-                    closestDistSqr = distSqr;
-                    targetTroop = &other;
+                    targetTroop = hit.troop;
                 }
             }
-
-            const float attackRangeSqr = const_attackRange[(int)m_btype] * const_attackRange[(int)m_btype];
-            if (closestDistSqr < attackRangeSqr)
+            else
             {
-                const Vector2 direction = Vector2Subtract(m_center, targetTroop->position);
-                troop.state = TroopState::ATTACKING;
-                troop.flipHorizontal = direction.x < 0.0f;
-
-                if ((float)rand() / RAND_MAX < const_accuracy[(int)m_btype])
+                float distSqr;
+                const int closest = targetTroops.nearest(m_troops.position(i), distSqr);
+                if (distSqr < attackRange * attackRange)
                 {
-                    targetTroop->health -= const_damage[(int)m_btype];
+                    targetTroop = closest;
                 }
             }
+
+            m_attackPlan[i] = (rolls[i - begin] < accuracy) ? targetTroop : -1;
+            // a troop with an enemy in reach breaks from the formation to face
+            // it, one without falls back in line
+            if (targetTroop >= 0)
+            {
+                const Vector2 direction = Vector2Subtract(m_center, targetTroops.position(targetTroop));
+                m_troops.engage(i, direction.x < 0.0f);
+            }
             else
             {
-                troop.state = TroopState::IDLE;
+                m_troops.disengage(i);
             }
         }
     }
-
-    else if (auto wallTarget = m_target_wall.lock()) // If no battalion target, attack the wall
+    else if (m_attackKind == AttackKind::Wall || m_attackKind == AttackKind::Castle)
     {
-        if (m_group == Group::Defender)
+        // every troop strikes once the battalion center is in range, the
+        // formation was set up for it in beginUpdate
+        Vector2 position;
+        if (m_attackKind == AttackKind::Wall)
         {
-            return;
+            position = getTargetWall()->position;
         }
-
-        for (auto &troop : m_troops)
+        else
         {
-            const float attackRangeSqr = const_attackRange[(int)m_btype] * const_attackRange[(int)m_btype];
-            float distSqr = Vector2DistanceSqr(m_center, wallTarget->position);
-
-            if (distSqr < attackRangeSqr)
-            {
-                const Vector2 direction = Vector2Subtract(m_center, wallTarget->position);
-
-                troop.state = TroopState::ATTACKING;
-                troop.flipHorizontal = direction.x < 0.0f;
+            position = getTargetCastle()->position;
+        }
 
-                if ((float)rand() / RAND_MAX < const_accuracy[(int)m_btype])
-                {
-                    Wall::takeDamage(const_damage[(int)m_btype]);
-                }
-            }
-            else
-            {
-                troop.state = TroopState::IDLE;
-            }
+        const bool inRange = Vector2DistanceSqr(m_center, position) < attackRange * attackRange;
+        for (int i = begin; i < end; i++)
+        {
+            m_attackPlan[i] = (inRange && rolls[i - begin] < accuracy) ? 0 : -1;
         }
     }
+}
 
-    else if (auto castle = m_target_castle.lock())
+void Battalion::resolveAttack()
+{
+    if (m_attackKind == AttackKind::None)
     {
-        if (m_group == Group::Defender)
+        return;
+    }
+
+    const float damage = const_damage[(int)m_btype];
+    Wall *wall = getTargetWall();
+    Castle *castle = getTargetCastle();
+
+    for (int i = 0; i < (int)m_attackPlan.size(); i++)
+    {
+        if (m_attackPlan[i] < 0)
         {
-            return;
+            continue;
         }
 
-        for (auto &troop : m_troops)
+        if (m_attackKind == AttackKind::Troops)
         {
-            const float attackRangeSqr = const_attackRange[(int)m_btype] * const_attackRange[(int)m_btype];
-            float distSqr = Vector2DistanceSqr(m_center, castle->position);
-
-            if (distSqr < attackRangeSqr)
-            {
-                troop.state = TroopState::ATTACKING;
-                if ((float)rand() / RAND_MAX < const_accuracy[(int)m_btype])
-                {
-                    castle.get()->takeDamage(const_damage[(int)m_btype]);
-                }
-            }
-            else
-            {
-                troop.state = TroopState::IDLE;
-            }
+            m_attackTarget->m_troops.damage(m_attackPlan[i], damage);
+        }
+        else if (m_attackKind == AttackKind::Wall)
+        {
+            wall->takeDamage(damage);
+        }
+        else
+        {
+            castle->takeDamage(damage);
         }
     }
 
-    m_cooldown = const_cooldown[(int)m_btype];
+    m_attackKind = AttackKind::None;
+    m_attackTarget = nullptr;
+}
+
+void Battalion::translate(Vector2 delta)
+{
+    m_center = Vector2Add(m_center, delta);
+    m_troops.translate(delta);
+    m_gridFresh = false;
+    m_centerDrift++;
 }
 
 void Battalion::rotate(float deltaTime)
 {
-    if (auto target = m_target.lock())
+    if (const Battalion *target = getTarget())
     {
-        const Vector2 direction = Vector2Subtract(target->m_center, m_center);
+        const Vector2 direction = Vector2Subtract(target->m_startCenter, m_center);
         const float targetRotation = atan2f(direction.y, direction.x) * RAD2DEG;
 
         // making deltaRotation in range [-180, 180] degrees
@@ -434,11 +429,9 @@ void Battalion::rotate(float deltaTime)
         m_rotation += std::copysign(rotationStep, deltaRotation);
 
         // Rotate each troop around the battalion center by the new rotation
-        for (auto &troop : m_troops)
-        {
-            Vector2 relativePosition = Vector2Subtract(troop.position, m_center);
-            relativePosition = Vector2Rotate(relativePosition, std::copysign(rotationStep, deltaRotation) * DEG2RAD);
-            troop.position = Vector2Add(m_center, relativePosition);
-        }
+        m_troops.rotate(m_center, std::copysign(rotationStep, deltaRotation) * DEG2RAD);
+        m_gridFresh = false;
+        // the troops turn around the center, which only moves by rounding
+        m_centerDrift++;
     }
 }
@@ -1,32 +1,18 @@
 
 #pragma once
 
-#include <raylib/raylib.h>
+#include "src/simmath.h"
+#include "src/troopstorage.h"
+#include "src/spatialgrid.h"
+#include "src/flowfield.h"
+#include "src/handlepool.h"
 #include <vector>
-#include <memory>
 #include "src/wall.h"
 #include "src/castle.h"
-
-enum class TroopState
-{
-    MOVING,
-    ATTACKING,
-    IDLE,
-    MOVING_UP,
-    MOVING_DOWN,
-    ATTACKING_DOWN,
-    ATTACKING_UP
-};
-
-struct Troop
-{
-    Vector2 position;
-    float health;
-    int currentFrame;
-    TroopState state;
-    float frameCounter;
-    bool flipHorizontal;
-};
+#ifndef HEADLESS
+#include "src/densitymap.h"
+#include "src/spritebatch.h"
+#endif
 
 enum class BType
 {
@@ -40,6 +26,52 @@ enum class Group
     Defender = 1,
 };
 
+// what the troops of a battalion attack during the current tick
+enum class AttackKind
+{
+    None,
+    Troops,
+    Wall,
+    Castle,
+};
+
+// per BType tuning, indexed with (int)BType
+inline constexpr float const_attackRange[] = {3.0f, 10.0f};
+inline constexpr float const_lookoutRange[] = {18.0f, 25.0f};
+inline constexpr float const_speed[] = {5.0f, 3.0f};
+inline constexpr float const_health[] = {22.5f, 15.0f};
+inline constexpr float const_damage[] = {10.0f, 13.5f};
+inline constexpr float const_accuracy[] = {0.69f, 0.9f};
+inline constexpr float const_cooldown[] = {0.7f, 2.0f};
+inline constexpr float const_rotation[] = {90.0f, 70.0f};
+
+#ifndef HEADLESS
+// animation frames per row of the troop spritesheet
+inline constexpr int const_troopFrameCount = 6;
+
+/// @brief texture coordinates of every troop sprite, looked up instead of computed per troop
+struct TroopFrames
+{
+    // [group][btype][attacking][frame][flipped]
+    SpriteUV uv[2][2][2][const_troopFrameCount][2];
+
+    /// @brief fills the table for the troop spritesheet
+    void build(Texture2D spritesheet);
+    const SpriteUV &get(Group group, BType btype, TroopState state, int frame, bool flipped) const
+    {
+        return uv[(int)group][(int)btype][state == TroopState::ATTACKING][frame][flipped];
+    }
+};
+
+/// @brief how much detail a battalion is drawn with, see BattalionHandler::drawAll
+enum class LodLevel
+{
+    Sprites, // every troop as an animated sprite
+    Glyph,   // a single footprint sized by the troop count
+    Density  // its troops in the density map
+};
+#endif
+
 class Battalion
 {
 
@@ -49,38 +81,122 @@ public:
     /// @brief returns the ratio [0.0 to 1.0] of troops that are within threshold range of position
     float getActiveRatio(const Vector2 &position, float range) const;
     float getLookoutRatio() const;
-    float getLookoutRatio(std::shared_ptr<Battalion> battalion) const;
+    float getLookoutRatio(const Battalion &battalion) const;
+    /// @brief returns how far from the center an enemy center can be and still be in lookout range of a troop
+    /// past it getLookoutRatio is 0
+    float getLookoutReach() const;
     int getTroopCount() const { return m_troops.size(); }
     int getInitialTroopCount() const { return m_initialTroopCount; }
-    void draw(bool selected, Texture2D spritesheet) const;
-    void update(float deltaTime,
-                const std::vector<std::shared_ptr<Wall>> &walls,
-                const std::shared_ptr<Castle> &castle,
-                bool wallsUp);
+#ifndef HEADLESS
+    /// @brief adds the troops inside view to batch, at alpha [0.0 to 1.0] of the way from the previous tick to the current one
+    void addSprites(SpriteBatch &batch, const TroopFrames &frames, Rectangle view, float alpha) const;
+    /// @brief draws the footprint and the attack and lookout ranges of the battalion, faintly unless selected
+    void drawRanges(bool selected, float alpha) const;
+    /// @brief draws the battalion as one footprint whose area grows with the troop count
+    void drawGlyph(float alpha) const;
+    /// @brief moves the troops of the battalion to the cells they stand on now in map
+    void updateDensity(DensityMap &map, Handle handle) const;
+#endif
+
+    // A tick is split in phases so that the battalions can be updated in
+    // parallel, every phase only writes to the battalion's own state:
+    // beginUpdate moves the battalion and decides what it attacks,
+    // planAttack picks the enemy each troop strikes (reading other battalions),
+    // endUpdate turns the battalion and animates it,
+    // resolveAttack deals the damage, battalion by battalion.
+
+    /// @brief moves the battalion and decides what it attacks this tick
+    void beginUpdate(float deltaTime,
+                     HandlePool<Wall> &walls,
+                     HandlePool<Castle> &castles,
+                     Handle castle,
+                     bool wallsUp);
+    /// @brief picks what the troops in [begin, end) strike this tick and rolls their hits
+    void planAttack(int begin, int end);
+    /// @brief turns the battalion towards its target and advances the animations
+    void endUpdate(float deltaTime);
+    /// @brief deals the damage of the planned hits, must run serially
+    void resolveAttack();
 
 private:
+    // filled in field by field by BattalionHandler::restoreSnapshot
+    Battalion() = default;
+
+    void savePositions();
     void removeDead();
     void move(float deltaTime);
-    void attack(float deltaTime);
+    /// @brief returns the unit direction from the center towards goal, around the walls and the castle
+    /// goalArea is the footprint of the wall or castle the goal is in, see FlowFields::getHeading
+    Vector2 getHeading(Vector2 goal, const Rectangle *goalArea = nullptr) const;
+    /// @brief moves the center and every troop by delta
+    void translate(Vector2 delta);
     void rotate(float deltaTime);
+    /// @brief return what the handles below refer to, nullptr once it is gone
+    Battalion *getTarget() const { return m_battalions ? m_battalions->get(m_target) : nullptr; }
+    Wall *getTargetWall() const { return m_walls ? m_walls->get(m_target_wall) : nullptr; }
+    Castle *getTargetCastle() const { return m_castles ? m_castles->get(m_target_castle) : nullptr; }
 
 private:
     int m_id;
+#ifndef HEADLESS
+    // level of detail of the last frame, kept so the level only changes past some margin
+    mutable LodLevel m_lod = LodLevel::Sprites;
+#endif
     Group m_group;
     BType m_btype;
     Vector2 m_center;
-    std::vector<Troop> m_troops;
-    std::weak_ptr<Battalion> m_target;
-    std::vector<std::shared_ptr<Wall>> m_walls;
+    // m_center is kept up to date as the troops move and die instead of being
+    // summed up every tick, this counts the updates since it last was
+    int m_centerDrift = 0;
+    // center at the start of the tick, what the other battalions see during the tick
+    Vector2 m_startCenter;
+    // center at the start of the previous tick, for drawing
+    Vector2 m_prevCenter;
+    TroopStorage m_troops;
+    // pools of the handler the battalion belongs to, m_walls and m_castles
+    // are set by every update
+    HandlePool<Battalion> *m_battalions = nullptr;
+    HandlePool<Wall> *m_walls = nullptr;
+    HandlePool<Castle> *m_castles = nullptr;
+    // handle of the battalion itself in m_battalions
+    Handle m_handle = const_nullHandle;
+    Handle m_target = const_nullHandle;
     bool m_wallsUp;
 
-    std::weak_ptr<Wall> m_target_wall;
-    std::weak_ptr<Castle> m_target_castle;
+    Handle m_target_wall = const_nullHandle;
+    Handle m_target_castle = const_nullHandle;
     bool movedToCastle;
 
     int m_initialTroopCount;
     float m_rotation;
     float m_cooldown;
 
+    // attack of the current tick, m_attackPlan holds the troop of
+    // m_attackTarget each troop hits (or 0 for walls and castle), -1 if none
+    AttackKind m_attackKind = AttackKind::None;
+    Battalion *m_attackTarget = nullptr;
+    std::vector<int> m_attackPlan;
+    std::vector<float> m_attackRolls;
+
+    // troop grid and paths of the current tick, set up by BattalionHandler
+    const SpatialGrid *m_grid = nullptr;
+    int m_gridId = -1;
+    // paths around the walls and the castle, shared by every battalion of the handler
+    const FlowFields *m_flowFields = nullptr;
+    int m_tick = 0; // tick the fields above were last set up for
+    uint64_t m_seed = 0;
+    // false once the troops moved away from their position at the start of the tick
+    bool m_gridFresh = false;
+    // unique within the handler, in spawn order; keys the center tree and
+    // the random numbers of the battalion
+    int m_key = -1;
+
+    // last lookout ratio, reused while neither battalion moved during the tick
+    mutable Handle m_lookoutTarget = const_nullHandle;
+    mutable int m_lookoutTick = -1;
+    mutable float m_lookoutRatio = 0.0f;
+
     friend class BattalionHandler;
+    friend class BenchmarkAccess;
+    friend class ReplayRecorder;
 };
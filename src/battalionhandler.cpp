@@ -1,28 +1,25 @@
 
 #include "src/battalionhandler.h"
-#include "src/raygui.h"
-#include <raylib/raymath.h>
 #include <algorithm>
+#include <chrono>
 #include <sstream>
+#ifdef HEADLESS
+#include <cstdio>
+#endif
+
+// battalions smaller than this are cheaper to scan troop by troop than to
+// put in the troop grid every tick
+const int const_gridMinTroops = 128;
+// troops per attack planning task, large battalions are split over threads
+const int const_attackChunkSize = 1024;
 
 BattalionHandler::BattalionHandler(Vector2 worldBounds)
     : m_worldBounds(worldBounds)
 {
-    m_troopSpriteSheet = LoadTexture("assets/spritesheets/troops.png");
-    m_wallSpriteSheet = LoadTexture("assets/spritesheets/world.png");
-    m_uiSpriteSheet = LoadTexture("assets/spritesheets/ui.png");
-    m_wallCornerSpriteSheet = LoadTexture("assets/spritesheets/filler.png");
     initCastle();
     initWalls();
 }
 
-BattalionHandler::~BattalionHandler()
-{
-    UnloadTexture(m_troopSpriteSheet);
-    UnloadTexture(m_wallSpriteSheet);
-    UnloadTexture(m_uiSpriteSheet);
-}
-
 bool BattalionHandler::isGameFinished(Group &winner) const
 {
     if (m_attackerBattalions.size() == 0)
@@ -35,7 +32,7 @@ bool BattalionHandler::isGameFinished(Group &winner) const
     {
         if (m_defenderWalls.size() == 0)
         {
-            if (m_defenderCastle->health <= 0)
+            if (getCastle().health <= 0)
             {
                 winner = Group::Attacker;
                 return true;
@@ -48,7 +45,10 @@ bool BattalionHandler::isGameFinished(Group &winner) const
 
 void BattalionHandler::spawn(Group group, const std::vector<BattalionSpawnInfo> &spawnInfos, bool flag)
 {
-    std::vector<std::shared_ptr<Battalion>> &vec = (group == Group::Attacker) ? m_attackerBattalions : m_defenderBattalions;
+    if (spawnInfos.empty())
+    {
+        return;
+    }
 
     if (group == Group::Attacker)
     {
@@ -69,8 +69,7 @@ void BattalionHandler::spawn(Group group, const std::vector<BattalionSpawnInfo>
                                { return Vector2{v.x + 3, v.y + 3}; });
             }
             BType btype = (BType)info.btype;
-            std::shared_ptr<Battalion> battalion = std::make_shared<Battalion>(info.id, group, btype, shiftedTroops);
-            vec.push_back(battalion);
+            addBattalion(Battalion(info.id, group, btype, shiftedTroops));
         }
 
         int id = spawnInfos.back().id;
@@ -97,17 +96,16 @@ void BattalionHandler::spawn(Group group, const std::vector<BattalionSpawnInfo>
             if (flag)
             {
                 std::transform(info.troops.begin(), info.troops.end(), shiftedTroops.begin(), [&](Vector2 v)
-                               { return Vector2{m_defenderCastle->position.x / 1.1f - v.x, m_defenderCastle->position.y - v.y}; });
+                               { return Vector2{getCastle().position.x / 1.1f - v.x, getCastle().position.y - v.y}; });
             }
             else
             {
                 std::transform(info.troops.begin(), info.troops.end(), shiftedTroops.begin(), [&](Vector2 v)
-                               { return Vector2{m_defenderCastle->position.x - v.x, m_defenderCastle->position.y / 1.2f - v.y}; });
+                               { return Vector2{getCastle().position.x - v.x, getCastle().position.y / 1.2f - v.y}; });
             }
 
             BType btype = (BType)info.btype;
-            std::shared_ptr<Battalion> battalion = std::make_shared<Battalion>(info.id, group, btype, shiftedTroops);
-            vec.push_back(battalion);
+            addBattalion(Battalion(info.id, group, btype, shiftedTroops));
         }
 
         int id = spawnInfos.back().id;
@@ -125,47 +123,21 @@ void BattalionHandler::spawn(Group group, const std::vector<BattalionSpawnInfo>
     }
 }
 
-void BattalionHandler::drawAll() const
+void BattalionHandler::addBattalion(Battalion battalion)
 {
-    for (const auto &b : m_attackerBattalions)
-    {
-        b->draw(b == m_selectedBattalion.lock(), m_troopSpriteSheet);
-    }
-    for (const auto &b : m_defenderBattalions)
-    {
-        b->draw(b == m_selectedBattalion.lock(), m_troopSpriteSheet);
-    }
-
-    drawWall();
-
-    drawCastle();
-}
-
-void BattalionHandler::drawWall() const
-{
-    for (const auto &wall : m_defenderWalls)
-    {
-        wall.get()->draw(m_wallSpriteSheet);
-    }
-
-    if (areWallsUp())
-    {
-        const Vector2 castlePos = m_defenderCastle->position;
-
-        const Vector2 cornerWallPos = {castlePos.x - 5.5f, castlePos.y - 6.5f};
-
-        DrawTexturePro(m_wallCornerSpriteSheet, Rectangle{0, 0, 8, 8}, {cornerWallPos.x, cornerWallPos.y, 1, 1}, {0, 0}, 0, WHITE);
-    }
-}
-
-void BattalionHandler::drawCastle() const
-{
-    m_defenderCastle->draw(m_wallSpriteSheet);
+    const Handle handle = m_battalions.insert(std::move(battalion));
+    Battalion &b = *m_battalions.get(handle);
+    b.m_battalions = &m_battalions;
+    b.m_handle = handle;
+    (b.m_group == Group::Attacker ? m_attackerBattalions : m_defenderBattalions).push_back(handle);
+    addCenter(b);
 }
 
 void BattalionHandler::initWalls()
 {
-    const Vector2 castlePos = m_defenderCastle->position;
+    const Vector2 castlePos = getCastle().position;
+    m_defenderWalls.clear();
+    m_wallHealth = TOTAL_HEALTH;
 
     const Vector2 verticalWallsPosition[] = {
         {castlePos.x - 5.0f, castlePos.y + 1.0f},
@@ -176,10 +148,11 @@ void BattalionHandler::initWalls()
 
     for (int i = 0; i < sizeof(verticalWallsPosition) / sizeof(Vector2); i++)
     {
-        m_defenderWalls.push_back(std::make_shared<Wall>(
+        m_defenderWalls.insert(Wall(
             verticalWallsPosition[i],
             Vector2{4.0f, 2.0f},
-            0.0f));
+            0.0f,
+            &m_wallHealth));
     }
 
     const Vector2 horizontalWallsPosition[] = {
@@ -191,16 +164,18 @@ void BattalionHandler::initWalls()
 
     for (int i = 0; i < sizeof(horizontalWallsPosition) / sizeof(Vector2); i++)
     {
-        m_defenderWalls.push_back(std::make_shared<Wall>(
+        m_defenderWalls.insert(Wall(
             horizontalWallsPosition[i],
             Vector2{4.0f, 2.0f},
-            90.0f));
+            90.0f,
+            &m_wallHealth));
     }
 }
 
 void BattalionHandler::initCastle()
 {
-    m_defenderCastle = std::make_shared<Castle>(Vector2{m_worldBounds.x - 3, m_worldBounds.y - 2}, 750.0f);
+    m_castles.clear();
+    m_defenderCastle = m_castles.insert(Castle(Vector2{m_worldBounds.x - 3, m_worldBounds.y - 2}, 750.0f));
 }
 
 bool BattalionHandler::areWallsUp() const
@@ -208,42 +183,178 @@ bool BattalionHandler::areWallsUp() const
     return m_defenderWalls.size() > 0;
 }
 
+int BattalionHandler::getTroopCount(Group group) const
+{
+    const std::vector<Handle> &vec = (group == Group::Attacker) ? m_attackerBattalions : m_defenderBattalions;
+
+    int count = 0;
+    for (Handle handle : vec)
+    {
+        count += m_battalions.get(handle)->getTroopCount();
+    }
+    return count;
+}
+
+void BattalionHandler::step(float deltaTime)
+{
+    m_tick++;
+    if (m_interpolated)
+    {
+        for (Battalion &b : m_battalions)
+        {
+            b.savePositions();
+        }
+    }
+
+    timePhase(TickPhase::RemoveDead, [&]
+              { removeDead(); });
+    timePhase(TickPhase::BeginTick, [&]
+              { beginTick(); });
+    timePhase(TickPhase::UpdateTargets, [&]
+              { updateTargets(); });
+    updateAll(deltaTime);
+}
+
+template <typename Phase>
+void BattalionHandler::timePhase(TickPhase phase, Phase &&run)
+{
+    if (!m_phaseTimes)
+    {
+        run();
+        return;
+    }
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    run();
+    (*m_phaseTimes)[phase] += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+void BattalionHandler::setThreadCount(int threadCount)
+{
+    if (threadCount == 1)
+    {
+        m_threadPool.reset();
+        return;
+    }
+    m_threadPool = std::make_unique<ThreadPool>(threadCount);
+    if (m_threadPool->getThreadCount() == 1)
+    {
+        m_threadPool.reset();
+    }
+}
+
+void BattalionHandler::runParallel(int count, const std::function<void(int)> &task)
+{
+    if (m_threadPool)
+    {
+        m_threadPool->parallelFor(count, task);
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        task(i);
+    }
+}
+
 void BattalionHandler::updateAll(float deltaTime)
 {
-    for (const auto &b : m_attackerBattalions)
+    // Every battalion sees the others as they were at the start of the tick
+    // (centers) or after every battalion moved (troops it attacks), and all
+    // damage is dealt at the end, battalion by battalion in a fixed order, so
+    // the outcome does not depend on how the work was spread over threads.
+    m_updateOrder.clear();
+    for (Handle handle : m_attackerBattalions)
     {
-        b->update(deltaTime, m_defenderWalls, m_defenderCastle, areWallsUp());
+        m_updateOrder.push_back(m_battalions.get(handle));
     }
-    for (const auto &b : m_defenderBattalions)
+    for (Handle handle : m_defenderBattalions)
     {
-        b->update(deltaTime, m_defenderWalls, m_defenderCastle, areWallsUp());
+        m_updateOrder.push_back(m_battalions.get(handle));
     }
+
+    const bool wallsUp = areWallsUp();
+    timePhase(TickPhase::Move, [&]
+              { runParallel(m_updateOrder.size(), [&](int i)
+                            { m_updateOrder[i]->beginUpdate(deltaTime, m_defenderWalls, m_castles, m_defenderCastle, wallsUp); }); });
+
+    // the troops attacked this tick have moved now and stay put until the
+    // attacks are planned, the grid and the plain scans see the same positions
+    timePhase(TickPhase::Positions, [&]
+              { cacheCombatPositions(); });
+    timePhase(TickPhase::Grid, [&]
+              { rebuildTroopGrid(); });
+
+    timePhase(TickPhase::PlanAttack, [&]
+              {
+        buildAttackChunks();
+        runParallel(m_attackChunks.size(), [&](int i)
+                    { m_attackChunks[i].battalion->planAttack(m_attackChunks[i].begin, m_attackChunks[i].end); }); });
+
+    timePhase(TickPhase::Turn, [&]
+              { runParallel(m_updateOrder.size(), [&](int i)
+                            { m_updateOrder[i]->endUpdate(deltaTime); }); });
+
+    timePhase(TickPhase::ResolveAttack, [&]
+              {
+        for (Battalion *b : m_updateOrder)
+        {
+            b->resolveAttack();
+        } });
 }
 
-void BattalionHandler::updateTargets()
+void BattalionHandler::cacheCombatPositions()
 {
-    // if there are atleast this many troops that can chase the target, dont update target
-    const float threshold = 0.4;
+    // marching battalions nobody attacks keep only their frame
+    m_combatBattalions.clear();
+    for (Battalion *b : m_updateOrder)
+    {
+        if (b->m_attackKind == AttackKind::Troops)
+        {
+            m_combatBattalions.push_back(b);
+            m_combatBattalions.push_back(b->m_attackTarget);
+        }
+    }
+    std::sort(m_combatBattalions.begin(), m_combatBattalions.end());
+    m_combatBattalions.erase(std::unique(m_combatBattalions.begin(), m_combatBattalions.end()), m_combatBattalions.end());
 
-    for (auto &battalion : m_attackerBattalions)
+    runParallel(m_combatBattalions.size(), [&](int i)
+                { m_combatBattalions[i]->m_troops.cacheWorldPositions(); });
+}
+
+void BattalionHandler::buildAttackChunks()
+{
+    m_attackChunks.clear();
+    for (Battalion *b : m_updateOrder)
     {
-        if (battalion->getLookoutRatio() < threshold)
+        if (b->m_attackKind == AttackKind::None)
         {
-            std::shared_ptr<Battalion> target = getTarget(battalion);
-            if (battalion->getLookoutRatio(target))
-            {
-                battalion->m_target = target;
-            }
+            continue;
+        }
+        for (int begin = 0; begin < b->getTroopCount(); begin += const_attackChunkSize)
+        {
+            m_attackChunks.push_back(AttackChunk{b, begin, std::min(begin + const_attackChunkSize, b->getTroopCount())});
         }
     }
-    for (auto &battalion : m_defenderBattalions)
+}
+
+void BattalionHandler::updateTargets()
+{
+    // if there are atleast this many troops that can chase the target, dont update target
+    const float threshold = 0.4;
+
+    for (const std::vector<Handle> *battalions : {&m_attackerBattalions, &m_defenderBattalions})
     {
-        if (battalion->getLookoutRatio() < threshold)
+        for (Handle handle : *battalions)
         {
-            std::shared_ptr<Battalion> target = getTarget(battalion);
-            if (battalion->getLookoutRatio(target))
+            Battalion &battalion = *m_battalions.get(handle);
+            if (battalion.getLookoutRatio() < threshold)
             {
-                battalion->m_target = target;
+                const Handle target = getTarget(battalion);
+                if (target != const_nullHandle && battalion.getLookoutRatio(*m_battalions.get(target)))
+                {
+                    battalion.m_target = target;
+                }
             }
         }
     }
@@ -251,35 +362,134 @@ void BattalionHandler::updateTargets()
 
 void BattalionHandler::removeDead()
 {
-    std::vector<std::shared_ptr<Battalion>> *vec = nullptr;
-    auto predicate = [](std::shared_ptr<Battalion> battalion)
+    for (Battalion &b : m_battalions)
     {
-        return battalion->getTroopCount() == 0;
-    };
+        b.removeDead();
+    }
+    updateCenterTrees();
 
-    vec = &m_attackerBattalions;
-    auto it1 = std::remove_if(vec->begin(), vec->end(), predicate);
-    vec->erase(it1, vec->end());
+    // the handles of the removed battalions stop resolving, which drops
+    // them as targets too
+    auto predicate = [&](Handle handle)
+    {
+        if (m_battalions.get(handle)->getTroopCount() > 0)
+        {
+            return false;
+        }
+        m_battalions.remove(handle);
+        return true;
+    };
 
-    vec = &m_defenderBattalions;
-    auto it2 = std::remove_if(vec->begin(), vec->end(), predicate);
-    vec->erase(it2, vec->end());
+    for (std::vector<Handle> *vec : {&m_attackerBattalions, &m_defenderBattalions})
+    {
+        vec->erase(std::remove_if(vec->begin(), vec->end(), predicate), vec->end());
+    }
 
     // remove walls
-    if (Wall::getHP() <= 0)
+    if (m_wallHealth <= 0)
     {
         m_defenderWalls.clear();
     }
 }
 
+void BattalionHandler::beginTick()
+{
+    // the castle is always in the way, the walls until they fall; the paths
+    // only change when they do
+    m_obstacles.clear();
+    m_obstacles.push_back(getCastle().getFootprint());
+    for (const Wall &wall : m_defenderWalls)
+    {
+        m_obstacles.push_back(wall.getFootprint());
+    }
+    m_flowFields.setObstacles(m_worldBounds, m_obstacles);
+    m_flowFields.beginTick(m_tick);
+
+    for (Battalion &b : m_battalions)
+    {
+        b.m_flowFields = &m_flowFields;
+        b.m_grid = &m_troopGrid;
+        b.m_gridId = -1;
+        b.m_tick = m_tick;
+        b.m_seed = m_seed;
+        b.m_gridFresh = true;
+    }
+}
+
+void BattalionHandler::rebuildTroopGrid()
+{
+    // cells no wider than the shortest attack range, lookups search outwards
+    // from their own cell and rarely need more than its neighbours
+    m_troopGrid.clear(const_attackRange[(int)BType::Warrior]);
+    m_gridBattalions.clear();
+
+    // only the battalions attacked this tick are put in the grid, and only
+    // the large ones, for which it beats a plain scan over their troops
+    for (Battalion *b : m_updateOrder)
+    {
+        Battalion *target = b->m_attackTarget;
+        if (b->m_attackKind != AttackKind::Troops || target->m_gridId >= 0 || target->getTroopCount() < const_gridMinTroops)
+        {
+            continue;
+        }
+
+        target->m_gridId = m_gridBattalions.size();
+        m_gridBattalions.push_back(target->m_handle);
+
+        const TroopStorage &troops = target->m_troops;
+        for (int i = 0; i < troops.size(); i++)
+        {
+            m_troopGrid.add(target->m_gridId, i, troops.worldX[i], troops.worldY[i]);
+        }
+    }
+    m_troopGrid.build();
+}
+
+void BattalionHandler::addCenter(Battalion &battalion)
+{
+    CenterTree &centers = (battalion.m_group == Group::Attacker) ? m_attackerCenters : m_defenderCenters;
+
+    // keys follow the spawn order, which is also the order of the battalion
+    // vectors, so nearest center ties resolve the same way a scan would
+    battalion.m_key = m_centerBattalions.size();
+    m_centerBattalions.push_back(battalion.m_handle);
+    centers.insert(battalion.m_key, battalion.m_center);
+}
+
+void BattalionHandler::updateCenterTrees()
+{
+    auto moveCenters = [&](const std::vector<Handle> &vec, CenterTree &centers)
+    {
+        for (Handle handle : vec)
+        {
+            const Battalion *b = m_battalions.get(handle);
+            if (b->getTroopCount() > 0)
+            {
+                centers.move(b->m_key, b->m_center);
+            }
+            else
+            {
+                centers.remove(b->m_key);
+                m_centerBattalions[b->m_key] = const_nullHandle;
+            }
+        }
+    };
+
+    moveCenters(m_attackerBattalions, m_attackerCenters);
+    moveCenters(m_defenderBattalions, m_defenderCenters);
+    m_attackerCenters.update();
+    m_defenderCenters.update();
+}
+
 void BattalionHandler::printDetails() const
 {
     std::stringstream stream;
     stream << "Overview\n";
 
     stream << "--- Group: Attacker ---\n";
-    for (const auto &b : m_attackerBattalions)
+    for (Handle handle : m_attackerBattalions)
     {
+        const Battalion *b = m_battalions.get(handle);
         stream << " Id: " << b->m_id;
         stream << " Type: " << ((b->m_btype == BType::Archer) ? "Archer" : "Warrior");
         stream << " TroopCount: " << b->getTroopCount();
@@ -289,8 +499,9 @@ void BattalionHandler::printDetails() const
     }
 
     stream << "--- Group: Defender ---\n";
-    for (const auto &b : m_defenderBattalions)
+    for (Handle handle : m_defenderBattalions)
     {
+        const Battalion *b = m_battalions.get(handle);
         stream << " Id: " << b->m_id;
         stream << " Type: " << ((b->m_btype == BType::Archer) ? "Archer" : "Warrior");
         stream << " TroopCount: " << b->getTroopCount();
@@ -299,95 +510,50 @@ void BattalionHandler::printDetails() const
         stream << "\n";
     }
 
+#ifdef HEADLESS
+    fprintf(stderr, "%s", stream.str().c_str());
+#else
     TraceLog(LOG_WARNING, "%s", stream.str().c_str());
+#endif
 }
 
 void BattalionHandler::selectBattalion(Vector2 position, float threshold)
 {
-    std::shared_ptr<Battalion> closest;
-    float closestDistance = std::numeric_limits<float>::max();
+    Handle closest = const_nullHandle;
+    float closestDistSqr = threshold * threshold;
 
-    for (const auto &other : m_attackerBattalions)
+    auto checkBattalions = [&](const std::vector<Handle> &vec)
     {
-        const float distance = Vector2Distance(position, other->m_center);
-        if (distance < closestDistance)
+        for (Handle handle : vec)
         {
-            closestDistance = distance;
-            closest = other;
-        }
-    }
-
-    for (const auto &other : m_defenderBattalions)
-    {
-        const float distance = Vector2Distance(position, other->m_center);
-        if (distance < closestDistance)
-        {
-            closestDistance = distance;
-            closest = other;
+            const Battalion *other = m_battalions.get(handle);
+            float distSqr;
+            if (other->m_troops.countInRangeByBounds(position, threshold) != 0 &&
+                other->m_troops.nearest(position, distSqr) >= 0 && distSqr < closestDistSqr)
+            {
+                closestDistSqr = distSqr;
+                closest = handle;
+            }
         }
-    }
-
-    m_selectedBattalion = (closestDistance < threshold) ? closest : std::weak_ptr<Battalion>();
-}
-
-void BattalionHandler::drawInfoPanel(const Camera2D &camera) const
-{
-    if (auto b = m_selectedBattalion.lock())
-    {
-        const Vector2 screenPos = GetWorldToScreen2D(b->m_center, camera);
-        const float panelWidth = 250;
-
-        const float x = screenPos.x - panelWidth / 2;
-        const float y = screenPos.y - 150;
-
-        const Color tintColor = (b->m_group == Group::Attacker) ? Color{255, 0, 0, 255} : Color{0, 0, 255, 255};
-        GuiSetStyle(DEFAULT, BACKGROUND_COLOR, ColorToInt(ColorTint(DARKGRAY, tintColor)));
-        GuiPanel({x, y, panelWidth, 130}, nullptr);
-
-        GuiSetStyle(LABEL, TEXT_ALIGNMENT, TEXT_ALIGN_CENTER);
-        GuiSetStyle(DEFAULT, TEXT_SIZE, 24);
-
-        GuiLabel({x + 10, y + 2, panelWidth - 20, 30}, TextFormat("Battalion Id: %d", b->m_id));
-        GuiLine({x + 5, y + 30, panelWidth - 10, 5}, nullptr);
-
-        GuiSetStyle(LABEL, TEXT_ALIGNMENT, TEXT_ALIGN_LEFT);
-        GuiSetStyle(DEFAULT, TEXT_SIZE, 16);
-
-        const char *text = TextFormat("Type: %s", ((b->m_btype == BType::Warrior) ? "Warrior" : "Archer"));
-        const Vector2 textSize = MeasureTextEx(GuiGetFont(), text, 16, 1);
-        GuiLabel({x + 10, y + 40, panelWidth - 20, 20}, text);
-
-        const Rectangle srcRect = (b->m_btype == BType::Warrior) ? Rectangle{8, 0, 8, 8} : Rectangle{0, 0, 8, 8};
-        DrawTexturePro(m_uiSpriteSheet, srcRect, {x + 15 + textSize.x, y + 40, 16, 16}, {0, 0}, 0, WHITE);
-
-        GuiLabel({x + 10, y + 60, panelWidth - 20, 20}, TextFormat("Center: %.2f, %.2f", b->m_center.x, b->m_center.y));
+    };
 
-        const int troopCount = b->getTroopCount();
-        const int iniTroopCount = b->getInitialTroopCount();
-        text = TextFormat("TroopPercent: %.2f%%", 100 * (float)troopCount / iniTroopCount);
-        GuiLabel({x + 10, y + 80, panelWidth - 20, 20}, text);
+    checkBattalions(m_attackerBattalions);
+    checkBattalions(m_defenderBattalions);
 
-        text = TextFormat("TroopCount: %d", troopCount);
-        GuiLabel({x + 10, y + 100, panelWidth - 20, 20}, text);
-    }
+    m_selectedBattalion = closest;
 }
 
-std::shared_ptr<Battalion> BattalionHandler::getTarget(std::shared_ptr<Battalion> battalion) const
+Handle BattalionHandler::getTarget(const Battalion &battalion) const
 {
-    const std::vector<std::shared_ptr<Battalion>> &vec = (battalion->m_group == Group::Attacker) ? m_defenderBattalions : m_attackerBattalions;
+    const CenterTree &centers = (battalion.m_group == Group::Attacker) ? m_defenderCenters : m_attackerCenters;
 
-    std::shared_ptr<Battalion> newTarget;
-    float closestDistance = std::numeric_limits<float>::max();
-
-    for (const auto &other : vec)
+    // enemies farther away than the reach have no troop of the battalion in
+    // lookout range, the search never descends into them
+    int key;
+    float distance;
+    if (!centers.nearest(battalion.m_center, battalion.getLookoutReach(), key, distance))
     {
-        const float distance = Vector2Distance(battalion->m_center, other->m_center);
-        if (distance < closestDistance)
-        {
-            closestDistance = distance;
-            newTarget = other;
-        }
+        return const_nullHandle;
     }
-
-    return newTarget;
+    return m_centerBattalions[key];
 }
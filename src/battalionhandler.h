@@ -1,68 +1,221 @@
 
-#pragma
+#pragma once
 
 #include "src/battalionspawninfo.h"
 #include "src/battalion.h"
+#include "src/centertree.h"
+#include "src/flowfield.h"
+#include "src/handlepool.h"
+#include "src/snapshot.h"
+#include "src/threadpool.h"
 #include <vector>
-#include <raylib/raylib.h>
 #include <memory>
+#include <string>
 #include "src/wall.h"
 #include "src/castle.h"
 
+/// @brief phases of BattalionHandler::step, in the order they run
+enum class TickPhase
+{
+    RemoveDead,
+    BeginTick,
+    UpdateTargets,
+    Move,      // Battalion::beginUpdate
+    Positions, // cacheCombatPositions
+    Grid,      // rebuildTroopGrid
+    PlanAttack,
+    Turn,      // Battalion::endUpdate
+    ResolveAttack,
+    Count
+};
+
+/// @brief time spent in every phase of BattalionHandler::step, in nanoseconds, summed over the ticks
+struct TickPhaseTimes
+{
+    double ns[(int)TickPhase::Count] = {};
+
+    double &operator[](TickPhase phase) { return ns[(int)phase]; }
+    double operator[](TickPhase phase) const { return ns[(int)phase]; }
+};
+
 class BattalionHandler
 {
 
 public:
     /// @brief constructor
     BattalionHandler(Vector2 worldBounds);
-    /// @brief destructor
-    ~BattalionHandler();
+
+    // walls point into m_wallHealth and battalions into the pools, neither
+    // would follow a copy or a move; see fork for an independent copy
+    BattalionHandler(const BattalionHandler &) = delete;
+    BattalionHandler &operator=(const BattalionHandler &) = delete;
+    BattalionHandler(BattalionHandler &&) = delete;
+    BattalionHandler &operator=(BattalionHandler &&) = delete;
+
     /// @brief returns true if the game is finished
     bool isGameFinished(Group &winner) const;
     /// @brief spawns battalions under the group provided
     void spawn(Group group, const std::vector<BattalionSpawnInfo> &spawnInfos, bool flag = true);
-    /// @brief draw all the battalions
-    void drawAll() const;
-    /// @brief calls each battalion's update method
+    /// @brief advances the simulation by a single tick
+    void step(float deltaTime);
+    /// @brief updates every battalion, spread over the worker threads if there are any
+    /// the result does not depend on the number of threads
     void updateAll(float deltaTime);
+    /// @brief keeps the positions of the previous tick, so drawing can interpolate between ticks
+    void setInterpolated(bool interpolated) { m_interpolated = interpolated; }
+    /// @brief sets the seed of every random number of the battle
+    void setSeed(uint64_t seed) { m_seed = seed; }
+    uint64_t getSeed() const { return m_seed; }
+    /// @brief sets the number of threads updateAll uses, 0 for one per hardware thread
+    void setThreadCount(int threadCount);
+    /// @brief adds the time every phase of step takes to times, nullptr (the default) stops timing
+    void setPhaseTimes(TickPhaseTimes *times) { m_phaseTimes = times; }
     /// @brief makes sure that each battalion has a target
     void updateTargets();
-    /// @brief removes battalions that are dead
+    /// @brief removes dead troops and the battalions left without any
     void removeDead();
     /// @brief gives an overview of the battalions
     void printDetails() const;
-    /// @brief selects the closest battalion to the position
+    /// @brief selects the battalion with the closest troop to the position
     void selectBattalion(Vector2 position, float threshold);
-    /// @brief displays the information of the selected battalion
-    void drawInfoPanel(const Camera2D &camera) const;
     /// @brief initialize walls
     void initWalls();
     /// @brief initialize castle
     void initCastle();
+    /// @brief checks if walls are up
+    bool areWallsUp() const;
+    /// @brief returns the number of troops still alive in the group
+    int getTroopCount(Group group) const;
+    /// @brief returns the remaining castle health
+    float getCastleHealth() const { return getCastle().health; }
+    /// @brief returns the remaining wall health, 0 once the wall fell
+    float getWallHealth() const { return areWallsUp() ? m_wallHealth : 0.0f; }
+
+    /// @brief copies the state of the battle into a flat buffer
+    SimulationSnapshot saveSnapshot() const;
+    /// @brief replaces the state of the battle with the snapshot
+    /// threads and interpolation stay as they are set on this handler
+    /// @return false if the snapshot is not valid, `error` says why; the battle is then empty
+    bool restoreSnapshot(const SimulationSnapshot &snapshot, std::string &error);
+    /// @brief returns an independent copy of the battle that continues from the current tick
+    /// a full deep copy: the battle is saved to a snapshot and restored into a
+    /// new handler, which costs as much as both, nothing is shared afterwards;
+    /// it runs on the calling thread only until setThreadCount is called on it
+    /// @return nullptr if the copy could not be restored from the snapshot of this battle
+    std::unique_ptr<BattalionHandler> fork() const;
+
+#ifndef HEADLESS
+    /// @brief loads the spritesheets used for drawing
+    void loadTextures();
+    /// @brief unloads the spritesheets used for drawing
+    void unloadTextures();
+    /// @brief draw all the battalions, alpha [0.0 to 1.0] of the way from the previous tick to the current one
+    /// only the troops in view of camera are drawn, the walls and the castle are left to drawStatic
+    void drawAll(float alpha, const Camera2D &camera) const;
+    /// @brief displays the information of the selected battalion
+    void drawInfoPanel(const Camera2D &camera) const;
+    /// @brief draws the walls and the castle, which only change with getStaticKey
+    void drawStatic() const;
+    /// @brief returns a number that changes whenever drawStatic would draw something different
+    int getStaticKey() const;
     /// @brief draws the wall
     void drawWall() const;
     /// @brief draws the castle
     void drawCastle() const;
-    /// @brief checks if walls are up
-    bool areWallsUp() const;
+#endif
 
 private:
-    /// @brief get the target for the battalion provided
-    std::shared_ptr<Battalion> getTarget(std::shared_ptr<Battalion> battalion) const;
+    /// @brief get the target for the battalion provided, the closest enemy within its lookout reach
+    /// const_nullHandle if there is none
+    Handle getTarget(const Battalion &battalion) const;
+    /// @brief adds a battalion to the pool and to the end of its group
+    void addBattalion(Battalion battalion);
+    Castle &getCastle() { return *m_castles.get(m_defenderCastle); }
+    const Castle &getCastle() const { return *m_castles.get(m_defenderCastle); }
+    /// @brief runs task(i) for every i in [0, count), on the worker threads if there are any
+    void runParallel(int count, const std::function<void(int)> &task);
+    /// @brief runs phase, adding the time it took to m_phaseTimes if it is set
+    template <typename Phase>
+    void timePhase(TickPhase phase, Phase &&run);
+    /// @brief splits the troops of the attacking battalions in m_updateOrder into attack planning tasks
+    void buildAttackChunks();
+    /// @brief hands every battalion the tick, the seed, the troop grid and the paths around the obstacles
+    void beginTick();
+    /// @brief caches the world positions of the battalions that attack troops or are attacked this tick
+    /// call after every battalion moved, the attacks and the troop grid read them
+    void cacheCombatPositions();
+    /// @brief rebuilds the troop grid from the current positions of the battalions attacked this tick
+    /// call after every battalion moved, before the attacks are planned
+    void rebuildTroopGrid();
+    /// @brief gives a new battalion its key and adds its center to its group's center tree
+    void addCenter(Battalion &battalion);
+    /// @brief moves the battalion centers in the center trees, drops the ones without troops
+    void updateCenterTrees();
+    /// @brief drops every battalion and resets the castle and the walls
+    void resetBattle();
 
 private:
-    std::vector<std::shared_ptr<Battalion>> m_attackerBattalions;
-    std::vector<std::shared_ptr<Battalion>> m_defenderBattalions;
+    // every battalion, in no particular order; the group lists below hold
+    // their handles in spawn order, which is the order they are updated in
+    HandlePool<Battalion> m_battalions;
+    std::vector<Handle> m_attackerBattalions;
+    std::vector<Handle> m_defenderBattalions;
+
+    HandlePool<Castle> m_castles;
+    Handle m_defenderCastle = const_nullHandle;
+    HandlePool<Wall> m_defenderWalls;
+    // shared by every wall segment
+    float m_wallHealth = TOTAL_HEALTH;
+
+    Handle m_selectedBattalion = const_nullHandle;
 
-    std::shared_ptr<Castle> m_defenderCastle;
-    std::vector<std::shared_ptr<Wall>> m_defenderWalls;
+    // every troop of the large battalions attacked this tick, indexed by Battalion::m_gridId
+    SpatialGrid m_troopGrid;
+    std::vector<Handle> m_gridBattalions;
+    // paths to the castle, the walls and the targets, around the castle and the walls
+    FlowFields m_flowFields;
+    std::vector<Rectangle> m_obstacles;
+    int m_tick = 0;
+    uint64_t m_seed = 0;
+    bool m_interpolated = false;
 
-    std::weak_ptr<Battalion> m_selectedBattalion;
+    // battalion centers of each group, indexed by Battalion::m_key
+    CenterTree m_attackerCenters;
+    CenterTree m_defenderCenters;
+    std::vector<Handle> m_centerBattalions;
 
     Vector2 m_worldBounds;
 
+    // null while updating on the calling thread only
+    std::unique_ptr<ThreadPool> m_threadPool;
+    // null unless the phases are timed
+    TickPhaseTimes *m_phaseTimes = nullptr;
+    // battalion and troop range of every attack planning task
+    struct AttackChunk
+    {
+        Battalion *battalion;
+        int begin;
+        int end;
+    };
+    std::vector<Battalion *> m_updateOrder;
+    std::vector<AttackChunk> m_attackChunks;
+    // battalions whose world positions are cached this tick
+    std::vector<Battalion *> m_combatBattalions;
+
+#ifndef HEADLESS
     Texture2D m_troopSpriteSheet;
     Texture2D m_wallSpriteSheet;
     Texture2D m_wallCornerSpriteSheet;
     Texture m_uiSpriteSheet;
+    TroopFrames m_troopFrames;
+    // every visible troop of the frame, refilled by drawAll
+    mutable SpriteBatch m_troopBatch;
+    // troops of the battalions drawn at LodLevel::Density, updated once per tick
+    mutable DensityMap m_densityMap;
+    mutable int m_densityTick = -1;
+#endif
+
+    // probes the battalions between ticks, see bench/benchmark.cpp
+    friend class BenchmarkAccess;
+    friend class ReplayRecorder;
 };
@@ -1,7 +1,7 @@
 
 #pragma once
 
-#include <raylib/raylib.h>
+#include "src/simmath.h"
 #include <vector>
 
 struct BattalionSpawnInfo
@@ -9,4 +9,10 @@ struct BattalionSpawnInfo
     int id;
     int btype;
     std::vector<Vector2> troops;
-};
\ No newline at end of file
+};
+
+struct InitialGameState
+{
+    std::vector<BattalionSpawnInfo> attackerBattalions;
+    std::vector<BattalionSpawnInfo> defenderBattalions;
+};
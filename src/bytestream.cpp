@@ -0,0 +1,151 @@
+
+#include "src/bytestream.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+void ByteWriter::writeVarint(uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        m_data.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    m_data.push_back((uint8_t)value);
+}
+
+void ByteWriter::writeU32(uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        m_data.push_back((uint8_t)(value >> (8 * i)));
+    }
+}
+
+void ByteWriter::writeFloat(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    writeU32(bits);
+}
+
+void ByteWriter::writeBytes(const void *bytes, size_t count)
+{
+    const uint8_t *begin = (const uint8_t *)bytes;
+    m_data.insert(m_data.end(), begin, begin + count);
+}
+
+uint8_t ByteReader::readByte()
+{
+    if (m_cur == m_end)
+    {
+        m_failed = true;
+        return 0;
+    }
+    return *m_cur++;
+}
+
+uint64_t ByteReader::readVarint()
+{
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (m_cur == m_end)
+        {
+            m_failed = true;
+            return 0;
+        }
+        const uint8_t byte = *m_cur++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return value;
+        }
+    }
+    // more than 10 bytes
+    m_failed = true;
+    return 0;
+}
+
+uint32_t ByteReader::readU32()
+{
+    if (remaining() < 4)
+    {
+        m_failed = true;
+        m_cur = m_end;
+        return 0;
+    }
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        value |= (uint32_t)*m_cur++ << (8 * i);
+    }
+    return value;
+}
+
+float ByteReader::readFloat()
+{
+    const uint32_t bits = readU32();
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+bool ByteReader::readBytes(void *bytes, size_t count)
+{
+    if (remaining() < count)
+    {
+        m_failed = true;
+        m_cur = m_end;
+        return false;
+    }
+    memcpy(bytes, m_cur, count);
+    m_cur += count;
+    return true;
+}
+
+bool ByteReader::skip(size_t count)
+{
+    if (remaining() < count)
+    {
+        m_failed = true;
+        m_cur = m_end;
+        return false;
+    }
+    m_cur += count;
+    return true;
+}
+
+bool writeBinaryFile(const char *path, const std::vector<uint8_t> &data, std::string &error)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        error = "cannot open file for writing";
+        return false;
+    }
+    file.write((const char *)data.data(), data.size());
+    if (!file)
+    {
+        error = "cannot write file";
+        return false;
+    }
+    return true;
+}
+
+bool readBinaryFile(const char *path, std::vector<uint8_t> &data, std::string &error)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        error = "cannot open file";
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (file.bad())
+    {
+        error = "cannot read file";
+        return false;
+    }
+    return true;
+}
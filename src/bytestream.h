@@ -0,0 +1,67 @@
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Little endian byte buffers with LEB128 varints, shared by the binary
+// formats of the simulation (replays, snapshots).
+
+/// @brief maps signed values to unsigned ones so that small magnitudes stay small
+inline uint64_t zigzagEncode(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+inline int64_t zigzagDecode(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+class ByteWriter
+{
+
+public:
+    void writeByte(uint8_t value) { m_data.push_back(value); }
+    void writeVarint(uint64_t value);
+    void writeSigned(int64_t value) { writeVarint(zigzagEncode(value)); }
+    void writeU32(uint32_t value);
+    void writeFloat(float value);
+    void writeBytes(const void *bytes, size_t count);
+
+    size_t size() const { return m_data.size(); }
+    void clear() { m_data.clear(); }
+    const std::vector<uint8_t> &getData() const { return m_data; }
+
+private:
+    std::vector<uint8_t> m_data;
+};
+
+/// @brief reads what ByteWriter wrote, reads past the end or malformed
+/// varints return 0 and set the failed flag instead of touching memory
+class ByteReader
+{
+
+public:
+    ByteReader(const uint8_t *data, size_t size)
+        : m_cur(data), m_end(data + size)
+    {
+    }
+
+    uint8_t readByte();
+    uint64_t readVarint();
+    int64_t readSigned() { return zigzagDecode(readVarint()); }
+    uint32_t readU32();
+    float readFloat();
+    bool readBytes(void *bytes, size_t count);
+    /// @brief skips count bytes, fails if there are fewer left
+    bool skip(size_t count);
+
+    size_t remaining() const { return m_end - m_cur; }
+    const uint8_t *position() const { return m_cur; }
+    bool failed() const { return m_failed; }
+
+private:
+    const uint8_t *m_cur;
+    const uint8_t *m_end;
+    bool m_failed = false;
+};
+
+/// @brief writes data to the file at path
+bool writeBinaryFile(const char *path, const std::vector<uint8_t> &data, std::string &error);
+/// @brief reads the whole file at path into data
+bool readBinaryFile(const char *path, std::vector<uint8_t> &data, std::string &error);
@@ -1,7 +1,6 @@
 #pragma once
 
-#include <raylib/raylib.h>
-#include <raylib/raymath.h>
+#include "src/simmath.h"
 #include <algorithm>
 
 struct Castle
@@ -11,10 +10,15 @@ struct Castle
 
     Castle(Vector2 position, float health) : position(position), health(health) {}
 
-    void draw(Texture2D spritesheet);
+    /// @brief returns the area the castle covers, as drawn
+    Rectangle getFootprint() const { return Rectangle{position.x - 2.0f, position.y - 3.0f, 4.0f, 4.0f}; }
+
+#ifndef HEADLESS
+    void draw(Texture2D spritesheet) const;
+#endif
 
     void takeDamage(float damage)
     {
         health -= damage;
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,249 @@
+
+#include "src/centertree.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+// centers per leaf
+const int const_leafSize = 8;
+// centers barely move between ticks, but the boxes of a refitted tree drift
+// apart from its split planes, so it is rebuilt from time to time anyway
+const int const_maxRefits = 60;
+
+} // namespace
+
+void CenterTree::clear()
+{
+    m_size = 0;
+    m_removed = 0;
+    m_refits = 0;
+    m_inserted = false;
+    m_order.clear();
+    m_nodes.clear();
+    m_keyPosition.clear();
+    m_keyAlive.clear();
+}
+
+void CenterTree::insert(int key, Vector2 position)
+{
+    if (key >= (int)m_keyAlive.size())
+    {
+        m_keyPosition.resize(key + 1);
+        m_keyAlive.resize(key + 1, false);
+    }
+
+    m_keyPosition[key] = position;
+    m_keyAlive[key] = true;
+    m_size++;
+    m_inserted = true;
+}
+
+void CenterTree::move(int key, Vector2 position)
+{
+    m_keyPosition[key] = position;
+}
+
+void CenterTree::remove(int key)
+{
+    m_keyAlive[key] = false;
+    m_size--;
+    m_removed++;
+}
+
+void CenterTree::update()
+{
+    if (m_inserted || m_removed * 4 > m_size || m_refits >= const_maxRefits)
+    {
+        rebuild();
+    }
+    else
+    {
+        refit();
+    }
+}
+
+void CenterTree::rebuild()
+{
+    m_order.clear();
+    for (int key = 0; key < (int)m_keyAlive.size(); key++)
+    {
+        if (m_keyAlive[key])
+        {
+            m_order.push_back(key);
+        }
+    }
+
+    m_nodes.clear();
+    if (!m_order.empty())
+    {
+        build(0, m_order.size());
+    }
+
+    m_removed = 0;
+    m_refits = 0;
+    m_inserted = false;
+}
+
+int CenterTree::build(int begin, int end)
+{
+    const int index = m_nodes.size();
+    m_nodes.push_back(Node{{0, 0}, {0, 0}, begin, end, -1, -1});
+
+    if (end - begin <= const_leafSize)
+    {
+        fitLeaf(m_nodes[index]);
+        return index;
+    }
+
+    Vector2 min = m_keyPosition[m_order[begin]];
+    Vector2 max = min;
+    for (int i = begin + 1; i < end; i++)
+    {
+        const Vector2 p = m_keyPosition[m_order[i]];
+        min = {std::min(min.x, p.x), std::min(min.y, p.y)};
+        max = {std::max(max.x, p.x), std::max(max.y, p.y)};
+    }
+
+    // split at the median of the wider axis, keys decide between equal
+    // coordinates so the tree only depends on the centers
+    const bool splitX = (max.x - min.x) >= (max.y - min.y);
+    const int mid = (begin + end) / 2;
+    std::nth_element(m_order.begin() + begin, m_order.begin() + mid, m_order.begin() + end, [&](int a, int b)
+                     {
+        const float pa = splitX ? m_keyPosition[a].x : m_keyPosition[a].y;
+        const float pb = splitX ? m_keyPosition[b].x : m_keyPosition[b].y;
+        return (pa != pb) ? pa < pb : a < b; });
+
+    const int left = build(begin, mid);
+    const int right = build(mid, end);
+
+    Node &node = m_nodes[index];
+    node.left = left;
+    node.right = right;
+    node.min = {std::min(m_nodes[left].min.x, m_nodes[right].min.x), std::min(m_nodes[left].min.y, m_nodes[right].min.y)};
+    node.max = {std::max(m_nodes[left].max.x, m_nodes[right].max.x), std::max(m_nodes[left].max.y, m_nodes[right].max.y)};
+    return index;
+}
+
+void CenterTree::fitLeaf(Node &node) const
+{
+    // a leaf without live centers gets an inverted box no query can reach
+    node.min = {INFINITY, INFINITY};
+    node.max = {-INFINITY, -INFINITY};
+    for (int i = node.begin; i < node.end; i++)
+    {
+        const int key = m_order[i];
+        if (!m_keyAlive[key])
+        {
+            continue;
+        }
+        const Vector2 p = m_keyPosition[key];
+        node.min = {std::min(node.min.x, p.x), std::min(node.min.y, p.y)};
+        node.max = {std::max(node.max.x, p.x), std::max(node.max.y, p.y)};
+    }
+}
+
+void CenterTree::refit()
+{
+    // children always come after their parent, so walking the nodes
+    // backwards sees both children before the parent
+    for (int i = m_nodes.size() - 1; i >= 0; i--)
+    {
+        Node &node = m_nodes[i];
+        if (node.left < 0)
+        {
+            fitLeaf(node);
+            continue;
+        }
+
+        const Node &left = m_nodes[node.left];
+        const Node &right = m_nodes[node.right];
+        node.min = {std::min(left.min.x, right.min.x), std::min(left.min.y, right.min.y)};
+        node.max = {std::max(left.max.x, right.max.x), std::max(left.max.y, right.max.y)};
+    }
+    m_refits++;
+}
+
+float CenterTree::boxDistance(const Node &node, Vector2 position) const
+{
+    if (node.min.x > node.max.x)
+    {
+        return INFINITY;
+    }
+
+    // never more than the distance to any center inside the box, even
+    // after rounding, so it is safe to prune against
+    const float dx = std::max({node.min.x - position.x, position.x - node.max.x, 0.0f});
+    const float dy = std::max({node.min.y - position.y, position.y - node.max.y, 0.0f});
+    return sqrtf(dx * dx + dy * dy);
+}
+
+bool CenterTree::nearest(Vector2 position, float maxDistance, int &key, float &distance) const
+{
+    if (m_size == 0 || m_nodes.empty())
+    {
+        return false;
+    }
+
+    bool found = false;
+    // deep enough for a tree over any number of centers an int can count
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0)
+    {
+        const Node &node = m_nodes[stack[--top]];
+        // strictly farther only, an equally distant center may have a lower key
+        const float nodeDistance = boxDistance(node, position);
+        if (nodeDistance >= maxDistance || (found && nodeDistance > distance))
+        {
+            continue;
+        }
+
+        if (node.left >= 0)
+        {
+            // the closer child goes on top of the stack
+            const float leftDistance = boxDistance(m_nodes[node.left], position);
+            const float rightDistance = boxDistance(m_nodes[node.right], position);
+            if (leftDistance <= rightDistance)
+            {
+                stack[top++] = node.right;
+                stack[top++] = node.left;
+            }
+            else
+            {
+                stack[top++] = node.left;
+                stack[top++] = node.right;
+            }
+            continue;
+        }
+
+        for (int i = node.begin; i < node.end; i++)
+        {
+            const int candidate = m_order[i];
+            if (!m_keyAlive[candidate])
+            {
+                continue;
+            }
+
+            // compared as distances rather than squared distances, two squares
+            // can round to the same distance and then the key decides
+            const float d = Vector2Distance(position, m_keyPosition[candidate]);
+            if (d >= maxDistance)
+            {
+                continue;
+            }
+            if (!found || d < distance || (d == distance && candidate < key))
+            {
+                distance = d;
+                key = candidate;
+                found = true;
+            }
+        }
+    }
+
+    return found;
+}
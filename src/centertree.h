@@ -0,0 +1,67 @@
+
+#pragma once
+
+#include "src/simmath.h"
+#include <cstdint>
+#include <vector>
+
+/// @brief kd-tree over battalion centers, answering nearest center within radius queries
+/// Every battalion is stored under a key that never changes during its life.
+/// Centers move a little every tick, so `update` normally only refits the
+/// bounding boxes of the existing nodes; the tree is rebuilt when centers
+/// were added, once enough of them were removed, or after a number of refits.
+class CenterTree
+{
+
+public:
+    /// @brief drops every center
+    void clear();
+    /// @brief adds the center of a new key
+    void insert(int key, Vector2 position);
+    /// @brief updates the center of key, takes effect on the next `update`
+    void move(int key, Vector2 position);
+    /// @brief removes key from the tree
+    void remove(int key);
+    /// @brief refits or rebuilds the tree after centers moved, call before querying
+    void update();
+
+    /// @brief finds the closest center nearer than maxDistance, ties are broken by the lower key
+    /// subtrees farther away than maxDistance are never visited
+    /// @return false if there is no center that near
+    bool nearest(Vector2 position, float maxDistance, int &key, float &distance) const;
+    int size() const { return m_size; }
+
+private:
+    struct Node
+    {
+        // bounds of the live centers below this node
+        Vector2 min;
+        Vector2 max;
+        // range of m_order covered by the node
+        int begin;
+        int end;
+        // children, -1 for leaves
+        int left;
+        int right;
+    };
+
+    void rebuild();
+    int build(int begin, int end);
+    void refit();
+    void fitLeaf(Node &node) const;
+    float boxDistance(const Node &node, Vector2 position) const;
+
+private:
+    int m_size = 0;
+    int m_removed = 0;
+    int m_refits = 0;
+    bool m_inserted = false;
+
+    // keys in tree order, removed keys stay until the next rebuild
+    std::vector<int> m_order;
+    std::vector<Node> m_nodes;
+
+    // per key: center and whether it is in the tree
+    std::vector<Vector2> m_keyPosition;
+    std::vector<uint8_t> m_keyAlive;
+};
@@ -0,0 +1,85 @@
+
+#include "src/counterrng.h"
+
+namespace
+{
+
+const uint32_t const_philoxM0 = 0xD2511F53;
+const uint32_t const_philoxM1 = 0xCD9E8D57;
+const uint32_t const_philoxW0 = 0x9E3779B9;
+const uint32_t const_philoxW1 = 0xBB67AE85;
+const int const_philoxRounds = 10;
+
+// 24 random bits, exactly representable as a float in [0, 1)
+inline float toUniform(uint32_t bits)
+{
+    return (bits >> 8) * (1.0f / 16777216.0f);
+}
+
+// every block of 4 consecutive indices comes from one Philox call
+inline void uniformBlock(uint64_t seed, RngStream stream, uint32_t owner, uint32_t tick, uint32_t block, float out[4])
+{
+    const uint32_t counter[4] = {block, tick, owner, (uint32_t)stream};
+    uint32_t bits[4];
+    philox4x32(counter, seed, bits);
+    for (int lane = 0; lane < 4; lane++)
+    {
+        out[lane] = toUniform(bits[lane]);
+    }
+}
+
+} // namespace
+
+void philox4x32(const uint32_t counter[4], uint64_t key, uint32_t out[4])
+{
+    uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    uint32_t k0 = (uint32_t)key;
+    uint32_t k1 = (uint32_t)(key >> 32);
+
+    for (int round = 0; round < const_philoxRounds; round++)
+    {
+        const uint64_t p0 = (uint64_t)const_philoxM0 * c0;
+        const uint64_t p1 = (uint64_t)const_philoxM1 * c2;
+        c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        c1 = (uint32_t)p1;
+        c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c3 = (uint32_t)p0;
+        k0 += const_philoxW0;
+        k1 += const_philoxW1;
+    }
+
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+void fillUniform(uint64_t seed, RngStream stream, uint32_t owner, uint32_t tick, int begin, int end, float *out)
+{
+    float block[4];
+    int i = begin;
+
+    // leading indices up to the first whole block
+    if (i < end && i % 4 != 0)
+    {
+        uniformBlock(seed, stream, owner, tick, i / 4, block);
+        for (; i < end && i % 4 != 0; i++)
+        {
+            out[i - begin] = block[i % 4];
+        }
+    }
+
+    for (; i + 4 <= end; i += 4)
+    {
+        uniformBlock(seed, stream, owner, tick, i / 4, out + (i - begin));
+    }
+
+    if (i < end)
+    {
+        uniformBlock(seed, stream, owner, tick, i / 4, block);
+        for (; i < end; i++)
+        {
+            out[i - begin] = block[i % 4];
+        }
+    }
+}
@@ -0,0 +1,23 @@
+
+#pragma once
+
+#include <cstdint>
+
+// Counter based random numbers (Philox4x32-10): every value is a pure
+// function of the seed and of where it is used, so results do not depend on
+// how many values were drawn before, in which order, or on which thread.
+
+// what the random numbers are used for, so two uses never share values
+enum class RngStream : uint32_t
+{
+    AttackRoll = 0,
+    TileVariant = 1,
+    WorldNoise = 2,
+};
+
+/// @brief scrambles counter under key, returns 4 random words
+void philox4x32(const uint32_t counter[4], uint64_t key, uint32_t out[4]);
+
+/// @brief writes uniform floats in [0, 1) for the indices [begin, end) to out[0, end - begin)
+/// the value of an index only depends on seed, stream, owner, tick and the index itself
+void fillUniform(uint64_t seed, RngStream stream, uint32_t owner, uint32_t tick, int begin, int end, float *out);
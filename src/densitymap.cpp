@@ -0,0 +1,133 @@
+#include "src/densitymap.h"
+#include <algorithm>
+#include <cmath>
+
+// troops per cell at which a cell is fully opaque
+const int const_saturatedCount = 6;
+// opacity of a saturated cell
+const float const_maxAlpha = 200.0f;
+
+void DensityMap::load(Vector2 worldBounds, float cellSize)
+{
+    m_worldBounds = worldBounds;
+    m_cellSize = cellSize;
+    m_width = std::max(1, (int)ceilf(worldBounds.x / cellSize));
+    m_height = std::max(1, (int)ceilf(worldBounds.y / cellSize));
+    m_counts[0].assign(m_width * m_height, 0);
+    m_counts[1].assign(m_width * m_height, 0);
+    m_pixels.assign(m_width * m_height, BLANK);
+    m_sources.clear();
+    m_firstDirtyRow = m_height;
+    m_lastDirtyRow = -1;
+
+    Image image = GenImageColor(m_width, m_height, BLANK);
+    m_texture = LoadTextureFromImage(image);
+    UnloadImage(image);
+    SetTextureFilter(m_texture, TEXTURE_FILTER_BILINEAR);
+}
+
+void DensityMap::unload()
+{
+    UnloadTexture(m_texture);
+    m_texture = {};
+}
+
+void DensityMap::begin()
+{
+    m_stamp++;
+}
+
+int DensityMap::cellOf(Vector2 position) const
+{
+    const float x = position.x / m_cellSize;
+    const float y = position.y / m_cellSize;
+    if (!(x >= 0 && y >= 0 && x < m_width && y < m_height))
+    {
+        return -1;
+    }
+    return (int)y * m_width + (int)x;
+}
+
+void DensityMap::addCount(int group, int cell, int delta)
+{
+    if (cell < 0)
+    {
+        return;
+    }
+    m_counts[group][cell] += delta;
+    const int row = cell / m_width;
+    m_firstDirtyRow = std::min(m_firstDirtyRow, row);
+    m_lastDirtyRow = std::max(m_lastDirtyRow, row);
+}
+
+void DensityMap::removeSource(const Source &source)
+{
+    for (int cell : source.cells)
+    {
+        addCount(source.group, cell, -1);
+    }
+}
+
+void DensityMap::upload(Color attackerColor, Color defenderColor)
+{
+    // battalions that left the density level of detail or the battle
+    for (auto it = m_sources.begin(); it != m_sources.end();)
+    {
+        if (it->second.stamp != m_stamp)
+        {
+            removeSource(it->second);
+            it = m_sources.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    int firstRow = m_height;
+    int lastRow = -1;
+    for (int y = m_firstDirtyRow; y <= m_lastDirtyRow; y++)
+    {
+        for (int x = 0; x < m_width; x++)
+        {
+            const int i = y * m_width + x;
+            const int attackers = m_counts[0][i];
+            const int defenders = m_counts[1][i];
+            const int total = attackers + defenders;
+
+            Color color = BLANK;
+            if (total > 0)
+            {
+                // blend the group colors by their share of the cell
+                const float t = (float)defenders / total;
+                color.r = (unsigned char)(attackerColor.r + (defenderColor.r - attackerColor.r) * t);
+                color.g = (unsigned char)(attackerColor.g + (defenderColor.g - attackerColor.g) * t);
+                color.b = (unsigned char)(attackerColor.b + (defenderColor.b - attackerColor.b) * t);
+                color.a = (unsigned char)(const_maxAlpha * std::min(1.0f, (float)total / const_saturatedCount));
+            }
+
+            Color &pixel = m_pixels[i];
+            if (pixel.r != color.r || pixel.g != color.g || pixel.b != color.b || pixel.a != color.a)
+            {
+                pixel = color;
+                firstRow = std::min(firstRow, y);
+                lastRow = y;
+            }
+        }
+    }
+    m_firstDirtyRow = m_height;
+    m_lastDirtyRow = -1;
+
+    if (lastRow >= firstRow)
+    {
+        const Rectangle rows = {0, (float)firstRow, (float)m_width, (float)(lastRow - firstRow + 1)};
+        UpdateTextureRec(m_texture, rows, &m_pixels[firstRow * m_width]);
+    }
+}
+
+void DensityMap::draw() const
+{
+    const Rectangle source = {0, 0, (float)m_width, (float)m_height};
+    const Rectangle dest = {0, 0, m_width * m_cellSize, m_height * m_cellSize};
+    DrawTexturePro(m_texture, source, dest, Vector2{0, 0}, 0, WHITE);
+}
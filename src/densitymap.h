@@ -0,0 +1,85 @@
+#pragma once
+
+#include "src/handlepool.h"
+#include <raylib/raylib.h>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/// @brief coarse texture of how many troops of each group stand on each cell
+/// Used when zoomed out far enough that single troops are smaller than a few
+/// pixels. The map remembers the cell every troop was counted in, per
+/// battalion, so a tick only changes the counts of the troops that crossed
+/// into another cell and only the rows of texels whose counts changed are
+/// recolored and uploaded again.
+class DensityMap
+{
+
+public:
+    /// @brief allocates the texture, one texel per cellSize world units
+    void load(Vector2 worldBounds, float cellSize);
+    void unload();
+    /// @brief starts a recount, battalions not updated until the next upload are taken out
+    void begin();
+    /// @brief moves the troops of the battalion of handle to the cells at positionAt(0..count-1)
+    /// After troops were removed the indices no longer match the cells, so
+    /// the battalion is then counted again from scratch.
+    template <typename PositionAt>
+    void update(Handle handle, int group, int count, PositionAt &&positionAt);
+    /// @brief takes out the battalions that were not updated, turns the
+    /// counts of the rows that changed into colors and uploads them
+    void upload(Color attackerColor, Color defenderColor);
+    /// @brief draws the map stretched over the world
+    void draw() const;
+
+private:
+    // cells a battalion's troops were counted in, -1 for outside the world
+    struct Source
+    {
+        int group = 0;
+        int stamp = 0;
+        std::vector<int> cells;
+    };
+
+    int cellOf(Vector2 position) const;
+    void addCount(int group, int cell, int delta);
+    void removeSource(const Source &source);
+
+    Vector2 m_worldBounds = {0, 0};
+    float m_cellSize = 1.0f;
+    int m_width = 0;
+    int m_height = 0;
+    std::vector<int> m_counts[2];
+    std::vector<Color> m_pixels;
+    std::unordered_map<Handle, Source> m_sources;
+    int m_stamp = 0;
+    // rows whose counts changed since the last upload
+    int m_firstDirtyRow = 0;
+    int m_lastDirtyRow = -1;
+    Texture2D m_texture = {};
+};
+
+template <typename PositionAt>
+void DensityMap::update(Handle handle, int group, int count, PositionAt &&positionAt)
+{
+    Source &source = m_sources[handle];
+    source.stamp = m_stamp;
+    if ((int)source.cells.size() != count || source.group != group)
+    {
+        removeSource(source);
+        source.group = group;
+        source.cells.assign(count, -1);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        const int cell = cellOf(positionAt(i));
+        int &counted = source.cells[i];
+        if (cell != counted)
+        {
+            addCount(group, counted, -1);
+            addCount(group, cell, 1);
+            counted = cell;
+        }
+    }
+}
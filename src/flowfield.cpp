@@ -0,0 +1,373 @@
+#include "src/flowfield.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <utility>
+
+namespace
+{
+
+const int const_unreachable = INT_MAX;
+// fields nobody asked for in this many ticks are dropped
+const int const_idleTicks = 120;
+// obstacles have to cover a cell by more than this to block it, so that
+// rounding in their corners does not block the row next to them
+const float const_coverMargin = 1e-3f;
+
+// straight steps first, then the diagonals
+const int const_stepX[] = {1, -1, 0, 0, 1, 1, -1, -1};
+const int const_stepY[] = {0, 0, 1, -1, 1, -1, 1, -1};
+const int const_stepCost[] = {10, 10, 10, 10, 14, 14, 14, 14};
+
+bool sameRect(const Rectangle &a, const Rectangle &b)
+{
+    return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+}
+
+/// @brief returns the cell range [x0, x1) by [y0, y1) the rectangle blocks, clamped to the grid
+void getCellRange(const Rectangle &r, int width, int height, int &x0, int &y0, int &x1, int &y1)
+{
+    x0 = std::max(0, (int)floorf(r.x + const_coverMargin));
+    y0 = std::max(0, (int)floorf(r.y + const_coverMargin));
+    x1 = std::min(width, (int)ceilf(r.x + r.width - const_coverMargin));
+    y1 = std::min(height, (int)ceilf(r.y + r.height - const_coverMargin));
+}
+
+/// @brief narrows [t0, t1] to the side of one slab boundary, false if nothing is left
+bool clipSlab(float p, float q, float &t0, float &t1)
+{
+    if (p == 0.0f)
+    {
+        return q > 0.0f;
+    }
+    const float t = q / p;
+    if (p < 0.0f)
+    {
+        t0 = std::max(t0, t);
+    }
+    else
+    {
+        t1 = std::min(t1, t);
+    }
+    return t0 < t1;
+}
+
+/// @brief marks the cells of the width by height grid that an obstacle covers
+void rasterize(const std::vector<Rectangle> &obstacles, int width, int height, std::vector<uint8_t> &blocked)
+{
+    for (const Rectangle &r : obstacles)
+    {
+        int x0, y0, x1, y1;
+        getCellRange(r, width, height, x0, y0, x1, y1);
+        for (int y = y0; y < y1; y++)
+        {
+            std::fill(blocked.begin() + y * width + x0, blocked.begin() + y * width + std::max(x0, x1), 1);
+        }
+    }
+}
+
+} // namespace
+
+void FlowFields::setObstacles(Vector2 worldBounds, const std::vector<Rectangle> &obstacles)
+{
+    const bool sameBounds = worldBounds.x == m_worldBounds.x && worldBounds.y == m_worldBounds.y;
+    if (sameBounds && obstacles.size() == m_obstacles.size() &&
+        std::equal(obstacles.begin(), obstacles.end(), m_obstacles.begin(), sameRect))
+    {
+        return;
+    }
+
+    const int width = std::max(1, (int)ceilf(worldBounds.x));
+    const int height = std::max(1, (int)ceilf(worldBounds.y));
+    std::vector<uint8_t> blocked(width * height, 0);
+    rasterize(obstacles, width, height, blocked);
+
+    // distances only ever shrink when cells open up, which a repair can
+    // follow; a cell closing can lengthen any path, so then it starts over
+    bool keepFields = sameBounds && !m_blocked.empty();
+    std::vector<int> opened;
+    for (int i = 0; keepFields && i < (int)blocked.size(); i++)
+    {
+        if (blocked[i] && !m_blocked[i])
+        {
+            keepFields = false;
+        }
+        else if (!blocked[i] && m_blocked[i])
+        {
+            opened.push_back(i);
+        }
+    }
+
+    const std::vector<Rectangle> previous = m_obstacles;
+    m_worldBounds = worldBounds;
+    m_width = width;
+    m_height = height;
+    m_obstacles = obstacles;
+    m_blocked = std::move(blocked);
+
+    if (!keepFields)
+    {
+        m_fields.clear();
+        return;
+    }
+
+    for (auto it = m_fields.begin(); it != m_fields.end();)
+    {
+        Field &field = *it->second;
+        // a field around an obstacle that went away has nothing left to lead to
+        if (field.obstacle >= 0 &&
+            (field.obstacle >= (int)m_obstacles.size() || !sameRect(m_obstacles[field.obstacle], previous[field.obstacle])))
+        {
+            it = m_fields.erase(it);
+            continue;
+        }
+
+        // the opened cells have no cost yet, their neighbours spread theirs into them
+        std::vector<int> open = findGoals(field);
+        for (int cell : opened)
+        {
+            const int x = cell % m_width;
+            const int y = cell / m_width;
+            for (int d = 0; d < 8; d++)
+            {
+                const int nx = x + const_stepX[d];
+                const int ny = y + const_stepY[d];
+                if (nx >= 0 && ny >= 0 && nx < m_width && ny < m_height &&
+                    field.cost[ny * m_width + nx] != const_unreachable)
+                {
+                    open.push_back(ny * m_width + nx);
+                }
+            }
+        }
+        relax(field, std::move(open));
+        updateNext(field);
+        ++it;
+    }
+}
+
+void FlowFields::beginTick(int tick)
+{
+    m_tick = tick;
+    for (auto it = m_fields.begin(); it != m_fields.end();)
+    {
+        if (it->second->lastUsed < tick - const_idleTicks)
+        {
+            it = m_fields.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+Vector2 FlowFields::getHeading(Vector2 position, Vector2 goal, const Rectangle *goalArea) const
+{
+    const Vector2 straight = Vector2Normalize(Vector2Subtract(goal, position));
+    if (m_obstacles.empty())
+    {
+        return straight;
+    }
+
+    int obstacle = -1;
+    for (int i = 0; goalArea && i < (int)m_obstacles.size(); i++)
+    {
+        if (sameRect(m_obstacles[i], *goalArea))
+        {
+            obstacle = i;
+            break;
+        }
+    }
+
+    if (isClear(position, goal, obstacle))
+    {
+        return straight;
+    }
+
+    const int cell = getCell(position);
+    const int goalCell = (obstacle < 0) ? getCell(goal) : -1;
+    if (cell < 0 || (obstacle < 0 && goalCell < 0))
+    {
+        return straight;
+    }
+
+    const Field &field = getField(obstacle, goalCell);
+    const int d = field.next[cell];
+    if (d < 0)
+    {
+        return straight;
+    }
+
+    // head for the middle of the next cell, which keeps the center clear of
+    // the corners it walks around
+    const Vector2 next = {(float)(cell % m_width + const_stepX[d]) + 0.5f, (float)(cell / m_width + const_stepY[d]) + 0.5f};
+    return Vector2Normalize(Vector2Subtract(next, position));
+}
+
+bool FlowFields::isClear(Vector2 a, Vector2 b, int skip) const
+{
+    const float dx = b.x - a.x;
+    const float dy = b.y - a.y;
+    for (int i = 0; i < (int)m_obstacles.size(); i++)
+    {
+        if (i == skip)
+        {
+            continue;
+        }
+
+        const Rectangle &r = m_obstacles[i];
+        float t0 = 0.0f;
+        float t1 = 1.0f;
+        if (clipSlab(-dx, a.x - r.x, t0, t1) && clipSlab(dx, r.x + r.width - a.x, t0, t1) &&
+            clipSlab(-dy, a.y - r.y, t0, t1) && clipSlab(dy, r.y + r.height - a.y, t0, t1))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+const FlowFields::Field &FlowFields::getField(int obstacle, int goalCell) const
+{
+#ifndef THREADPOOL_SERIAL
+    std::lock_guard<std::mutex> lock(m_mutex);
+#endif
+    const int key = (obstacle >= 0) ? -(obstacle + 1) : goalCell;
+    std::unique_ptr<Field> &field = m_fields[key];
+    if (!field)
+    {
+        field = std::make_unique<Field>();
+        field->obstacle = obstacle;
+        field->goalCell = goalCell;
+        field->cost.assign(m_width * m_height, const_unreachable);
+        relax(*field, findGoals(*field));
+        updateNext(*field);
+    }
+    field->lastUsed = m_tick;
+    return *field;
+}
+
+std::vector<int> FlowFields::findGoals(Field &field) const
+{
+    std::vector<int> goals;
+    if (field.obstacle < 0)
+    {
+        goals.push_back(field.goalCell);
+    }
+    else
+    {
+        // every free cell touching the obstacle
+        int x0, y0, x1, y1;
+        getCellRange(m_obstacles[field.obstacle], m_width, m_height, x0, y0, x1, y1);
+        for (int y = std::max(0, y0 - 1); y < std::min(m_height, y1 + 1); y++)
+        {
+            for (int x = std::max(0, x0 - 1); x < std::min(m_width, x1 + 1); x++)
+            {
+                if (!isBlocked(y * m_width + x))
+                {
+                    goals.push_back(y * m_width + x);
+                }
+            }
+        }
+    }
+
+    for (int cell : goals)
+    {
+        field.cost[cell] = 0;
+    }
+    return goals;
+}
+
+void FlowFields::relax(Field &field, std::vector<int> open) const
+{
+    using Entry = std::pair<int, int>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+    for (int cell : open)
+    {
+        queue.push(Entry{field.cost[cell], cell});
+    }
+
+    while (!queue.empty())
+    {
+        const auto [cost, cell] = queue.top();
+        queue.pop();
+        if (cost != field.cost[cell])
+        {
+            continue;
+        }
+
+        for (int d = 0; d < 8; d++)
+        {
+            if (!canStep(field, cell, d))
+            {
+                continue;
+            }
+            const int next = cell + const_stepY[d] * m_width + const_stepX[d];
+            if (cost + const_stepCost[d] < field.cost[next])
+            {
+                field.cost[next] = cost + const_stepCost[d];
+                queue.push(Entry{field.cost[next], next});
+            }
+        }
+    }
+}
+
+void FlowFields::updateNext(Field &field) const
+{
+    field.next.assign(m_width * m_height, -1);
+    for (int cell = 0; cell < m_width * m_height; cell++)
+    {
+        if (field.cost[cell] == 0 || field.cost[cell] == const_unreachable || isBlocked(cell))
+        {
+            continue;
+        }
+
+        int best = field.cost[cell];
+        for (int d = 0; d < 8; d++)
+        {
+            if (!canStep(field, cell, d))
+            {
+                continue;
+            }
+            const int next = cell + const_stepY[d] * m_width + const_stepX[d];
+            if (field.cost[next] < best)
+            {
+                best = field.cost[next];
+                field.next[cell] = d;
+            }
+        }
+    }
+}
+
+bool FlowFields::canStep(const Field &field, int cell, int d) const
+{
+    const int x = cell % m_width + const_stepX[d];
+    const int y = cell / m_width + const_stepY[d];
+    if (x < 0 || y < 0 || x >= m_width || y >= m_height)
+    {
+        return false;
+    }
+
+    // a point goal may lie under an obstacle, it is still where the way ends
+    const int next = y * m_width + x;
+    if (isBlocked(next) && next != field.goalCell)
+    {
+        return false;
+    }
+
+    // diagonal steps must not cut the corner of an obstacle
+    return d < 4 || (!isBlocked(y * m_width + cell % m_width) && !isBlocked(cell - cell % m_width + x));
+}
+
+int FlowFields::getCell(Vector2 position) const
+{
+    const int x = (int)floorf(position.x);
+    const int y = (int)floorf(position.y);
+    if (position.x < 0.0f || position.y < 0.0f || x >= m_width || y >= m_height)
+    {
+        return -1;
+    }
+    return y * m_width + x;
+}
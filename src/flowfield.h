@@ -0,0 +1,88 @@
+#pragma once
+
+#include "src/simmath.h"
+#include "src/threadpool.h"
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#ifndef THREADPOOL_SERIAL
+#include <mutex>
+#endif
+
+/// @brief shared paths around the walls and the castle, one flow field per goal
+/// The world is split into unit cells, the ones under an obstacle are
+/// blocked. A field holds the walking distance of every cell to its goal and
+/// the neighbour to step to next, so every battalion heading for the same goal
+/// looks its way up in the same field. Battalions that can see their goal walk
+/// straight at it and never touch a field.
+///
+/// Distances are whole numbers (10 per straight step, 14 per diagonal one), a
+/// field is therefore the same whether it was built from scratch or repaired
+/// after obstacles went away, which keeps restored and forked battles exact.
+class FlowFields
+{
+
+public:
+    /// @brief sets the world and the obstacles in it, does nothing if neither changed
+    /// fields survive obstacles going away, they are repaired instead of rebuilt;
+    /// a new obstacle or other bounds drop every field
+    void setObstacles(Vector2 worldBounds, const std::vector<Rectangle> &obstacles);
+    /// @brief drops the fields no battalion asked for in a while, must run serially
+    void beginTick(int tick);
+
+    /// @brief returns the unit direction to walk from position to reach goal
+    /// goalArea is the obstacle the goal lies in (a wall or the castle) or
+    /// nullptr if the goal is a point; the goal's own obstacle never blocks the
+    /// way. Safe to call from several threads at once.
+    Vector2 getHeading(Vector2 position, Vector2 goal, const Rectangle *goalArea = nullptr) const;
+
+    /// @brief returns the number of fields currently kept
+    int getFieldCount() const { return m_fields.size(); }
+
+private:
+    struct Field
+    {
+        // obstacle the goal cells surround, -1 for a point goal
+        int obstacle;
+        // cell of a point goal
+        int goalCell;
+        // walking distance to the goal, const_unreachable where there is no way
+        std::vector<int> cost;
+        // neighbour [0 to 8) to step to next, -1 at the goal and where there is no way
+        std::vector<int8_t> next;
+        mutable int lastUsed;
+    };
+
+    /// @brief returns true if no obstacle but skip crosses the segment from a to b
+    bool isClear(Vector2 a, Vector2 b, int skip) const;
+    /// @brief returns the field of the goal, building it on first use
+    const Field &getField(int obstacle, int goalCell) const;
+    /// @brief fills in the goal cells of field and returns them
+    std::vector<int> findGoals(Field &field) const;
+    /// @brief lowers the costs reachable from the cells in open, Dijkstra style
+    void relax(Field &field, std::vector<int> open) const;
+    /// @brief picks the next neighbour of every cell from the costs
+    void updateNext(Field &field) const;
+    /// @brief returns true if a step from cell in direction d stays on free cells
+    bool canStep(const Field &field, int cell, int d) const;
+    bool isBlocked(int cell) const { return m_blocked[cell] != 0; }
+    /// @brief returns the cell of position, -1 outside the world
+    int getCell(Vector2 position) const;
+
+private:
+    Vector2 m_worldBounds = {0.0f, 0.0f};
+    int m_width = 0;
+    int m_height = 0;
+    std::vector<Rectangle> m_obstacles;
+    std::vector<uint8_t> m_blocked;
+    int m_tick = 0;
+
+    // keyed by -(obstacle + 1) for obstacle goals and by the goal cell for
+    // point goals; filled in lazily while the battalions move
+    mutable std::unordered_map<int, std::unique_ptr<Field>> m_fields;
+#ifndef THREADPOOL_SERIAL
+    mutable std::mutex m_mutex;
+#endif
+};
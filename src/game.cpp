@@ -6,10 +6,24 @@
 #include "src/gameparser.h"
 #include <raylib/raymath.h>
 #include <emscripten.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 
+// every page load shows the same world, which is then loaded from the world cache
+const uint64_t const_defaultWorldSeed = 1;
 const float minZoom = 10;
 const float maxZoom = 40;
 
+// simulated seconds per real second, selected with the number keys,
+// 0 runs as many ticks as fit in the frame budget
+const float const_speeds[] = {1, 2, 4, 16, 0};
+const int const_speedKeys[] = {KEY_ONE, KEY_TWO, KEY_THREE, KEY_FOUR, KEY_FIVE};
+// real time the simulation may take per frame, so fast-forward never stalls the page
+const double const_frameBudget = 0.012;
+// frames longer than this (hidden tab, hitch) are not caught up on
+const float const_maxFrameTime = 0.25f;
+
 void emscriptenMainLoop(void *arg)
 {
     ((Game *)arg)->processFrame();
@@ -33,17 +47,20 @@ Game::Game(int windowWidth, int windowHeight, const char *windowTitle)
 
 Game::~Game()
 {
+    m_battalionHandler->unloadTextures();
     delete m_battalionHandler;
     UnloadSound(m_winSound);
     UnloadTexture(m_cloudTexture);
-    UnloadTexture(m_worldTexture);
+    m_world.reset();
+    m_staticLayer.unload();
     CloseAudioDevice();
     CloseWindow();
 }
 
 void Game::startGameLoop()
 {
-    emscripten_set_main_loop_arg(emscriptenMainLoop, this, m_targetFPS, 1);
+    // frames follow the display refresh rate, the simulation keeps its own fixed tick
+    emscripten_set_main_loop_arg(emscriptenMainLoop, this, 0, 1);
 }
 
 void Game::processFrame()
@@ -51,23 +68,7 @@ void Game::processFrame()
     if (m_state == State::RUN_SIMULATION)
     {
         m_cloudDrawOffset += 0.07;
-        m_battalionHandler->removeDead();
-        m_battalionHandler->updateTargets();
-        m_battalionHandler->updateAll(1.0f / m_targetFPS);
-
-        Group winner;
-        if (m_battalionHandler->isGameFinished(winner))
-        {
-            m_state = State::GAME_OVER;
-            if (winner == Group::Attacker)
-            {
-                PlaySound(m_winSound);
-            }
-            else
-            {
-                PlaySound(m_lossSound);
-            }
-        }
+        advanceSimulation();
     }
 
     BeginDrawing();
@@ -79,9 +80,60 @@ void Game::processFrame()
     EndDrawing();
 }
 
+void Game::advanceSimulation()
+{
+    const float tickTime = 1.0f / m_targetFPS;
+    const float speed = const_speeds[m_speedIndex];
+    const double start = GetTime();
+
+    if (speed > 0)
+    {
+        m_accumulator += std::min(GetFrameTime(), const_maxFrameTime) * speed;
+    }
+
+    while (speed == 0 || m_accumulator >= tickTime)
+    {
+        m_battalionHandler->step(tickTime);
+        m_accumulator -= (speed > 0) ? tickTime : 0;
+
+        if (checkGameOver() || GetTime() - start > const_frameBudget)
+        {
+            break;
+        }
+    }
+
+    // what did not fit in the budget is dropped: the battle runs slower than
+    // the selected speed rather than falling further behind every frame
+    if (m_accumulator >= tickTime)
+    {
+        m_accumulator = fmodf(m_accumulator, tickTime);
+    }
+}
+
+bool Game::checkGameOver()
+{
+    Group winner;
+    if (!m_battalionHandler->isGameFinished(winner))
+    {
+        return false;
+    }
+
+    m_state = State::GAME_OVER;
+    if (winner == Group::Attacker)
+    {
+        PlaySound(m_winSound);
+    }
+    else
+    {
+        PlaySound(m_lossSound);
+    }
+    return true;
+}
+
 void Game::setup()
 {
     m_worldBounds = {100, 60};
+    m_worldSeed = const_defaultWorldSeed;
     m_camera = {
         .offset = {GetScreenWidth() / 2.0f, GetScreenHeight() / 2.0f},
         .target = {m_worldBounds.x / 2, m_worldBounds.y / 2},
@@ -103,20 +155,79 @@ void Game::setup()
     };
 
     m_battalionHandler = new BattalionHandler(m_worldBounds);
+    m_battalionHandler->setInterpolated(true);
+    m_battalionHandler->loadTextures();
 
-    WorldGen worldGen;
-    m_worldTexture = worldGen.createWorldTexture(m_worldBounds.x, m_worldBounds.y);
-    m_cloudTexture = worldGen.createCloudTexture();
+    m_world = std::make_unique<ChunkedWorld>(m_worldBounds.x, m_worldBounds.y, m_worldSeed);
+    m_cloudTexture = WorldGen::createCloudTexture();
 
     m_winSound = LoadSound("assets/sfx/win.wav");
     m_lossSound = LoadSound("assets/sfx/loss.wav");
+
+    // one request for the whole loading screen, retried by the loader itself
+    loadInitialGameState(&Game::onInitialGameStateLoaded, this);
+}
+
+void Game::onInitialGameStateLoaded(void *arg, bool ok)
+{
+    Game *game = (Game *)arg;
+    if (!ok)
+    {
+        game->m_loadFailed = true;
+        return;
+    }
+
+    // a battle that arrived broken or not at all stays on the loading
+    // screen with the error, like a request that failed
+    int32_t *packed = takePackedInitialGameState();
+    if (packed == nullptr)
+    {
+        TraceLog(LOG_WARNING, "GAME: Initial game state is missing");
+        game->m_loadFailed = true;
+        return;
+    }
+
+    const float *coords = (const float *)(packed + const_packedHeaderSize + packed[0] * const_packedBattalionSize);
+    InitialGameState gameState;
+    std::string error;
+    const bool parsed = parsePackedGameState(packed, coords, gameState, error);
+    free(packed);
+    if (!parsed)
+    {
+        TraceLog(LOG_WARNING, "GAME: Invalid initial game state: %s", error.c_str());
+        game->m_loadFailed = true;
+        return;
+    }
+
+    game->m_battalionHandler->spawn(Group::Attacker, gameState.attackerBattalions);
+    game->m_battalionHandler->spawn(Group::Defender, gameState.defenderBattalions);
+    game->m_state = State::RUN_SIMULATION;
 }
 
 void Game::drawFrame()
 {
     if (m_state == State::LOADING)
     {
-        const char *text = "Loading... (You should only see this for a few frames)";
+        int attempt, received, total;
+        getInitialGameStateProgress(attempt, received, total);
+
+        const char *text = "Loading...";
+        if (m_loadFailed)
+        {
+            text = "Could not load the battle, refresh to try again";
+        }
+        else if (total > 0)
+        {
+            text = TextFormat("Loading... %d%% (attempt %d)", (int)(100.0f * received / total), attempt);
+        }
+        else if (received > 0)
+        {
+            text = TextFormat("Loading... %d KB (attempt %d)", received / 1024, attempt);
+        }
+        else if (attempt > 1)
+        {
+            text = TextFormat("Loading... (attempt %d)", attempt);
+        }
         const int fontSize = 25;
         const int textWidth = MeasureText(text, fontSize);
         const Vector2 textSize = MeasureTextEx(GetFontDefault(), text, fontSize, fontSize / 10);
@@ -141,10 +252,15 @@ void Game::drawFrame()
     }
     else
     {
+        updateStaticLayer();
+
         BeginMode2D(m_camera);
-        drawCloud(220);
-        drawWorld();
-        m_battalionHandler->drawAll();
+        drawCloudBorder(220);
+        m_staticLayer.draw();
+        // fast-forward at max speed leaves no partial tick to interpolate
+        const float tickTime = 1.0f / m_targetFPS;
+        const float alpha = (const_speeds[m_speedIndex] > 0) ? m_accumulator / tickTime : 1.0f;
+        m_battalionHandler->drawAll(alpha, m_camera);
 
         // zooming in increases opacity
         const float cameraZoomRange = maxZoom - minZoom;
@@ -154,6 +270,7 @@ void Game::drawFrame()
         EndMode2D();
 
         m_battalionHandler->drawInfoPanel(m_camera);
+        drawSpeed();
     }
 }
 
@@ -161,23 +278,14 @@ void Game::processInputs()
 {
     if (m_state == State::LOADING)
     {
-        call_getInitialGameState();
-
-        auto initState = val::take_ownership(getInitialGameState());
-        if (!initState.isNull())
-        {
-            auto gameState = parseInitialGameState(initState);
-            m_battalionHandler->spawn(Group::Attacker, gameState.attackerBattalions);
-            m_battalionHandler->spawn(Group::Defender, gameState.defenderBattalions);
-            m_state = State::RUN_SIMULATION;
-        }
+        // the battle starts from onInitialGameStateLoaded
     }
     else
     {
         const float zoomDelta = 60 * GetMouseWheelMove() * GetFrameTime();
         m_camera.zoom = Clamp(m_camera.zoom + zoomDelta, minZoom, maxZoom);
 
-        SetTextureFilter(m_worldTexture, m_camera.zoom < 15.0f ? TEXTURE_FILTER_ANISOTROPIC_8X : TEXTURE_FILTER_POINT);
+        m_world->setFilter(m_camera.zoom < 15.0f ? TEXTURE_FILTER_ANISOTROPIC_8X : TEXTURE_FILTER_POINT);
 
         Vector2 camMoveVec = {0, 0};
         camMoveVec.x -= IsKeyDown(KEY_A);
@@ -199,6 +307,14 @@ void Game::processInputs()
             m_state = (m_state == State::RUN_SIMULATION) ? State::PAUSE_SIMULATION : State::RUN_SIMULATION;
         }
 
+        for (int i = 0; i < sizeof(const_speedKeys) / sizeof(int); i++)
+        {
+            if (IsKeyPressed(const_speedKeys[i]))
+            {
+                m_speedIndex = i;
+            }
+        }
+
         if (IsKeyPressed(KEY_X))
         {
             m_battalionHandler->printDetails();
@@ -216,15 +332,69 @@ void Game::processInputs()
 
 void Game::drawCloud(uint8_t alpha)
 {
-    const Rectangle srcRect = {m_cloudDrawOffset, 0, (float)m_cloudTexture.width / 2.0f, (float)m_cloudTexture.height};
-    const Rectangle destRect = {-20, -20, m_worldBounds.x + 40, m_worldBounds.y + 40};
-    DrawTexturePro(m_cloudTexture, srcRect, destRect, {0, 0}, 0, {255, 255, 255, alpha});
+    drawCloud(alpha, {-20, -20, m_worldBounds.x + 40, m_worldBounds.y + 40});
+}
+
+void Game::drawCloud(uint8_t alpha, Rectangle dest)
+{
+    // the cloud map is stretched over the world and 20 units around it
+    const Rectangle cloudRect = {-20, -20, m_worldBounds.x + 40, m_worldBounds.y + 40};
+    const float scaleX = m_cloudTexture.width / 2.0f / cloudRect.width;
+    const float scaleY = m_cloudTexture.height / cloudRect.height;
+
+    const Rectangle srcRect = {m_cloudDrawOffset + (dest.x - cloudRect.x) * scaleX, (dest.y - cloudRect.y) * scaleY,
+                               dest.width * scaleX, dest.height * scaleY};
+    DrawTexturePro(m_cloudTexture, srcRect, dest, {0, 0}, 0, {255, 255, 255, alpha});
+}
+
+void Game::drawCloudBorder(uint8_t alpha)
+{
+    // the world is opaque, so only the 20 units around it show the clouds below
+    drawCloud(alpha, {-20, -20, m_worldBounds.x + 40, 20});
+    drawCloud(alpha, {-20, m_worldBounds.y, m_worldBounds.x + 40, 20});
+    drawCloud(alpha, {-20, 0, 20, m_worldBounds.y});
+    drawCloud(alpha, {m_worldBounds.x, 0, 20, m_worldBounds.y});
 }
 
 void Game::drawWorld()
 {
-    const Rectangle srcRect = {0, 0, (float)m_worldTexture.width, (float)m_worldTexture.height};
-    const Rectangle destRect = {0, 0, m_worldBounds.x, m_worldBounds.y};
-    const Vector2 origin = {m_worldBounds.x, m_worldBounds.y};
-    DrawTexturePro(m_worldTexture, srcRect, destRect, origin, 180, WHITE);
+    // the static layer reaches past the screen, so do the chunks drawn into it
+    const Rectangle view = getWorldView();
+    const float margin = const_chunkTiles;
+    m_world->draw({view.x - margin, view.y - margin, view.width + 2 * margin, view.height + 2 * margin});
+}
+
+Rectangle Game::getWorldView() const
+{
+    const Vector2 topLeft = GetScreenToWorld2D({0, 0}, m_camera);
+    const Vector2 bottomRight = GetScreenToWorld2D({(float)GetScreenWidth(), (float)GetScreenHeight()}, m_camera);
+    return {topLeft.x, topLeft.y, bottomRight.x - topLeft.x, bottomRight.y - topLeft.y};
+}
+
+void Game::updateStaticLayer()
+{
+    m_world->update(getWorldView());
+
+    // chunks showing up or going away change the layer as well
+    const int key = m_world->getRevision() * 4 + m_battalionHandler->getStaticKey() + 1;
+    if (!m_staticLayer.isStale(m_camera, key))
+    {
+        return;
+    }
+
+    m_staticLayer.begin(m_camera, key);
+    drawWorld();
+    m_battalionHandler->drawStatic();
+    m_staticLayer.end();
+}
+
+void Game::drawSpeed()
+{
+    const float speed = const_speeds[m_speedIndex];
+    const char *text = (speed > 0) ? TextFormat("Speed: %gx", speed) : "Speed: max";
+    if (m_state == State::PAUSE_SIMULATION)
+    {
+        text = "Paused";
+    }
+    DrawText(text, 10, 10, 20, RAYWHITE);
 }
@@ -2,6 +2,8 @@
 #pragma once
 
 #include "src/battalionhandler.h"
+#include "src/layercache.h"
+#include "src/worldchunks.h"
 #include <raylib/raylib.h>
 #include <vector>
 #include <memory>
@@ -12,7 +14,7 @@ class Game
 public:
     enum class State
     {
-        // loading (only for a single frame)
+        // waiting for the initial game state
         LOADING = 0,
         // simulation
         RUN_SIMULATION = 1,
@@ -31,26 +33,54 @@ public:
 private:
     // initializes the game
     void setup();
+    // starts the battle once the initial game state arrived, called by the loader
+    static void onInitialGameStateLoaded(void *arg, bool ok);
+    // runs the simulation ticks due this frame
+    void advanceSimulation();
+    // switches to the game over screen once a side won
+    bool checkGameOver();
     // draws single frame
     void drawFrame();
     // handles inputs
     void processInputs();
     // draw the cloud map with some transparancy
     void drawCloud(uint8_t alpha);
+    // draw the part of the cloud map within dest, in world coordinates
+    void drawCloud(uint8_t alpha, Rectangle dest);
+    // draw the cloud map only where the world does not cover it
+    void drawCloudBorder(uint8_t alpha);
     // draw the actual world
     void drawWorld();
+    // redraws the world, walls and castle into m_staticLayer if they changed or the camera moved too far
+    void updateStaticLayer();
+    // returns the part of the world on screen
+    Rectangle getWorldView() const;
+    // draws the simulation speed in the top left corner
+    void drawSpeed();
 
 private:
     Camera2D m_camera;
     Vector2 m_worldBounds;
+    // picks the world, see WorldGen
+    uint64_t m_worldSeed;
     State m_state = State::LOADING;
+    // every attempt to load the initial game state failed
+    bool m_loadFailed = false;
+    // simulation ticks per simulated second, independent from the frame rate
     int m_targetFPS;
+    // index into const_speeds
+    int m_speedIndex = 0;
+    // simulated time that is due but not run yet, less than a tick after each frame
+    float m_accumulator = 0.0f;
 
     BattalionHandler *m_battalionHandler = nullptr;
 
     float m_cloudDrawOffset = 0.0;
+    std::unique_ptr<ChunkedWorld> m_world;
     // created by `WorldGen`
-    Texture m_worldTexture, m_cloudTexture;
+    Texture m_cloudTexture;
+    // world, walls and castle as drawn for the current camera
+    LayerCache m_staticLayer;
 
     Sound m_winSound, m_lossSound;
 };
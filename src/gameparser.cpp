@@ -1,67 +1,63 @@
-
 #include "src/gameparser.h"
-#include <algorithm>
 
-void tolower(std::string &string)
+bool parsePackedGameState(const int32_t *header, const float *coords, InitialGameState &state, std::string &error)
 {
-    auto func = [](const char &c)
+    const int battalionCount = header[0];
+    const int troopCount = header[1];
+    if (battalionCount < 0 || troopCount < 0)
     {
-        return std::tolower(c);
-    };
-    std::transform(string.begin(), string.end(), string.begin(), func);
-}
-
-InitialGameState parseInitialGameState(emscripten::val rawData)
-{
-    InitialGameState ret;
-
-    auto userBattalions = emscripten::vecFromJSArray<emscripten::val>(rawData["userInitData"]["battalions"]);
-    auto aiBattalions = emscripten::vecFromJSArray<emscripten::val>(rawData["aiInitData"]["battalions"]);
-    int id = 0;
+        error = "negative battalion or troop count";
+        return false;
+    }
 
-    for (const auto &b : userBattalions)
+    const int32_t *battalions = header + const_packedHeaderSize;
+    int userCount = 0;
+    int troopTotal = 0;
+    for (int i = 0; i < battalionCount; i++)
     {
-        BattalionSpawnInfo info;
-        info.id = ++id;
-
-        std::string btype = b["type"].as<std::string>();
-        tolower(btype);
-        info.btype = (btype == "warrior") ? 0 : 1;
-
-        // auto center = emscripten::vecFromJSArray<float>(b["avgCenter"]);
-        // info.position = {center[0], center[1]};
-
-        auto troops = emscripten::vecFromJSArray<emscripten::val>(b["troops"]);
-        for (const auto &t : troops)
+        const int32_t *b = battalions + i * const_packedBattalionSize;
+        if (b[2] == 0)
         {
-            auto tt = emscripten::vecFromJSArray<float>(t);
-            info.troops.push_back({tt[0], tt[1]});
+            error = "a battalion needs at least one troop";
+            return false;
         }
-
-        ret.attackerBattalions.push_back(info);
+        if (b[2] < 0 || b[2] > troopCount - troopTotal)
+        {
+            error = "battalion troop counts do not add up to the troop count";
+            return false;
+        }
+        userCount += (b[0] == 0);
+        troopTotal += b[2];
     }
-
-    for (const auto &b : aiBattalions)
+    if (troopTotal != troopCount)
     {
-        BattalionSpawnInfo info;
-        info.id = ++id;
+        error = "battalion troop counts do not add up to the troop count";
+        return false;
+    }
 
-        std::string btype = b["type"].as<std::string>();
-        tolower(btype);
-        info.btype = (btype == "warrior") ? 1 : 0;
+    state.attackerBattalions.clear();
+    state.defenderBattalions.clear();
+    state.attackerBattalions.reserve(userCount);
+    state.defenderBattalions.reserve(battalionCount - userCount);
 
-        // auto center = emscripten::vecFromJSArray<float>(b["avgCenter"]);
-        // info.position = {center[0], center[1]};
+    const Vector2 *troops = (const Vector2 *)coords;
+    int id = 0;
+    for (int i = 0; i < battalionCount; i++)
+    {
+        const int32_t *b = battalions + i * const_packedBattalionSize;
+        const bool isAi = b[0] != 0;
+        const bool isWarrior = b[1] != 0;
 
-        auto troops = emscripten::vecFromJSArray<emscripten::val>(b["troops"]);
-        for (const auto &t : troops)
-        {
-            auto tt = emscripten::vecFromJSArray<float>(t);
-            info.troops.push_back({tt[0], tt[1]});
-        }
+        BattalionSpawnInfo info;
+        info.id = ++id;
+        // the ai side has its type ids swapped, as it always had
+        info.btype = isWarrior ? (isAi ? 1 : 0) : (isAi ? 0 : 1);
+        info.troops.assign(troops, troops + b[2]);
+        troops += b[2];
 
-        ret.defenderBattalions.push_back(info);
+        auto &side = isAi ? state.defenderBattalions : state.attackerBattalions;
+        side.push_back(std::move(info));
     }
 
-    return ret;
+    return true;
 }
@@ -1,13 +1,22 @@
-
 #pragma once
 
 #include "src/battalionspawninfo.h"
-#include <emscripten/val.h>
+#include <cstdint>
+#include <string>
+
+// The `/api/init` JSON is packed into two typed arrays on the JS side (see
+// Module.packInitialGameState in prefix.js) and copied into the wasm heap in
+// one go, instead of walking it troop by troop through emscripten::val.
+//
+// header: battalion count, troop count, then for every battalion
+//         its side (0 user, 1 ai), 1 if it is made of warriors, its troop count
+// coords: x and y of every troop, battalion after battalion
 
-struct InitialGameState
-{
-    std::vector<BattalionSpawnInfo> attackerBattalions;
-    std::vector<BattalionSpawnInfo> defenderBattalions;
-};
+// int32 values in the header before the battalions
+inline constexpr int const_packedHeaderSize = 2;
+// int32 values per battalion in the header
+inline constexpr int const_packedBattalionSize = 3;
 
-InitialGameState parseInitialGameState(emscripten::val rawData);
+/// @brief builds the initial game state from the packed arrays
+/// @return false if the counts do not add up, `error` says why
+bool parsePackedGameState(const int32_t *header, const float *coords, InitialGameState &state, std::string &error);
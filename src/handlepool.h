@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/// @brief reference to an object of a HandlePool, 0 never refers to anything
+/// The low bits hold the slot, the high bits the generation of the slot when
+/// the object was added. A slot gets a new generation every time it is freed,
+/// so handles to removed objects stop resolving instead of dangling.
+using Handle = uint32_t;
+
+inline constexpr Handle const_nullHandle = 0;
+
+/// @brief objects stored back to back, addressed by generational handles
+/// Removing an object moves the last one into its place, so iterating the pool
+/// touches contiguous memory only, but in no particular order; keep the
+/// handles in a separate list where the order matters. Pointers to objects are
+/// only valid until the next insert or remove, handles stay valid until the
+/// object is removed.
+template <typename T>
+class HandlePool
+{
+
+public:
+    /// @brief adds value to the pool
+    /// @return the handle of the new object
+    Handle insert(T value)
+    {
+        uint32_t slot;
+        if (m_freeSlot != const_noSlot)
+        {
+            slot = m_freeSlot;
+            m_freeSlot = m_slots[slot].index;
+        }
+        else
+        {
+            slot = m_slots.size();
+            m_slots.push_back(Slot{const_noSlot, 1});
+        }
+
+        m_slots[slot].index = m_objects.size();
+        m_objects.push_back(std::move(value));
+        m_handles.push_back(makeHandle(slot, m_slots[slot].generation));
+        return m_handles.back();
+    }
+
+    /// @brief removes the object of handle, does nothing if it is no longer in the pool
+    void remove(Handle handle)
+    {
+        if (!isValid(handle))
+        {
+            return;
+        }
+
+        Slot &slot = m_slots[handle & const_slotMask];
+        const uint32_t index = slot.index;
+        const uint32_t last = m_objects.size() - 1;
+        if (index != last)
+        {
+            m_objects[index] = std::move(m_objects[last]);
+            m_handles[index] = m_handles[last];
+            m_slots[m_handles[index] & const_slotMask].index = index;
+        }
+        m_objects.pop_back();
+        m_handles.pop_back();
+
+        // generation 0 is skipped so that no handle is ever 0
+        slot.generation = (slot.generation + 1) & const_generationMask;
+        slot.generation += slot.generation == 0;
+        slot.index = m_freeSlot;
+        m_freeSlot = handle & const_slotMask;
+    }
+
+    /// @brief removes every object, handles given out before are not reused
+    void clear()
+    {
+        for (int i = size() - 1; i >= 0; i--)
+        {
+            remove(m_handles[i]);
+        }
+    }
+
+    /// @brief returns true if the object of handle is still in the pool
+    bool isValid(Handle handle) const
+    {
+        const uint32_t slot = handle & const_slotMask;
+        return slot < m_slots.size() && m_slots[slot].generation == (handle >> const_slotBits) &&
+               handle != const_nullHandle;
+    }
+
+    /// @brief returns the object of handle, nullptr if it is no longer in the pool
+    T *get(Handle handle) { return isValid(handle) ? &m_objects[m_slots[handle & const_slotMask].index] : nullptr; }
+    const T *get(Handle handle) const { return isValid(handle) ? &m_objects[m_slots[handle & const_slotMask].index] : nullptr; }
+
+    int size() const { return m_objects.size(); }
+    bool empty() const { return m_objects.empty(); }
+    /// @brief returns the handle of the object at index [0 to size)
+    Handle getHandle(int index) const { return m_handles[index]; }
+
+    T &operator[](int index) { return m_objects[index]; }
+    const T &operator[](int index) const { return m_objects[index]; }
+    typename std::vector<T>::iterator begin() { return m_objects.begin(); }
+    typename std::vector<T>::iterator end() { return m_objects.end(); }
+    typename std::vector<T>::const_iterator begin() const { return m_objects.begin(); }
+    typename std::vector<T>::const_iterator end() const { return m_objects.end(); }
+
+private:
+    static constexpr int const_slotBits = 20;
+    static constexpr uint32_t const_slotMask = (1u << const_slotBits) - 1;
+    static constexpr uint32_t const_generationMask = (1u << (32 - const_slotBits)) - 1;
+    static constexpr uint32_t const_noSlot = UINT32_MAX;
+
+    struct Slot
+    {
+        // index of the object in m_objects, the next free slot while free
+        uint32_t index;
+        uint32_t generation;
+    };
+
+    static Handle makeHandle(uint32_t slot, uint32_t generation) { return (generation << const_slotBits) | slot; }
+
+private:
+    std::vector<T> m_objects;
+    // handle of every object, in the order of m_objects
+    std::vector<Handle> m_handles;
+    std::vector<Slot> m_slots;
+    uint32_t m_freeSlot = const_noSlot;
+};
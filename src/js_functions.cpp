@@ -2,21 +2,48 @@
 #include "src/js_functions.h"
 #include <emscripten.h>
 
-EM_JS(void, call_getInitialGameState_impl, (), {
-    Module.call_getInitialGameState();
+// called from JS when the load finished, hands the result to the C++ callback
+extern "C" EMSCRIPTEN_KEEPALIVE void initialGameStateLoaded(void (*onLoaded)(void *, bool), void *arg, int ok)
+{
+    onLoaded(arg, ok != 0);
+}
+
+EM_JS(void, loadInitialGameState_impl, (void *onLoaded, void *arg), {
+    Module.loadInitialGameState((ok) => Module._initialGameStateLoaded(onLoaded, arg, ok ? 1 : 0));
 });
 
-void call_getInitialGameState()
+void loadInitialGameState(void (*onLoaded)(void *arg, bool ok), void *arg)
 {
-    call_getInitialGameState_impl();
+    loadInitialGameState_impl((void *)onLoaded, arg);
 }
 
-EM_JS(EM_VAL, getInitialGameState_impl, (), {
-    const ret = Module.initialGameState;
-    return Emval.toHandle(ret);
+EM_JS(void, getInitialGameStateProgress_impl, (int *attempt, int *received, int *total), {
+    const load = Module.initLoad;
+    HEAP32[attempt >> 2] = load.attempt;
+    HEAP32[received >> 2] = load.received;
+    HEAP32[total >> 2] = load.total;
+});
+
+void getInitialGameStateProgress(int &attempt, int &received, int &total)
+{
+    getInitialGameStateProgress_impl(&attempt, &received, &total);
+}
+
+EM_JS(int32_t *, takePackedInitialGameState_impl, (), {
+    const packed = Module.initialGameState;
+    if (!packed) {
+        return 0;
+    }
+    Module.initialGameState = null;
+
+    // one copy of each array straight into the heap, the coords right after the header
+    const ptr = _malloc(packed.header.byteLength + packed.coords.byteLength);
+    HEAP32.set(packed.header, ptr >> 2);
+    HEAPF32.set(packed.coords, (ptr + packed.header.byteLength) >> 2);
+    return ptr;
 });
 
-EM_VAL getInitialGameState()
+int32_t *takePackedInitialGameState()
 {
-    return getInitialGameState_impl();
+    return takePackedInitialGameState_impl();
 }
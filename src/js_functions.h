@@ -1,14 +1,17 @@
-
 #pragma once
 
-#include <emscripten/val.h>
+#include <cstdint>
 
-using emscripten::EM_VAL;
-using emscripten::val;
+// starts loading the initial game state (see Module.loadInitialGameState in prefix.js),
+// does nothing while a load is running or after one succeeded
+// onLoaded(arg, ok) is called once the state can be taken with
+// takePackedInitialGameState (ok) or once every attempt failed (!ok)
+void loadInitialGameState(void (*onLoaded)(void *arg, bool ok), void *arg);
 
-// calls the init route
-void call_getInitialGameState();
+// progress of the load: the attempt (from 1) and the bytes received of total (-1 if unknown)
+void getInitialGameStateProgress(int &attempt, int &received, int &total);
 
-// gets the initial game state
-// check the dataSet attribute to see if valid
-EM_VAL getInitialGameState();
+// moves the packed initial game state (see src/gameparser.h) into the wasm heap
+// returns the header, followed by the coords, or null if it has not arrived yet
+// the caller frees the block with free()
+int32_t *takePackedInitialGameState();
@@ -0,0 +1,69 @@
+#include "src/layercache.h"
+#include <cmath>
+
+// pixels the camera may move in each direction before the layer is drawn again
+const int const_cacheMargin = 128;
+
+bool LayerCache::isStale(const Camera2D &camera, int key) const
+{
+    if (!m_valid || key != m_key || camera.zoom != m_camera.zoom || camera.rotation != m_camera.rotation)
+    {
+        return true;
+    }
+    if (m_target.texture.width != GetScreenWidth() + 2 * const_cacheMargin ||
+        m_target.texture.height != GetScreenHeight() + 2 * const_cacheMargin)
+    {
+        return true;
+    }
+
+    // the screen has to stay inside the cached area
+    const float dx = fabsf(camera.target.x - m_camera.target.x) * camera.zoom;
+    const float dy = fabsf(camera.target.y - m_camera.target.y) * camera.zoom;
+    return dx > const_cacheMargin || dy > const_cacheMargin;
+}
+
+void LayerCache::begin(const Camera2D &camera, int key)
+{
+    const int width = GetScreenWidth() + 2 * const_cacheMargin;
+    const int height = GetScreenHeight() + 2 * const_cacheMargin;
+    if (m_target.texture.width != width || m_target.texture.height != height)
+    {
+        unload();
+        m_target = LoadRenderTexture(width, height);
+    }
+
+    m_camera = camera;
+    m_camera.offset = {width / 2.0f, height / 2.0f};
+    m_key = key;
+    m_valid = true;
+
+    BeginTextureMode(m_target);
+    ClearBackground(BLANK);
+    BeginMode2D(m_camera);
+}
+
+void LayerCache::end()
+{
+    EndMode2D();
+    EndTextureMode();
+}
+
+void LayerCache::draw() const
+{
+    const float width = m_target.texture.width / m_camera.zoom;
+    const float height = m_target.texture.height / m_camera.zoom;
+    // render textures are stored upside down
+    const Rectangle source = {0, 0, (float)m_target.texture.width, -(float)m_target.texture.height};
+    const Rectangle dest = {m_camera.target.x - width / 2, m_camera.target.y - height / 2, width, height};
+    DrawTexturePro(m_target.texture, source, dest, Vector2{0, 0}, 0, WHITE);
+}
+
+void LayerCache::unload()
+{
+    if (m_target.id != 0)
+    {
+        UnloadRenderTexture(m_target);
+    }
+    m_target = {};
+    m_valid = false;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <raylib/raylib.h>
+
+/// @brief keeps what was drawn of a mostly static layer in a render texture
+/// The texture covers the screen plus a margin on every side, so the camera can
+/// move by up to the margin before the layer has to be drawn again. Drawing the
+/// cached texture is a single textured quad however much went into the layer.
+class LayerCache
+{
+
+public:
+    /// @brief returns true if the cache does not hold the layer for camera and key
+    /// key identifies the content of the layer, e.g. the damage of the walls
+    bool isStale(const Camera2D &camera, int key) const;
+    /// @brief starts drawing the layer into the cache, in world coordinates
+    /// must not be called between BeginMode2D and EndMode2D
+    void begin(const Camera2D &camera, int key);
+    /// @brief finishes drawing the layer into the cache
+    void end();
+    /// @brief draws the cached layer, between BeginMode2D and EndMode2D
+    void draw() const;
+    void unload();
+
+private:
+    RenderTexture2D m_target = {};
+    Camera2D m_camera = {};
+    int m_key = 0;
+    bool m_valid = false;
+};
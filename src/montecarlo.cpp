@@ -0,0 +1,173 @@
+
+#include "src/montecarlo.h"
+#include "src/battalionhandler.h"
+#include "src/replay.h"
+#include "src/threadpool.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <string>
+
+namespace
+{
+
+// steps handler until the battle is over or settings.maxTicks more ticks passed
+BattleOutcome playOut(BattalionHandler &handler, const BattleSettings &settings, ReplayRecorder *recorder)
+{
+    BattleOutcome outcome;
+    outcome.seed = handler.getSeed();
+
+    if (recorder)
+    {
+        recorder->begin(handler, settings.targetFPS);
+    }
+
+    Group winner;
+    outcome.finished = handler.isGameFinished(winner);
+    while (!outcome.finished && outcome.ticks < settings.maxTicks)
+    {
+        handler.step(1.0f / settings.targetFPS);
+        outcome.ticks++;
+        if (recorder)
+        {
+            recorder->record(handler);
+        }
+        outcome.finished = handler.isGameFinished(winner);
+    }
+
+    outcome.attackerWon = outcome.finished && winner == Group::Attacker;
+    outcome.attackerTroops = handler.getTroopCount(Group::Attacker);
+    outcome.defenderTroops = handler.getTroopCount(Group::Defender);
+    outcome.castleHealth = handler.getCastleHealth();
+    outcome.wallHealth = handler.getWallHealth();
+    return outcome;
+}
+
+MonteCarloResult estimate(const MonteCarloOptions &options, const std::function<BattleOutcome(uint64_t)> &runSeed)
+{
+    MonteCarloResult result;
+    ThreadPool pool(options.threadCount);
+
+    std::vector<BattleOutcome> outcomes;
+    double totalTicks = 0.0;
+    const float z2 = options.z * options.z;
+
+    while (result.battles < options.maxBattles)
+    {
+        const int round = std::min(std::max(options.roundSize, 1), options.maxBattles - result.battles);
+        const uint64_t firstSeed = options.firstSeed + result.battles;
+
+        outcomes.assign(round, BattleOutcome());
+        pool.parallelFor(round, [&](int i)
+                         { outcomes[i] = runSeed(firstSeed + i); });
+
+        for (const BattleOutcome &outcome : outcomes)
+        {
+            result.battles++;
+            if (!outcome.finished)
+            {
+                result.timeouts++;
+            }
+            else if (outcome.attackerWon)
+            {
+                result.attackerWins++;
+            }
+            else
+            {
+                result.defenderWins++;
+            }
+
+            totalTicks += outcome.ticks;
+            result.attackerSurvivors.push_back(outcome.attackerTroops);
+            result.defenderSurvivors.push_back(outcome.defenderTroops);
+        }
+
+        // Wilson score interval, unlike the normal approximation it stays
+        // inside [0, 1] and is still sensible when every battle went one way
+        const float n = result.battles;
+        const float p = result.attackerWins / n;
+        const float center = (p + z2 / (2 * n)) / (1 + z2 / n);
+        const float halfWidth = options.z * sqrtf(p * (1 - p) / n + z2 / (4 * n * n)) / (1 + z2 / n);
+
+        result.winProbability = p;
+        result.intervalLow = std::max(center - halfWidth, 0.0f);
+        result.intervalHigh = std::min(center + halfWidth, 1.0f);
+
+        if (result.battles >= options.minBattles && 2 * halfWidth <= options.maxIntervalWidth)
+        {
+            result.converged = true;
+            break;
+        }
+    }
+
+    if (result.battles > 0)
+    {
+        result.meanSeconds = totalTicks / result.battles / options.battle.targetFPS;
+    }
+    return result;
+}
+
+} // namespace
+
+BattleOutcome runBattle(const InitialGameState &gameState, const BattleSettings &settings, uint64_t seed,
+                        ReplayRecorder *recorder)
+{
+    BattalionHandler handler(settings.worldBounds);
+    handler.setThreadCount(settings.threadCount);
+    handler.setSeed(seed);
+    handler.spawn(Group::Attacker, gameState.attackerBattalions);
+    handler.spawn(Group::Defender, gameState.defenderBattalions);
+    return playOut(handler, settings, recorder);
+}
+
+bool runBattle(const SimulationSnapshot &snapshot, const BattleSettings &settings, uint64_t seed,
+               BattleOutcome &outcome, std::string &error)
+{
+    BattalionHandler handler(settings.worldBounds);
+    if (!handler.restoreSnapshot(snapshot, error))
+    {
+        return false;
+    }
+    handler.setThreadCount(settings.threadCount);
+    handler.setSeed(seed);
+    outcome = playOut(handler, settings, nullptr);
+    return true;
+}
+
+MonteCarloResult estimateOutcome(const InitialGameState &gameState, const MonteCarloOptions &options)
+{
+    return estimate(options, [&](uint64_t seed)
+                    { return runBattle(gameState, options.battle, seed); });
+}
+
+bool estimateOutcome(const SimulationSnapshot &snapshot, const MonteCarloOptions &options,
+                     MonteCarloResult &result, std::string &error)
+{
+    // a snapshot that does not restore fails the same way for every seed,
+    // find out before playing any battle
+    BattalionHandler handler(options.battle.worldBounds);
+    if (!handler.restoreSnapshot(snapshot, error))
+    {
+        return false;
+    }
+
+    std::atomic<bool> failed = false;
+    MonteCarloResult estimated = estimate(options, [&](uint64_t seed)
+                                          {
+        BattleOutcome outcome;
+        std::string battleError;
+        if (!runBattle(snapshot, options.battle, seed, outcome, battleError))
+        {
+            failed = true;
+        }
+        return outcome; });
+
+    if (failed)
+    {
+        error = "snapshot could not be restored for every battle";
+        return false;
+    }
+    result = std::move(estimated);
+    return true;
+}
@@ -0,0 +1,89 @@
+
+#pragma once
+
+#include "src/battalionspawninfo.h"
+#include "src/snapshot.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// @brief how a single battle is played
+struct BattleSettings
+{
+    Vector2 worldBounds = {100, 60};
+    int targetFPS = 60;
+    long maxTicks = 60L * 60 * 30;
+    // threads used inside the battle, see BattalionHandler::setThreadCount
+    int threadCount = 1;
+};
+
+/// @brief the end of a single battle
+struct BattleOutcome
+{
+    uint64_t seed = 0;
+    // false if the battle hit BattleSettings::maxTicks
+    bool finished = false;
+    bool attackerWon = false;
+    long ticks = 0;
+    int attackerTroops = 0;
+    int defenderTroops = 0;
+    float castleHealth = 0.0f;
+    float wallHealth = 0.0f;
+};
+
+class ReplayRecorder;
+
+/// @brief plays one battle to the end, recording it if recorder is not null
+BattleOutcome runBattle(const InitialGameState &gameState, const BattleSettings &settings, uint64_t seed,
+                        ReplayRecorder *recorder = nullptr);
+/// @brief continues the battle of the snapshot to the end with a new seed, for what-if questions
+/// the ticks of the outcome count from the snapshot on
+/// @return false if the snapshot is not valid, `error` says why and outcome is left as it is
+bool runBattle(const SimulationSnapshot &snapshot, const BattleSettings &settings, uint64_t seed,
+               BattleOutcome &outcome, std::string &error);
+
+struct MonteCarloOptions
+{
+    BattleSettings battle;
+    // battles use the seeds firstSeed, firstSeed + 1, ...
+    uint64_t firstSeed = 0;
+    int minBattles = 32;
+    int maxBattles = 1024;
+    // battles are played in rounds of this size and the stop condition is
+    // only checked between rounds, so the result never depends on threads
+    int roundSize = 32;
+    // stop once the confidence interval of the win probability is this narrow
+    float maxIntervalWidth = 0.05f;
+    // z value of the confidence interval (1.96 for 95%)
+    float z = 1.96f;
+    // threads playing battles side by side, 0 for one per hardware thread
+    int threadCount = 0;
+};
+
+struct MonteCarloResult
+{
+    int battles = 0;
+    int attackerWins = 0;
+    int defenderWins = 0;
+    int timeouts = 0;
+
+    // probability of an attacker win, timeouts count as losses
+    float winProbability = 0.0f;
+    // Wilson score interval of winProbability
+    float intervalLow = 0.0f;
+    float intervalHigh = 1.0f;
+    // true if the interval got narrow enough before maxBattles
+    bool converged = false;
+
+    float meanSeconds = 0.0f;
+    // surviving troops at the end of every battle, in seed order
+    std::vector<int> attackerSurvivors;
+    std::vector<int> defenderSurvivors;
+};
+
+/// @brief plays independently seeded battles of gameState until the win probability is known well enough
+MonteCarloResult estimateOutcome(const InitialGameState &gameState, const MonteCarloOptions &options);
+/// @brief same, continuing the battle of the snapshot with every seed
+/// @return false if the snapshot is not valid, `error` says why and result is left as it is
+bool estimateOutcome(const SimulationSnapshot &snapshot, const MonteCarloOptions &options,
+                     MonteCarloResult &result, std::string &error);
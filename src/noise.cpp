@@ -0,0 +1,245 @@
+#include "src/noise.h"
+#include <cmath>
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+// The row functions run 4 points at once with the same operations, in the
+// same order, as the scalar ones, so both give bit for bit the same values
+// on every platform (there is no fused multiply-add in either path).
+
+namespace
+{
+const float const_diagonal = 0.70710678f;
+// 2D gradient noise peaks at sqrt(0.5), this scales it up to about [-1, 1]
+const float const_noiseScale = 1.41421356f;
+const uint32_t const_octaveKeyStep = 0x9E3779B9u;
+const uint32_t const_hashMul = 1664525u;
+const uint32_t const_hashAdd = 1013904223u;
+
+// integer hash of a lattice point, see "Hash Functions for GPU Rendering" (pcg2d)
+inline uint32_t hashPoint(int32_t x, int32_t y, uint32_t key)
+{
+    uint32_t vx = (uint32_t)x * const_hashMul + const_hashAdd + key;
+    uint32_t vy = (uint32_t)y * const_hashMul + const_hashAdd;
+    vx += vy * const_hashMul;
+    vy += vx * const_hashMul;
+    vx ^= vx >> 16;
+    vy ^= vy >> 16;
+    vx += vy * const_hashMul;
+    vy += vx * const_hashMul;
+    vy ^= vy >> 16;
+    return vy;
+}
+
+// dot product of one of 8 unit gradients with (dx, dy): bit 2 picks the
+// diagonals, bits 0 and 1 the signs (diagonals) or the sign and axis
+inline float gradientDot(uint32_t hash, float dx, float dy)
+{
+    const bool b0 = hash & 1;
+    const bool b1 = hash & 2;
+    float gx, gy;
+    if (hash & 4)
+    {
+        gx = b1 ? -const_diagonal : const_diagonal;
+        gy = b0 ? -const_diagonal : const_diagonal;
+    }
+    else
+    {
+        const float sign = b0 ? -1.0f : 1.0f;
+        gx = b1 ? 0.0f : sign;
+        gy = b1 ? sign : 0.0f;
+    }
+    return gx * dx + gy * dy;
+}
+
+inline float fade(float t)
+{
+    return t * t * t * (t * (t * 6 - 15) + 10);
+}
+
+#if defined(__wasm_simd128__) || defined(__SSE4_1__)
+#if defined(__wasm_simd128__)
+using F4 = v128_t;
+using I4 = v128_t;
+inline F4 splat(float v) { return wasm_f32x4_splat(v); }
+inline I4 splatI(uint32_t v) { return wasm_i32x4_splat((int32_t)v); }
+inline F4 load(const float *p) { return wasm_v128_load(p); }
+inline void store(float *p, F4 v) { wasm_v128_store(p, v); }
+inline F4 add(F4 a, F4 b) { return wasm_f32x4_add(a, b); }
+inline F4 sub(F4 a, F4 b) { return wasm_f32x4_sub(a, b); }
+inline F4 mul(F4 a, F4 b) { return wasm_f32x4_mul(a, b); }
+inline F4 floor4(F4 a) { return wasm_f32x4_floor(a); }
+inline I4 toInt(F4 a) { return wasm_i32x4_trunc_sat_f32x4(a); }
+inline I4 addI(I4 a, I4 b) { return wasm_i32x4_add(a, b); }
+inline I4 mulI(I4 a, I4 b) { return wasm_i32x4_mul(a, b); }
+inline I4 xorI(I4 a, I4 b) { return wasm_v128_xor(a, b); }
+inline I4 shr16(I4 a) { return wasm_u32x4_shr(a, 16); }
+// lanes where (a & bit) is set
+inline I4 hasBit(I4 a, uint32_t bit) { return wasm_i32x4_ne(wasm_v128_and(a, splatI(bit)), splatI(0)); }
+inline F4 select(I4 mask, F4 a, F4 b) { return wasm_v128_bitselect(a, b, mask); }
+#else
+using F4 = __m128;
+using I4 = __m128i;
+inline F4 splat(float v) { return _mm_set1_ps(v); }
+inline I4 splatI(uint32_t v) { return _mm_set1_epi32((int32_t)v); }
+inline F4 load(const float *p) { return _mm_loadu_ps(p); }
+inline void store(float *p, F4 v) { _mm_storeu_ps(p, v); }
+inline F4 add(F4 a, F4 b) { return _mm_add_ps(a, b); }
+inline F4 sub(F4 a, F4 b) { return _mm_sub_ps(a, b); }
+inline F4 mul(F4 a, F4 b) { return _mm_mul_ps(a, b); }
+inline F4 floor4(F4 a) { return _mm_floor_ps(a); }
+inline I4 toInt(F4 a) { return _mm_cvttps_epi32(a); }
+inline I4 addI(I4 a, I4 b) { return _mm_add_epi32(a, b); }
+inline I4 mulI(I4 a, I4 b) { return _mm_mullo_epi32(a, b); }
+inline I4 xorI(I4 a, I4 b) { return _mm_xor_si128(a, b); }
+inline I4 shr16(I4 a) { return _mm_srli_epi32(a, 16); }
+inline I4 hasBit(I4 a, uint32_t bit)
+{
+    const I4 masked = _mm_and_si128(a, splatI(bit));
+    return _mm_xor_si128(_mm_cmpeq_epi32(masked, _mm_setzero_si128()), _mm_set1_epi32(-1));
+}
+inline F4 select(I4 mask, F4 a, F4 b) { return _mm_blendv_ps(b, a, _mm_castsi128_ps(mask)); }
+#endif
+
+inline I4 hashPoint4(I4 x, I4 y, I4 key)
+{
+    const I4 m = splatI(const_hashMul);
+    const I4 c = splatI(const_hashAdd);
+    I4 vx = addI(addI(mulI(x, m), c), key);
+    I4 vy = addI(mulI(y, m), c);
+    vx = addI(vx, mulI(vy, m));
+    vy = addI(vy, mulI(vx, m));
+    vx = xorI(vx, shr16(vx));
+    vy = xorI(vy, shr16(vy));
+    vx = addI(vx, mulI(vy, m));
+    vy = addI(vy, mulI(vx, m));
+    vy = xorI(vy, shr16(vy));
+    return vy;
+}
+
+inline F4 gradientDot4(I4 hash, F4 dx, F4 dy)
+{
+    const I4 b0 = hasBit(hash, 1);
+    const I4 b1 = hasBit(hash, 2);
+    const I4 b2 = hasBit(hash, 4);
+    const F4 zero = splat(0.0f);
+    const F4 sign = select(b0, splat(-1.0f), splat(1.0f));
+    const F4 diagX = select(b1, splat(-const_diagonal), splat(const_diagonal));
+    const F4 diagY = select(b0, splat(-const_diagonal), splat(const_diagonal));
+    const F4 gx = select(b2, diagX, select(b1, zero, sign));
+    const F4 gy = select(b2, diagY, select(b1, sign, zero));
+    return add(mul(gx, dx), mul(gy, dy));
+}
+
+inline F4 fade4(F4 t)
+{
+    const F4 inner = add(mul(t, sub(mul(t, splat(6.0f)), splat(15.0f))), splat(10.0f));
+    return mul(mul(mul(t, t), t), inner);
+}
+
+F4 gradientNoise4(F4 x, F4 y, I4 key)
+{
+    const F4 fx = floor4(x);
+    const F4 fy = floor4(y);
+    const I4 ix = toInt(fx);
+    const I4 iy = toInt(fy);
+    const I4 one = splatI(1);
+    const I4 ix1 = addI(ix, one);
+    const I4 iy1 = addI(iy, one);
+    const F4 dx = sub(x, fx);
+    const F4 dy = sub(y, fy);
+    const F4 dx1 = sub(dx, splat(1.0f));
+    const F4 dy1 = sub(dy, splat(1.0f));
+
+    const F4 n00 = gradientDot4(hashPoint4(ix, iy, key), dx, dy);
+    const F4 n10 = gradientDot4(hashPoint4(ix1, iy, key), dx1, dy);
+    const F4 n01 = gradientDot4(hashPoint4(ix, iy1, key), dx, dy1);
+    const F4 n11 = gradientDot4(hashPoint4(ix1, iy1, key), dx1, dy1);
+
+    const F4 u = fade4(dx);
+    const F4 v = fade4(dy);
+    const F4 nx0 = add(n00, mul(sub(n10, n00), u));
+    const F4 nx1 = add(n01, mul(sub(n11, n01), u));
+    return mul(add(nx0, mul(sub(nx1, nx0), v)), splat(const_noiseScale));
+}
+#define NOISE_SIMD
+#endif
+} // namespace
+
+float gradientNoise(float x, float y, uint32_t key)
+{
+    const float fx = floorf(x);
+    const float fy = floorf(y);
+    const int32_t ix = (int32_t)fx;
+    const int32_t iy = (int32_t)fy;
+    const float dx = x - fx;
+    const float dy = y - fy;
+
+    const float n00 = gradientDot(hashPoint(ix, iy, key), dx, dy);
+    const float n10 = gradientDot(hashPoint(ix + 1, iy, key), dx - 1, dy);
+    const float n01 = gradientDot(hashPoint(ix, iy + 1, key), dx, dy - 1);
+    const float n11 = gradientDot(hashPoint(ix + 1, iy + 1, key), dx - 1, dy - 1);
+
+    const float u = fade(dx);
+    const float v = fade(dy);
+    const float nx0 = n00 + (n10 - n00) * u;
+    const float nx1 = n01 + (n11 - n01) * u;
+    return (nx0 + (nx1 - nx0) * v) * const_noiseScale;
+}
+
+float fbmNoise(float x, float y, uint32_t key, int octaves)
+{
+    float sum = 0.0f;
+    float amplitude = 1.0f;
+    for (int octave = 0; octave < octaves; octave++)
+    {
+        // every octave gets its own lattice so they do not line up at the origin
+        sum += gradientNoise(x, y, key + octave * const_octaveKeyStep) * amplitude;
+        x *= 2.0f;
+        y *= 2.0f;
+        amplitude *= 0.5f;
+    }
+    return sum;
+}
+
+void fbmNoiseRow(int x, int y, int count, float frequency, uint32_t key, int octaves, float *out)
+{
+    int i = 0;
+#ifdef NOISE_SIMD
+    const float fy = y * frequency;
+    for (; i + 4 <= count; i += 4)
+    {
+        const float xs[4] = {(x + i) * frequency, (x + i + 1) * frequency, (x + i + 2) * frequency, (x + i + 3) * frequency};
+        F4 px = load(xs);
+        F4 py = splat(fy);
+        F4 sum = splat(0.0f);
+        float amplitude = 1.0f;
+        for (int octave = 0; octave < octaves; octave++)
+        {
+            const I4 octaveKey = splatI(key + octave * const_octaveKeyStep);
+            sum = add(sum, mul(gradientNoise4(px, py, octaveKey), splat(amplitude)));
+            px = mul(px, splat(2.0f));
+            py = mul(py, splat(2.0f));
+            amplitude *= 0.5f;
+        }
+        store(out + i, sum);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        out[i] = fbmNoise((x + i) * frequency, y * frequency, key, octaves);
+    }
+}
+
+bool fbmNoiseRowIsSimd()
+{
+#ifdef NOISE_SIMD
+    return true;
+#else
+    return false;
+#endif
+}
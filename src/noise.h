@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+// Seeded 2D gradient noise. Unlike raylib's GenImagePerlinNoise, which is
+// scaled by the size of the image, the value of a point only depends on
+// its coordinates and the key, so pieces of a world can be generated apart
+// from each other and still line up.
+
+/// @brief returns gradient noise at (x, y), roughly in [-1, 1]
+float gradientNoise(float x, float y, uint32_t key);
+/// @brief returns fractal (fbm) noise at (x, y): octaves of gradient noise, each
+/// at twice the frequency and half the amplitude of the previous one
+float fbmNoise(float x, float y, uint32_t key, int octaves);
+/// @brief writes fbmNoise((x + i) * frequency, y * frequency) to out[i] for i in [0, count)
+/// runs 4 points at once where SIMD is available (wasm simd128, SSE4.1), the
+/// values are the same as those of fbmNoise either way
+void fbmNoiseRow(int x, int y, int count, float frequency, uint32_t key, int octaves, float *out);
+/// @brief true if fbmNoiseRow runs 4 points at once in this build
+bool fbmNoiseRowIsSimd();
@@ -0,0 +1,369 @@
+
+#include "src/battalionhandler.h"
+#include "src/raygui.h"
+#include <raylib/raymath.h>
+#include <algorithm>
+#include <cmath>
+
+// Drawing for the simulation types. Kept out of the sim sources so that those
+// build without raylib (see the `headless` target in the Makefile).
+
+const Color const_colors[2][2] = {
+    {Color{140, 0, 0, 255}, Color{220, 20, 60, 255}},
+    {Color{0, 0, 140, 255}, Color{60, 20, 220, 255}},
+};
+
+// size of a troop sprite in the spritesheet and in the world
+const int const_troopFrameSize = 16;
+const float const_troopSpriteSize = 1.0f;
+
+// level of detail by the on screen size of a troop in pixels, each switch
+// back to more detail needs a larger size than the switch away from it so
+// that a battalion does not flicker between levels around the threshold
+const float const_glyphBelowPixels = 12.0f;
+const float const_spritesAbovePixels = 14.0f;
+const float const_densityBelowPixels = 11.0f;
+const float const_glyphAbovePixels = 12.5f;
+// battalions smaller than this are hardly visible in the density map, so they stay glyphs
+const int const_densityMinTroops = 64;
+const int const_glyphMaxTroops = 48;
+// world units per texel of the density map
+const float const_densityCellSize = 1.0f;
+
+namespace
+{
+LodLevel nextLod(LodLevel current, float troopPixels, int troopCount)
+{
+    switch (current)
+    {
+    case LodLevel::Sprites:
+        if (troopPixels >= const_glyphBelowPixels)
+        {
+            return LodLevel::Sprites;
+        }
+        return nextLod(LodLevel::Glyph, troopPixels, troopCount);
+    case LodLevel::Glyph:
+        if (troopPixels > const_spritesAbovePixels)
+        {
+            return LodLevel::Sprites;
+        }
+        if (troopPixels < const_densityBelowPixels && troopCount >= const_densityMinTroops)
+        {
+            return LodLevel::Density;
+        }
+        return LodLevel::Glyph;
+    case LodLevel::Density:
+        if (troopPixels > const_glyphAbovePixels || troopCount < const_glyphMaxTroops)
+        {
+            return nextLod(LodLevel::Glyph, troopPixels, troopCount);
+        }
+        return LodLevel::Density;
+    }
+    return current;
+}
+} // namespace
+
+void TroopFrames::build(Texture2D spritesheet)
+{
+    for (int group = 0; group < 2; group++)
+    {
+        for (int btype = 0; btype < 2; btype++)
+        {
+            for (int attacking = 0; attacking < 2; attacking++)
+            {
+                const int startX = ((BType)btype == BType::Archer) ? 0 : 96;
+                const int startY = (((Group)group == Group::Attacker) ? 48 : 208) + (attacking ? 48 : 0);
+                for (int frame = 0; frame < const_troopFrameCount; frame++)
+                {
+                    const Rectangle source = {(float)(startX + frame * const_troopFrameSize), (float)startY,
+                                              (float)const_troopFrameSize, (float)const_troopFrameSize};
+                    uv[group][btype][attacking][frame][0] = GetSpriteUV(spritesheet, source, false);
+                    uv[group][btype][attacking][frame][1] = GetSpriteUV(spritesheet, source, true);
+                }
+            }
+        }
+    }
+}
+
+void Battalion::addSprites(SpriteBatch &batch, const TroopFrames &frames, Rectangle view, float alpha) const
+{
+    // a sprite is visible if its center is within half a sprite of the view
+    const float margin = const_troopSpriteSize / 2;
+    const float minX = view.x - margin;
+    const float minY = view.y - margin;
+    const float maxX = view.x + view.width + margin;
+    const float maxY = view.y + view.height + margin;
+    const Vector2 size = {const_troopSpriteSize, const_troopSpriteSize};
+
+    // every drawn position lies between the previous and the current bounds
+    const Rectangle bounds = m_troops.getBounds(false);
+    const Rectangle prevBounds = m_troops.getBounds(true);
+    if (std::min(prevBounds.x, bounds.x) > maxX ||
+        std::max(prevBounds.x + prevBounds.width, bounds.x + bounds.width) < minX ||
+        std::min(prevBounds.y, bounds.y) > maxY ||
+        std::max(prevBounds.y + prevBounds.height, bounds.y + bounds.height) < minY)
+    {
+        return;
+    }
+
+    for (int i = 0; i < m_troops.size(); i++)
+    {
+        const Vector2 position = m_troops.position(i);
+        const Vector2 prevPosition = m_troops.prevPosition(i);
+        const float x = prevPosition.x + (position.x - prevPosition.x) * alpha;
+        const float y = prevPosition.y + (position.y - prevPosition.y) * alpha;
+        if (x < minX || x > maxX || y < minY || y > maxY)
+        {
+            continue;
+        }
+
+        const int frame = std::min(m_troops.getFrame(i), const_troopFrameCount - 1);
+        batch.add(Vector2{x, y}, size, frames.get(m_group, m_btype, m_troops.getState(i), frame, m_troops.getFlip(i)));
+    }
+}
+
+void Battalion::drawRanges(bool selected, float alpha) const
+{
+    const Color color = const_colors[(int)m_group][(int)m_btype];
+    const Color debugColor = {color.r, color.g, color.b, (unsigned char)(selected ? 20 : 2)};
+    const Vector2 center = Vector2Lerp(m_prevCenter, m_center, alpha);
+
+    const Rectangle rect = {center.x, center.y, (float)getTroopCount(), 1.0};
+    const Vector2 origin = {(float)getTroopCount() / 2, 0.5};
+    DrawRectanglePro(rect, origin, m_rotation, debugColor);
+
+    DrawCircleV(center, const_attackRange[(int)m_btype], debugColor);
+    DrawCircleV(center, const_lookoutRange[(int)m_btype], debugColor);
+}
+
+void Battalion::drawGlyph(float alpha) const
+{
+    const Color color = const_colors[(int)m_group][(int)m_btype];
+    const Vector2 center = Vector2Lerp(m_prevCenter, m_center, alpha);
+
+    // a square of one unit per troop, turned like the formation
+    const float side = sqrtf((float)getTroopCount());
+    const Rectangle rect = {center.x, center.y, side, side};
+    DrawRectanglePro(rect, Vector2{side / 2, side / 2}, m_rotation, Fade(color, 0.8f));
+}
+
+void Battalion::updateDensity(DensityMap &map, Handle handle) const
+{
+    map.update(handle, (int)m_group, m_troops.size(), [this](int i) { return m_troops.position(i); });
+}
+
+void BattalionHandler::loadTextures()
+{
+    m_troopSpriteSheet = LoadTexture("assets/spritesheets/troops.png");
+    m_troopFrames.build(m_troopSpriteSheet);
+    m_densityMap.load(m_worldBounds, const_densityCellSize);
+    m_densityTick = -1;
+    m_wallSpriteSheet = LoadTexture("assets/spritesheets/world.png");
+    m_uiSpriteSheet = LoadTexture("assets/spritesheets/ui.png");
+    m_wallCornerSpriteSheet = LoadTexture("assets/spritesheets/filler.png");
+}
+
+void BattalionHandler::unloadTextures()
+{
+    UnloadTexture(m_troopSpriteSheet);
+    UnloadTexture(m_wallSpriteSheet);
+    UnloadTexture(m_uiSpriteSheet);
+    UnloadTexture(m_wallCornerSpriteSheet);
+    m_densityMap.unload();
+}
+
+void BattalionHandler::drawAll(float alpha, const Camera2D &camera) const
+{
+    // without the previous positions only the current ones can be drawn
+    if (!m_interpolated)
+    {
+        alpha = 1.0f;
+    }
+
+    // the part of the world on screen
+    const Vector2 topLeft = GetScreenToWorld2D(Vector2{0, 0}, camera);
+    const Vector2 bottomRight = GetScreenToWorld2D(Vector2{(float)GetScreenWidth(), (float)GetScreenHeight()}, camera);
+    const Rectangle view = {std::min(topLeft.x, bottomRight.x), std::min(topLeft.y, bottomRight.y),
+                            fabsf(bottomRight.x - topLeft.x), fabsf(bottomRight.y - topLeft.y)};
+
+    // pick the level of detail of every battalion, the density map only needs
+    // to be updated when the simulation ticked or a battalion joined or left it
+    const float troopPixels = camera.zoom * const_troopSpriteSize;
+    bool densityChanged = m_densityTick != m_tick;
+    for (const auto *battalions : {&m_attackerBattalions, &m_defenderBattalions})
+    {
+        for (Handle handle : *battalions)
+        {
+            const Battalion *b = m_battalions.get(handle);
+            const LodLevel lod = nextLod(b->m_lod, troopPixels, b->getTroopCount());
+            densityChanged |= (lod != b->m_lod) && (lod == LodLevel::Density || b->m_lod == LodLevel::Density);
+            b->m_lod = lod;
+        }
+    }
+
+    if (densityChanged)
+    {
+        m_densityMap.begin();
+        for (const auto *battalions : {&m_attackerBattalions, &m_defenderBattalions})
+        {
+            for (Handle handle : *battalions)
+            {
+                const Battalion *b = m_battalions.get(handle);
+                if (b->m_lod == LodLevel::Density)
+                {
+                    b->updateDensity(m_densityMap, handle);
+                }
+            }
+        }
+        m_densityMap.upload(const_colors[(int)Group::Attacker][0], const_colors[(int)Group::Defender][0]);
+        m_densityTick = m_tick;
+    }
+    m_densityMap.draw();
+
+    // the ranges of every battalion, the selected one stronger, below every troop
+    for (const auto *battalions : {&m_attackerBattalions, &m_defenderBattalions})
+    {
+        for (Handle handle : *battalions)
+        {
+            m_battalions.get(handle)->drawRanges(handle == m_selectedBattalion, alpha);
+        }
+    }
+
+    m_troopBatch.clear();
+    for (const auto *battalions : {&m_attackerBattalions, &m_defenderBattalions})
+    {
+        for (Handle handle : *battalions)
+        {
+            const Battalion *b = m_battalions.get(handle);
+            if (b->m_lod == LodLevel::Glyph)
+            {
+                b->drawGlyph(alpha);
+            }
+            else if (b->m_lod == LodLevel::Sprites)
+            {
+                b->addSprites(m_troopBatch, m_troopFrames, view, alpha);
+            }
+        }
+    }
+    m_troopBatch.draw(m_troopSpriteSheet);
+}
+
+void BattalionHandler::drawStatic() const
+{
+    drawWall();
+
+    drawCastle();
+}
+
+int BattalionHandler::getStaticKey() const
+{
+    // the castle looks the same whatever its health
+    return areWallsUp() ? m_defenderWalls[0].getDamageTier() : -1;
+}
+
+void BattalionHandler::drawWall() const
+{
+    for (const Wall &wall : m_defenderWalls)
+    {
+        wall.draw(m_wallSpriteSheet);
+    }
+
+    if (areWallsUp())
+    {
+        const Vector2 castlePos = getCastle().position;
+
+        const Vector2 cornerWallPos = {castlePos.x - 5.5f, castlePos.y - 6.5f};
+
+        DrawTexturePro(m_wallCornerSpriteSheet, Rectangle{0, 0, 8, 8}, {cornerWallPos.x, cornerWallPos.y, 1, 1}, {0, 0}, 0, WHITE);
+    }
+}
+
+void BattalionHandler::drawCastle() const
+{
+    getCastle().draw(m_wallSpriteSheet);
+}
+
+void BattalionHandler::drawInfoPanel(const Camera2D &camera) const
+{
+    if (const Battalion *b = m_battalions.get(m_selectedBattalion))
+    {
+        const Vector2 screenPos = GetWorldToScreen2D(b->m_center, camera);
+        const float panelWidth = 250;
+
+        const float x = screenPos.x - panelWidth / 2;
+        const float y = screenPos.y - 170;
+
+        const Color tintColor = (b->m_group == Group::Attacker) ? Color{255, 0, 0, 255} : Color{0, 0, 255, 255};
+        GuiSetStyle(DEFAULT, BACKGROUND_COLOR, ColorToInt(ColorTint(DARKGRAY, tintColor)));
+        GuiPanel({x, y, panelWidth, 150}, nullptr);
+
+        GuiSetStyle(LABEL, TEXT_ALIGNMENT, TEXT_ALIGN_CENTER);
+        GuiSetStyle(DEFAULT, TEXT_SIZE, 24);
+
+        GuiLabel({x + 10, y + 2, panelWidth - 20, 30}, TextFormat("Battalion Id: %d", b->m_id));
+        GuiLine({x + 5, y + 30, panelWidth - 10, 5}, nullptr);
+
+        GuiSetStyle(LABEL, TEXT_ALIGNMENT, TEXT_ALIGN_LEFT);
+        GuiSetStyle(DEFAULT, TEXT_SIZE, 16);
+
+        const char *text = TextFormat("Type: %s", ((b->m_btype == BType::Warrior) ? "Warrior" : "Archer"));
+        const Vector2 textSize = MeasureTextEx(GuiGetFont(), text, 16, 1);
+        GuiLabel({x + 10, y + 40, panelWidth - 20, 20}, text);
+
+        const Rectangle srcRect = (b->m_btype == BType::Warrior) ? Rectangle{8, 0, 8, 8} : Rectangle{0, 0, 8, 8};
+        DrawTexturePro(m_uiSpriteSheet, srcRect, {x + 15 + textSize.x, y + 40, 16, 16}, {0, 0}, 0, WHITE);
+
+        GuiLabel({x + 10, y + 60, panelWidth - 20, 20}, TextFormat("Center: %.2f, %.2f", b->m_center.x, b->m_center.y));
+
+        const int troopCount = b->getTroopCount();
+        const int iniTroopCount = b->getInitialTroopCount();
+        text = TextFormat("TroopPercent: %.2f%%", 100 * (float)troopCount / iniTroopCount);
+        GuiLabel({x + 10, y + 80, panelWidth - 20, 20}, text);
+
+        text = TextFormat("TroopCount: %d", troopCount);
+        GuiLabel({x + 10, y + 100, panelWidth - 20, 20}, text);
+
+        text = TextFormat("Health: %.0f", b->m_troops.healthTotal);
+        GuiLabel({x + 10, y + 120, panelWidth - 20, 20}, text);
+    }
+}
+
+int Wall::getDamageTier() const
+{
+    if (getHP() < TOTAL_HEALTH * 0.33)
+    {
+        return 2;
+    }
+    if (getHP() < TOTAL_HEALTH * 0.66)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+void Wall::draw(Texture2D spritesheet) const
+{
+    const float baseX = 32.0f * getDamageTier();
+    const float baseY = 96;
+
+    Rectangle wallSourceRec = {baseX, baseY, 32, 16}; // Assuming wall sprite starts at 0,0 in the texture
+    Rectangle wallDestRec = getBoundingBox();
+    DrawTexturePro(spritesheet, wallSourceRec, wallDestRec, Vector2{0, 0}, rotation, WHITE);
+}
+
+void Castle::draw(Texture2D spritesheet) const
+{
+    // Assuming width and height of the castle after scaling
+    float castleWidth = 4.0f;
+    float castleHeight = 4.0f; // Adjust this based on the combined height of both blocks
+
+    // Calculate the position to center the castle in the bottom-right corner
+    float posX = position.x - castleWidth / 2;
+    float posY = position.y - castleHeight / 2;
+
+    // Draw the upper block (Assume the height is half the total height)
+    DrawTexturePro(spritesheet, Rectangle{0, 64, 32, 16}, Rectangle{posX, posY - castleHeight / 4, 4, 2}, Vector2{0, 0}, 0.0f, WHITE);
+
+    // Draw the lower block
+    DrawTexturePro(spritesheet, Rectangle{32, 64, 32, 16}, Rectangle{posX, posY + castleHeight / 4, 4, 2}, Vector2{0, 0}, 0.0f, WHITE);
+}
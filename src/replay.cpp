@@ -0,0 +1,931 @@
+
+#include "src/replay.h"
+#include "src/battalionhandler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+
+const char const_replayMagic[4] = {'B', 'S', 'R', 'P'};
+const int const_replayVersion = 1;
+
+// troops relative to the origin, 1/32 of a world unit
+const float const_positionScale = 32.0f;
+// origins and their velocities, fine enough that a velocity stays good for a while
+const float const_originScale = 4096.0f;
+// rotations in radians
+const float const_angleScale = 65536.0f;
+const float const_healthScale = 16.0f;
+
+// how far the troops may drift with the origin and the rotation before those
+// are corrected, well below const_replayTolerance so that troops seldom are
+const float const_driftTolerance = 1.0f / 64.0f;
+
+enum RecordKind
+{
+    RecordKeyframe = 0,
+    RecordDelta = 1,
+};
+
+// what a delta says about a battalion
+enum BattalionChange
+{
+    ChangeRemoved = 1 << 0,
+    ChangeOrigin = 1 << 1,
+    ChangeRotation = 1 << 2,
+    ChangeDeaths = 1 << 3,
+    ChangePositions = 1 << 4,
+    ChangeHealth = 1 << 5,
+    ChangeState = 1 << 6,
+    ChangeStateRuns = 1 << 7,
+    ChangeTarget = 1 << 8,
+};
+
+int32_t quantize(float value, float scale)
+{
+    return (int32_t)lroundf(value * scale);
+}
+
+// keeps the sign, a troop is dead exactly when its quantized health is <= 0
+int32_t quantizeHealth(float value)
+{
+    const int32_t health = quantize(value, const_healthScale);
+    if (value > 0.0f)
+    {
+        return std::max(health, 1);
+    }
+    return std::min(health, 0);
+}
+
+uint8_t packState(const TroopStorage &troops, int index)
+{
+    return (uint8_t)troops.getState(index) | (troops.getFlip(index) ? 0x80 : 0);
+}
+
+// writes the indices in [0, count) for which changed(i), as gaps from the
+// previous index, and write(i) after each of them
+template <typename Changed, typename Write>
+void writeChanges(ByteWriter &writer, int count, Changed changed, Write write)
+{
+    int changes = 0;
+    for (int i = 0; i < count; i++)
+    {
+        changes += changed(i) ? 1 : 0;
+    }
+
+    writer.writeVarint(changes);
+    int last = -1;
+    for (int i = 0; i < count; i++)
+    {
+        if (changed(i))
+        {
+            writer.writeVarint(i - last - 1);
+            write(i);
+            last = i;
+        }
+    }
+}
+
+template <typename Read>
+bool readChanges(ByteReader &reader, int count, Read read)
+{
+    const uint64_t changes = reader.readVarint();
+    if (changes > (uint64_t)count)
+    {
+        return false;
+    }
+
+    int64_t index = -1;
+    for (uint64_t k = 0; k < changes && !reader.failed(); k++)
+    {
+        index += reader.readVarint() + 1;
+        if (index >= count)
+        {
+            return false;
+        }
+        read((int)index);
+    }
+    return !reader.failed();
+}
+
+// values that are mostly the same as the previous one, as (run length, value) pairs
+template <typename T, typename Write>
+void writeRuns(ByteWriter &writer, const std::vector<T> &values, Write write)
+{
+    for (int i = 0; i < (int)values.size();)
+    {
+        int run = 1;
+        while (i + run < (int)values.size() && values[i + run] == values[i])
+        {
+            run++;
+        }
+        writer.writeVarint(run);
+        write(values[i]);
+        i += run;
+    }
+}
+
+template <typename T, typename Read>
+bool readRuns(ByteReader &reader, std::vector<T> &values, Read read)
+{
+    for (int i = 0; i < (int)values.size() && !reader.failed();)
+    {
+        const uint64_t run = reader.readVarint();
+        const T value = read();
+        if (run == 0 || run > values.size() - i)
+        {
+            return false;
+        }
+        std::fill(values.begin() + i, values.begin() + i + run, value);
+        i += run;
+    }
+    return !reader.failed();
+}
+
+Vector2 rotateVector(Vector2 v, float cosres, float sinres)
+{
+    return Vector2{v.x * cosres - v.y * sinres, v.x * sinres + v.y * cosres};
+}
+
+bool isDead(const ReplayBattalion &battalion, int index)
+{
+    return battalion.health[index] <= 0;
+}
+
+int countAlive(const ReplayBattalion &battalion)
+{
+    int alive = 0;
+    for (int i = 0; i < battalion.getTroopCount(); i++)
+    {
+        alive += isDead(battalion, i) ? 0 : 1;
+    }
+    return alive;
+}
+
+// removes the troops that died, the same way TroopStorage::removeDead does
+void removeDeadTroops(ReplayBattalion &battalion)
+{
+    int alive = 0;
+    for (int i = 0; i < battalion.getTroopCount(); i++)
+    {
+        if (isDead(battalion, i))
+        {
+            continue;
+        }
+        battalion.x[alive] = battalion.x[i];
+        battalion.y[alive] = battalion.y[i];
+        battalion.health[alive] = battalion.health[i];
+        battalion.state[alive] = battalion.state[i];
+        alive++;
+    }
+    battalion.x.resize(alive);
+    battalion.y.resize(alive);
+    battalion.health.resize(alive);
+    battalion.state.resize(alive);
+}
+
+void resizeTroops(ReplayBattalion &battalion, int count)
+{
+    battalion.x.resize(count);
+    battalion.y.resize(count);
+    battalion.health.resize(count);
+    battalion.state.resize(count);
+}
+
+// every tick starts with the origins moving on by their velocity
+void advance(ReplayFrame &frame)
+{
+    for (ReplayBattalion &b : frame.battalions)
+    {
+        b.originX += b.velocityX;
+        b.originY += b.velocityY;
+        b.rotation += b.angularVelocity;
+    }
+}
+
+void writeKeyframe(ByteWriter &writer, const ReplayFrame &frame)
+{
+    writer.writeSigned(frame.castleHealth);
+    writer.writeSigned(frame.wallHealth);
+    writer.writeVarint(frame.battalions.size());
+
+    for (const ReplayBattalion &b : frame.battalions)
+    {
+        writer.writeVarint(b.key);
+        writer.writeSigned(b.id);
+        writer.writeByte((uint8_t)b.group);
+        writer.writeByte((uint8_t)b.btype);
+        writer.writeVarint(b.target + 1);
+        writer.writeSigned(b.originX);
+        writer.writeSigned(b.originY);
+        writer.writeSigned(b.velocityX);
+        writer.writeSigned(b.velocityY);
+        writer.writeSigned(b.rotation);
+        writer.writeSigned(b.angularVelocity);
+
+        // neighbouring troops of a formation are close to each other
+        writer.writeVarint(b.getTroopCount());
+        int32_t lastX = 0, lastY = 0;
+        for (int i = 0; i < b.getTroopCount(); i++)
+        {
+            writer.writeSigned(b.x[i] - lastX);
+            writer.writeSigned(b.y[i] - lastY);
+            lastX = b.x[i];
+            lastY = b.y[i];
+        }
+        writeRuns(writer, b.health, [&](int32_t value)
+                  { writer.writeSigned(value); });
+        writeRuns(writer, b.state, [&](uint8_t value)
+                  { writer.writeByte(value); });
+    }
+}
+
+bool readKeyframe(ByteReader &reader, ReplayFrame &frame)
+{
+    frame.castleHealth = reader.readSigned();
+    frame.wallHealth = reader.readSigned();
+    const uint64_t count = reader.readVarint();
+    if (count > reader.remaining())
+    {
+        return false;
+    }
+
+    frame.battalions.assign(count, ReplayBattalion());
+    int lastKey = -1;
+    for (ReplayBattalion &b : frame.battalions)
+    {
+        b.key = reader.readVarint();
+        b.id = reader.readSigned();
+        b.group = (Group)reader.readByte();
+        b.btype = (BType)reader.readByte();
+        b.target = (int)reader.readVarint() - 1;
+        b.originX = reader.readSigned();
+        b.originY = reader.readSigned();
+        b.velocityX = reader.readSigned();
+        b.velocityY = reader.readSigned();
+        b.rotation = reader.readSigned();
+        b.angularVelocity = reader.readSigned();
+        if (b.key <= lastKey || (int)b.group > 1 || (int)b.btype > 1)
+        {
+            return false;
+        }
+        lastKey = b.key;
+
+        const uint64_t troops = reader.readVarint();
+        if (troops > reader.remaining())
+        {
+            return false;
+        }
+        resizeTroops(b, troops);
+        int32_t lastX = 0, lastY = 0;
+        for (int i = 0; i < (int)troops; i++)
+        {
+            lastX += reader.readSigned();
+            lastY += reader.readSigned();
+            b.x[i] = lastX;
+            b.y[i] = lastY;
+        }
+        if (!readRuns(reader, b.health, [&]
+                      { return (int32_t)reader.readSigned(); }) ||
+            !readRuns(reader, b.state, [&]
+                      { return reader.readByte(); }))
+        {
+            return false;
+        }
+    }
+    return !reader.failed();
+}
+
+bool readDelta(ByteReader &reader, ReplayFrame &frame)
+{
+    frame.castleHealth += reader.readSigned();
+    frame.wallHealth += reader.readSigned();
+    advance(frame);
+
+    // the changed battalions as gaps + 1 from the previous one, 0 ends the list
+    int index = -1;
+    bool removed = false;
+    for (uint64_t gap = reader.readVarint(); gap != 0 && !reader.failed(); gap = reader.readVarint())
+    {
+        index += gap;
+        if (index >= (int)frame.battalions.size())
+        {
+            return false;
+        }
+        ReplayBattalion &b = frame.battalions[index];
+        const uint64_t flags = reader.readVarint();
+
+        if (flags & ChangeRemoved)
+        {
+            resizeTroops(b, 0);
+            removed = true;
+            continue;
+        }
+        if (flags & ChangeTarget)
+        {
+            b.target = (int)reader.readVarint() - 1;
+        }
+        if (flags & ChangeOrigin)
+        {
+            b.originX += reader.readSigned();
+            b.originY += reader.readSigned();
+            b.velocityX += reader.readSigned();
+            b.velocityY += reader.readSigned();
+        }
+        if (flags & ChangeRotation)
+        {
+            b.rotation += reader.readSigned();
+            b.angularVelocity += reader.readSigned();
+        }
+        if (flags & ChangeDeaths)
+        {
+            removeDeadTroops(b);
+        }
+        if ((flags & ChangePositions) && !readChanges(reader, b.getTroopCount(), [&](int i)
+                                                      { b.x[i] += reader.readSigned();
+                                                        b.y[i] += reader.readSigned(); }))
+        {
+            return false;
+        }
+        if ((flags & ChangeHealth) && !readChanges(reader, b.getTroopCount(), [&](int i)
+                                                   { b.health[i] += reader.readSigned(); }))
+        {
+            return false;
+        }
+        if ((flags & ChangeState) && !readChanges(reader, b.getTroopCount(), [&](int i)
+                                                  { b.state[i] = reader.readByte(); }))
+        {
+            return false;
+        }
+        if ((flags & ChangeStateRuns) && !readRuns(reader, b.state, [&]
+                                                   { return reader.readByte(); }))
+        {
+            return false;
+        }
+    }
+
+    if (removed)
+    {
+        auto empty = [](const ReplayBattalion &b)
+        { return b.getTroopCount() == 0; };
+        frame.battalions.erase(std::remove_if(frame.battalions.begin(), frame.battalions.end(), empty), frame.battalions.end());
+    }
+    return !reader.failed();
+}
+
+} // namespace
+
+Vector2 ReplayBattalion::getOrigin() const
+{
+    return Vector2{originX / const_originScale, originY / const_originScale};
+}
+
+float ReplayBattalion::getRotation() const
+{
+    return rotation / const_angleScale;
+}
+
+Vector2 ReplayBattalion::getTroopPosition(int index) const
+{
+    const float angle = getRotation();
+    const Vector2 local = {x[index] / const_positionScale, y[index] / const_positionScale};
+    return Vector2Add(getOrigin(), rotateVector(local, cosf(angle), sinf(angle)));
+}
+
+float ReplayBattalion::getTroopHealth(int index) const
+{
+    return health[index] / const_healthScale;
+}
+
+float ReplayFrame::getCastleHealth() const
+{
+    return castleHealth / const_healthScale;
+}
+
+float ReplayFrame::getWallHealth() const
+{
+    return wallHealth / const_healthScale;
+}
+
+int ReplayFrame::getTroopCount(Group group) const
+{
+    int count = 0;
+    for (const ReplayBattalion &b : battalions)
+    {
+        if (b.group == group)
+        {
+            count += b.getTroopCount();
+        }
+    }
+    return count;
+}
+
+ReplayRecorder::ReplayRecorder(int keyframeInterval)
+    : m_keyframeInterval(std::max(keyframeInterval, 1))
+{
+}
+
+void ReplayRecorder::begin(const BattalionHandler &handler, int targetFPS)
+{
+    m_data.clear();
+    m_data.writeBytes(const_replayMagic, sizeof(const_replayMagic));
+    m_data.writeVarint(const_replayVersion);
+    m_data.writeFloat(handler.m_worldBounds.x);
+    m_data.writeFloat(handler.m_worldBounds.y);
+    m_data.writeVarint(targetFPS);
+    m_data.writeVarint(handler.m_seed);
+    m_data.writeVarint(m_keyframeInterval);
+
+    m_tracks.clear();
+    capture(handler);
+    encodeKeyframe();
+    writeRecord(RecordKeyframe, m_tick);
+    m_lastKeyframeTick = m_tick;
+}
+
+void ReplayRecorder::record(const BattalionHandler &handler)
+{
+    capture(handler);
+
+    if (m_tick - m_lastKeyframeTick < m_keyframeInterval && encodeDelta())
+    {
+        writeRecord(RecordDelta, m_tick);
+        return;
+    }
+
+    encodeKeyframe();
+    writeRecord(RecordKeyframe, m_tick);
+    m_lastKeyframeTick = m_tick;
+}
+
+bool ReplayRecorder::save(const char *path, std::string &error) const
+{
+    return writeBinaryFile(path, m_data.getData(), error);
+}
+
+void ReplayRecorder::capture(const BattalionHandler &handler)
+{
+    m_tick = handler.m_tick;
+    m_castleHealth = quantizeHealth(handler.getCastleHealth());
+    m_wallHealth = quantizeHealth(handler.getWallHealth());
+
+    m_captured.clear();
+    auto add = [&](const std::vector<Handle> &vec)
+    {
+        for (Handle handle : vec)
+        {
+            const Battalion *b = handler.m_battalions.get(handle);
+            Captured captured;
+            captured.battalion = b;
+            captured.rotation = b->m_rotation * DEG2RAD;
+            m_captured.push_back(captured);
+        }
+    };
+    add(handler.m_attackerBattalions);
+    add(handler.m_defenderBattalions);
+    std::sort(m_captured.begin(), m_captured.end(), [](const Captured &a, const Captured &b)
+              { return a.battalion->m_key < b.battalion->m_key; });
+
+    for (Captured &c : m_captured)
+    {
+        const Battalion &b = *c.battalion;
+        if ((int)m_tracks.size() <= b.m_key)
+        {
+            m_tracks.resize(b.m_key + 1);
+        }
+
+        // The troops only ever move and turn together, except that removing
+        // the dead at the start of the tick moves the center among them. The
+        // origin starts at the center and stays where it was on the troops.
+        Track &track = m_tracks[b.m_key];
+        if (track.valid)
+        {
+            const Vector2 jump = Vector2Subtract(b.m_startCenter, track.center);
+            track.offset = Vector2Subtract(track.offset, rotateVector(jump, cosf(track.rotation), -sinf(track.rotation)));
+        }
+        else
+        {
+            track.valid = true;
+            track.offset = Vector2{0, 0};
+            track.origin = b.m_center;
+            track.rotation = c.rotation;
+        }
+
+        const Vector2 origin = Vector2Add(b.m_center, rotateVector(track.offset, cosf(c.rotation), sinf(c.rotation)));
+        // the last step becomes the velocity whenever the origin is corrected
+        c.origin = origin;
+        c.velocity = Vector2Subtract(origin, track.origin);
+        c.angularVelocity = c.rotation - track.rotation;
+
+        track.center = b.m_center;
+        track.origin = origin;
+        track.rotation = c.rotation;
+    }
+}
+
+void ReplayRecorder::encodeKeyframe()
+{
+    m_frame.tick = m_tick;
+    m_frame.castleHealth = m_castleHealth;
+    m_frame.wallHealth = m_wallHealth;
+    m_frame.battalions.resize(m_captured.size());
+
+    for (int i = 0; i < (int)m_captured.size(); i++)
+    {
+        const Captured &c = m_captured[i];
+        const Battalion &source = *c.battalion;
+        ReplayBattalion &b = m_frame.battalions[i];
+        b.key = source.m_key;
+        b.id = source.m_id;
+        b.group = source.m_group;
+        b.btype = source.m_btype;
+        const Battalion *target = source.getTarget();
+        b.target = target ? target->m_key : -1;
+        b.originX = quantize(c.origin.x, const_originScale);
+        b.originY = quantize(c.origin.y, const_originScale);
+        b.velocityX = quantize(c.velocity.x, const_originScale);
+        b.velocityY = quantize(c.velocity.y, const_originScale);
+        b.rotation = quantize(c.rotation, const_angleScale);
+        b.angularVelocity = quantize(c.angularVelocity, const_angleScale);
+
+        // in the frame of the quantized origin, that is what the player turns them with
+        const Vector2 origin = b.getOrigin();
+        const float angle = b.getRotation();
+        const float cosres = cosf(angle);
+        const float sinres = -sinf(angle);
+        const TroopStorage &troops = source.m_troops;
+        resizeTroops(b, troops.size());
+        for (int t = 0; t < troops.size(); t++)
+        {
+            const Vector2 local = rotateVector(Vector2Subtract(troops.position(t), origin), cosres, sinres);
+            b.x[t] = quantize(local.x, const_positionScale);
+            b.y[t] = quantize(local.y, const_positionScale);
+            b.health[t] = quantizeHealth(troops.health[t]);
+            b.state[t] = packState(troops, t);
+        }
+    }
+
+    m_payload.clear();
+    writeKeyframe(m_payload, m_frame);
+}
+
+bool ReplayRecorder::encodeDelta()
+{
+    m_payload.clear();
+    m_payload.writeSigned(m_castleHealth - m_frame.castleHealth);
+    m_payload.writeSigned(m_wallHealth - m_frame.wallHealth);
+    m_frame.tick = m_tick;
+    m_frame.castleHealth = m_castleHealth;
+    m_frame.wallHealth = m_wallHealth;
+    advance(m_frame);
+
+    // every captured battalion has to continue one of the frame with exactly
+    // its surviving troops, anything else needs a keyframe
+    std::vector<int> continued(m_frame.battalions.size(), -1);
+    int previous = 0;
+    for (int i = 0; i < (int)m_captured.size(); i++)
+    {
+        const int key = m_captured[i].battalion->m_key;
+        while (previous < (int)m_frame.battalions.size() && m_frame.battalions[previous].key < key)
+        {
+            previous++;
+        }
+        if (previous == (int)m_frame.battalions.size() || m_frame.battalions[previous].key != key)
+        {
+            return false;
+        }
+        continued[previous] = i;
+    }
+
+    int last = -1;
+    std::vector<int32_t> newX, newY;
+    for (int p = 0; p < (int)m_frame.battalions.size(); p++)
+    {
+        ReplayBattalion &b = m_frame.battalions[p];
+        const int alive = countAlive(b);
+        uint64_t flags = 0;
+
+        if (continued[p] < 0)
+        {
+            if (alive > 0)
+            {
+                return false;
+            }
+            m_payload.writeVarint(p - last);
+            m_payload.writeVarint(ChangeRemoved);
+            last = p;
+            continue;
+        }
+
+        const Captured &c = m_captured[continued[p]];
+        const Battalion &source = *c.battalion;
+        const TroopStorage &troops = source.m_troops;
+        if (alive != troops.size())
+        {
+            return false;
+        }
+
+        if (alive != b.getTroopCount())
+        {
+            flags |= ChangeDeaths;
+            removeDeadTroops(b);
+        }
+
+        const Battalion *target = source.getTarget();
+        const int targetKey = target ? target->m_key : -1;
+        flags |= (targetKey != b.target) ? ChangeTarget : 0;
+
+        // the origin and the rotation are only corrected once they drifted off
+        const int32_t originX = quantize(c.origin.x, const_originScale);
+        const int32_t originY = quantize(c.origin.y, const_originScale);
+        const int32_t velocityX = quantize(c.velocity.x, const_originScale);
+        const int32_t velocityY = quantize(c.velocity.y, const_originScale);
+        const int32_t originTolerance = quantize(const_driftTolerance, const_originScale);
+        if (std::abs(originX - b.originX) > originTolerance || std::abs(originY - b.originY) > originTolerance)
+        {
+            flags |= ChangeOrigin;
+        }
+
+        // a turn moves the troops furthest from the origin the most
+        int32_t radius = const_positionScale;
+        for (int t = 0; t < alive; t++)
+        {
+            radius = std::max(radius, std::abs(b.x[t]) + std::abs(b.y[t]));
+        }
+        const int32_t rotation = quantize(c.rotation, const_angleScale);
+        const int32_t angularVelocity = quantize(c.angularVelocity, const_angleScale);
+        const int32_t rotationTolerance = quantize(const_driftTolerance * const_positionScale / radius, const_angleScale);
+        if (std::abs(rotation - b.rotation) > rotationTolerance)
+        {
+            flags |= ChangeRotation;
+        }
+
+        const int32_t oldOriginX = b.originX, oldOriginY = b.originY;
+        const int32_t oldVelocityX = b.velocityX, oldVelocityY = b.velocityY;
+        const int32_t oldRotation = b.rotation, oldAngularVelocity = b.angularVelocity;
+        if (flags & ChangeOrigin)
+        {
+            b.originX = originX;
+            b.originY = originY;
+            b.velocityX = velocityX;
+            b.velocityY = velocityY;
+        }
+        if (flags & ChangeRotation)
+        {
+            b.rotation = rotation;
+            b.angularVelocity = angularVelocity;
+        }
+
+        // troops that ended up too far from where the player would put them
+        const Vector2 origin = b.getOrigin();
+        const float angle = b.getRotation();
+        const float cosres = cosf(angle);
+        const float sinres = sinf(angle);
+        const float toleranceSqr = const_replayTolerance * const_replayTolerance;
+        newX.assign(b.x.begin(), b.x.end());
+        newY.assign(b.y.begin(), b.y.end());
+        bool moved = false;
+        for (int t = 0; t < alive; t++)
+        {
+            const Vector2 local = {b.x[t] / const_positionScale, b.y[t] / const_positionScale};
+            const Vector2 predicted = Vector2Add(origin, rotateVector(local, cosres, sinres));
+            if (Vector2DistanceSqr(predicted, troops.position(t)) > toleranceSqr)
+            {
+                const Vector2 actual = rotateVector(Vector2Subtract(troops.position(t), origin), cosres, -sinres);
+                newX[t] = quantize(actual.x, const_positionScale);
+                newY[t] = quantize(actual.y, const_positionScale);
+                moved = true;
+            }
+        }
+        flags |= moved ? ChangePositions : 0;
+
+        bool healthChanged = false;
+        bool stateChanged = false;
+        m_states.resize(alive);
+        for (int t = 0; t < alive; t++)
+        {
+            m_states[t] = packState(troops, t);
+            healthChanged |= b.health[t] != quantizeHealth(troops.health[t]);
+            stateChanged |= b.state[t] != m_states[t];
+        }
+        flags |= healthChanged ? ChangeHealth : 0;
+
+        // whole battalions switch state at once, then runs are shorter than changes
+        m_scratch.clear();
+        size_t changesSize = 0;
+        if (stateChanged)
+        {
+            writeChanges(
+                m_scratch, alive, [&](int i)
+                { return b.state[i] != m_states[i]; },
+                [&](int i)
+                { m_scratch.writeByte(m_states[i]); });
+            changesSize = m_scratch.size();
+            writeRuns(m_scratch, m_states, [&](uint8_t value)
+                      { m_scratch.writeByte(value); });
+            flags |= (m_scratch.size() - changesSize < changesSize) ? ChangeStateRuns : ChangeState;
+        }
+
+        if (!flags)
+        {
+            continue;
+        }
+
+        m_payload.writeVarint(p - last);
+        m_payload.writeVarint(flags);
+        last = p;
+        if (flags & ChangeTarget)
+        {
+            m_payload.writeVarint(targetKey + 1);
+            b.target = targetKey;
+        }
+        if (flags & ChangeOrigin)
+        {
+            m_payload.writeSigned(b.originX - oldOriginX);
+            m_payload.writeSigned(b.originY - oldOriginY);
+            m_payload.writeSigned(b.velocityX - oldVelocityX);
+            m_payload.writeSigned(b.velocityY - oldVelocityY);
+        }
+        if (flags & ChangeRotation)
+        {
+            m_payload.writeSigned(b.rotation - oldRotation);
+            m_payload.writeSigned(b.angularVelocity - oldAngularVelocity);
+        }
+        if (flags & ChangePositions)
+        {
+            writeChanges(
+                m_payload, alive, [&](int i)
+                { return newX[i] != b.x[i] || newY[i] != b.y[i]; },
+                [&](int i)
+                { m_payload.writeSigned(newX[i] - b.x[i]);
+                  m_payload.writeSigned(newY[i] - b.y[i]); });
+            b.x.swap(newX);
+            b.y.swap(newY);
+        }
+        if (flags & ChangeHealth)
+        {
+            writeChanges(
+                m_payload, alive, [&](int i)
+                { return b.health[i] != quantizeHealth(troops.health[i]); },
+                [&](int i)
+                { m_payload.writeSigned(quantizeHealth(troops.health[i]) - b.health[i]);
+                  b.health[i] = quantizeHealth(troops.health[i]); });
+        }
+        if (flags & ChangeState)
+        {
+            m_payload.writeBytes(m_scratch.getData().data(), changesSize);
+        }
+        if (flags & ChangeStateRuns)
+        {
+            m_payload.writeBytes(m_scratch.getData().data() + changesSize, m_scratch.size() - changesSize);
+        }
+        b.state.swap(m_states);
+    }
+    m_payload.writeVarint(0);
+
+    int kept = 0;
+    for (int p = 0; p < (int)m_frame.battalions.size(); p++)
+    {
+        if (continued[p] >= 0)
+        {
+            std::swap(m_frame.battalions[kept++], m_frame.battalions[p]);
+        }
+    }
+    m_frame.battalions.resize(kept);
+    return true;
+}
+
+void ReplayRecorder::writeRecord(int kind, int tick)
+{
+    m_data.writeVarint(kind);
+    m_data.writeVarint(tick);
+    m_data.writeVarint(m_payload.size());
+    m_data.writeBytes(m_payload.getData().data(), m_payload.size());
+}
+
+bool ReplayPlayer::load(std::vector<uint8_t> data, std::string &error)
+{
+    m_data = std::move(data);
+    m_records.clear();
+    m_current = -1;
+    m_frame = ReplayFrame();
+
+    ByteReader reader(m_data.data(), m_data.size());
+    char magic[4];
+    if (!reader.readBytes(magic, sizeof(magic)) || memcmp(magic, const_replayMagic, sizeof(magic)) != 0)
+    {
+        error = "not a replay";
+        return false;
+    }
+    if (reader.readVarint() != const_replayVersion)
+    {
+        error = "unsupported replay version";
+        return false;
+    }
+    m_header.worldBounds.x = reader.readFloat();
+    m_header.worldBounds.y = reader.readFloat();
+    m_header.targetFPS = reader.readVarint();
+    m_header.seed = reader.readVarint();
+    m_header.keyframeInterval = reader.readVarint();
+
+    // only the record headers are read here, the payloads when seeking
+    while (reader.remaining() > 0 && !reader.failed())
+    {
+        Record record;
+        record.kind = reader.readVarint();
+        record.tick = reader.readVarint();
+        record.length = reader.readVarint();
+        record.offset = reader.position() - m_data.data();
+        if (!reader.skip(record.length))
+        {
+            break;
+        }
+        if (record.kind != RecordKeyframe && record.kind != RecordDelta)
+        {
+            error = "unknown record kind";
+            return false;
+        }
+        if (m_records.empty() ? record.kind != RecordKeyframe : record.tick <= m_records.back().tick)
+        {
+            error = "records out of order";
+            return false;
+        }
+        m_records.push_back(record);
+    }
+
+    if (reader.failed() || m_records.empty())
+    {
+        error = "truncated replay";
+        return false;
+    }
+    if (!seek(getFirstTick()))
+    {
+        error = "corrupt replay";
+        return false;
+    }
+    return true;
+}
+
+bool ReplayPlayer::loadFile(const char *path, std::string &error)
+{
+    std::vector<uint8_t> data;
+    if (!readBinaryFile(path, data, error))
+    {
+        return false;
+    }
+    return load(std::move(data), error);
+}
+
+bool ReplayPlayer::seek(int tick)
+{
+    auto after = std::upper_bound(m_records.begin(), m_records.end(), tick, [](int t, const Record &record)
+                                  { return t < record.tick; });
+    const int target = std::max((int)(after - m_records.begin()) - 1, 0);
+
+    int keyframe = target;
+    while (m_records[keyframe].kind != RecordKeyframe)
+    {
+        keyframe--;
+    }
+
+    // going forward within the same keyframe interval only needs the records in between
+    int first = keyframe;
+    if (m_current >= keyframe && m_current <= target)
+    {
+        first = m_current + 1;
+    }
+
+    ReplayFrame frame = (first == keyframe) ? ReplayFrame() : m_frame;
+    std::swap(frame, m_frame);
+    for (int i = first; i <= target; i++)
+    {
+        if (!apply(i))
+        {
+            std::swap(frame, m_frame);
+            return false;
+        }
+    }
+    m_current = target;
+    return true;
+}
+
+bool ReplayPlayer::next()
+{
+    if (m_current + 1 >= (int)m_records.size())
+    {
+        return false;
+    }
+    return seek(m_records[m_current + 1].tick);
+}
+
+bool ReplayPlayer::apply(int index)
+{
+    const Record &record = m_records[index];
+    ByteReader reader(m_data.data() + record.offset, record.length);
+
+    const bool ok = (record.kind == RecordKeyframe) ? readKeyframe(reader, m_frame) : readDelta(reader, m_frame);
+    m_frame.tick = record.tick;
+    return ok && reader.remaining() == 0;
+}
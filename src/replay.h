@@ -0,0 +1,183 @@
+
+#pragma once
+
+#include "src/battalion.h"
+#include "src/bytestream.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class BattalionHandler;
+
+// Binary replay of a battle: a header, a keyframe with the full state of the
+// first tick and then one record per tick with only what changed since the
+// previous tick. Troops are stored relative to an origin that moves and turns
+// with their battalion, and the origin keeps moving at its last velocity
+// until the recorder corrects it, so a battalion marching or turning steadily
+// costs nothing. Positions are reproduced within const_replayTolerance and
+// health is quantized. A keyframe is written every keyframe interval, seeking
+// decodes at most one interval of records.
+
+/// @brief largest distance between a replayed troop and the recorded one
+inline constexpr float const_replayTolerance = 1.0f / 16.0f;
+
+/// @brief a battalion as stored in a replay, positions and health are quantized
+struct ReplayBattalion
+{
+    int key = -1;
+    int id = 0;
+    Group group = Group::Attacker;
+    BType btype = BType::Warrior;
+    // key of the targeted battalion, -1 if none
+    int target = -1;
+
+    // point moving rigidly with the troops and its change per tick
+    int32_t originX = 0;
+    int32_t originY = 0;
+    int32_t velocityX = 0;
+    int32_t velocityY = 0;
+    int32_t rotation = 0;
+    int32_t angularVelocity = 0;
+
+    // per troop, x and y in the frame of the origin
+    std::vector<int32_t> x;
+    std::vector<int32_t> y;
+    // <= 0 once the troop died, it is removed at the next tick
+    std::vector<int32_t> health;
+    // TroopState, with the top bit set if the sprite is flipped
+    std::vector<uint8_t> state;
+
+    int getTroopCount() const { return x.size(); }
+    Vector2 getOrigin() const;
+    /// @brief returns the rotation of the battalion in radians
+    float getRotation() const;
+    Vector2 getTroopPosition(int index) const;
+    float getTroopHealth(int index) const;
+    TroopState getTroopState(int index) const { return (TroopState)(state[index] & 0x7F); }
+    bool isTroopFlipped(int index) const { return state[index] & 0x80; }
+};
+
+/// @brief the state of a battle at the end of a tick
+struct ReplayFrame
+{
+    int tick = 0;
+    int32_t castleHealth = 0;
+    int32_t wallHealth = 0;
+    // ordered by key
+    std::vector<ReplayBattalion> battalions;
+
+    float getCastleHealth() const;
+    float getWallHealth() const;
+    int getTroopCount(Group group) const;
+};
+
+struct ReplayHeader
+{
+    Vector2 worldBounds = {0, 0};
+    int targetFPS = 60;
+    uint64_t seed = 0;
+    int keyframeInterval = 0;
+};
+
+class ReplayRecorder
+{
+
+public:
+    /// @brief keyframeInterval is the number of ticks between keyframes
+    ReplayRecorder(int keyframeInterval = 600);
+
+    /// @brief starts a new replay with the current state of the handler as the first keyframe
+    void begin(const BattalionHandler &handler, int targetFPS);
+    /// @brief records the tick the handler just stepped
+    void record(const BattalionHandler &handler);
+
+    const std::vector<uint8_t> &getData() const { return m_data.getData(); }
+    /// @brief writes the replay to the file at path
+    bool save(const char *path, std::string &error) const;
+
+private:
+    // a battalion as it really is at the end of the tick
+    struct Captured
+    {
+        const Battalion *battalion;
+        Vector2 origin;
+        Vector2 velocity;
+        float rotation;
+        float angularVelocity;
+    };
+    // what the recorder remembers of a battalion between ticks, by key
+    struct Track
+    {
+        bool valid = false;
+        // origin in the frame of the battalion, relative to its center
+        Vector2 offset;
+        Vector2 center;
+        Vector2 origin;
+        float rotation;
+    };
+
+    /// @brief finds the battalions of the handler and where their origins are
+    void capture(const BattalionHandler &handler);
+    /// @brief makes m_frame the exact captured state and writes it to m_payload
+    void encodeKeyframe();
+    /// @brief moves m_frame to the captured state and writes the changes to m_payload
+    /// @return false if they cannot be written as a delta
+    bool encodeDelta();
+    void writeRecord(int kind, int tick);
+
+private:
+    int m_keyframeInterval;
+    int m_lastKeyframeTick = 0;
+    ByteWriter m_data;
+    ByteWriter m_payload;
+    ByteWriter m_scratch;
+    std::vector<uint8_t> m_states;
+    // what a player sees at the last recorded tick
+    ReplayFrame m_frame;
+    std::vector<Captured> m_captured;
+    std::vector<Track> m_tracks;
+    int m_tick = 0;
+    int32_t m_castleHealth = 0;
+    int32_t m_wallHealth = 0;
+};
+
+class ReplayPlayer
+{
+
+public:
+    /// @brief reads a replay written by ReplayRecorder and seeks to its first tick
+    /// @return false if it is not a valid replay, `error` says why
+    bool load(std::vector<uint8_t> data, std::string &error);
+    /// @brief reads the replay file at path
+    bool loadFile(const char *path, std::string &error);
+
+    const ReplayHeader &getHeader() const { return m_header; }
+    int getFirstTick() const { return m_records.front().tick; }
+    int getLastTick() const { return m_records.back().tick; }
+    /// @brief moves to the last recorded tick at or before tick
+    /// @return false if the replay is corrupt, the frame is then left as is
+    bool seek(int tick);
+    /// @brief moves to the next recorded tick, false at the end
+    bool next();
+    const ReplayFrame &getFrame() const { return m_frame; }
+
+private:
+    struct Record
+    {
+        int kind;
+        int tick;
+        size_t offset;
+        size_t length;
+    };
+
+    /// @brief applies record index to m_frame
+    bool apply(int index);
+
+private:
+    std::vector<uint8_t> m_data;
+    ReplayHeader m_header;
+    std::vector<Record> m_records;
+    // index of the record m_frame is at, -1 if none
+    int m_current = -1;
+    ReplayFrame m_frame;
+};
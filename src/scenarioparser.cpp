@@ -0,0 +1,613 @@
+#include "src/scenarioparser.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+// numbers up to this long are copied on the stack, longer ones to the heap
+const size_t const_maxNumberLength = 63;
+
+// Reads the scenario schema while scanning the text, without building a
+// document first: troop positions go straight into the BattalionSpawnInfo
+// they belong to, and keys the schema does not know are skipped.
+class ScenarioReader
+{
+
+public:
+    ScenarioReader(const char *data, size_t size)
+        : m_cur(data), m_begin(data), m_end(data + size)
+    {
+    }
+
+    bool parse(InitialGameState &state)
+    {
+        bool seen[2] = {false, false};
+        if (!expect('{'))
+        {
+            return false;
+        }
+        if (!peekIs('}'))
+        {
+            do
+            {
+                if (!parseKey())
+                {
+                    return false;
+                }
+
+                const int side = (m_key == "userInitData") ? 0 : (m_key == "aiInitData") ? 1
+                                                                                         : -1;
+                if (side < 0)
+                {
+                    if (!skipValue(0))
+                    {
+                        return false;
+                    }
+                    continue;
+                }
+                if (seen[side])
+                {
+                    return fail("duplicate side");
+                }
+                seen[side] = true;
+
+                auto &battalions = side ? state.defenderBattalions : state.attackerBattalions;
+                if (!parseInitData(side == 1, battalions))
+                {
+                    return false;
+                }
+            } while (next('}'));
+        }
+        if (!m_error.empty() || !expect('}'))
+        {
+            return false;
+        }
+
+        skipWhitespace();
+        if (m_cur != m_end)
+        {
+            return fail("unexpected trailing characters");
+        }
+        if (!seen[0] || !seen[1])
+        {
+            return fail(seen[0] ? "aiInitData is missing" : "userInitData is missing");
+        }
+
+        // ids follow the sides, whatever order they came in
+        int id = 0;
+        for (auto &info : state.attackerBattalions)
+        {
+            info.id = ++id;
+        }
+        for (auto &info : state.defenderBattalions)
+        {
+            info.id = ++id;
+        }
+        return true;
+    }
+
+    const std::string &error() const { return m_error; }
+
+private:
+    bool fail(const char *message)
+    {
+        // the position is only worked out for the error message
+        int line = 1;
+        const char *lineStart = m_begin;
+        for (const char *c = m_begin; c < m_cur; c++)
+        {
+            if (*c == '\n')
+            {
+                line++;
+                lineStart = c + 1;
+            }
+        }
+
+        std::stringstream stream;
+        stream << line << ":" << (m_cur - lineStart + 1) << ": " << message;
+        m_error = stream.str();
+        return false;
+    }
+
+    void skipWhitespace()
+    {
+        while (m_cur != m_end && (*m_cur == ' ' || *m_cur == '\n' || *m_cur == '\r' || *m_cur == '\t'))
+        {
+            m_cur++;
+        }
+    }
+
+    bool peekIs(char c)
+    {
+        skipWhitespace();
+        return m_cur != m_end && *m_cur == c;
+    }
+
+    bool expect(char c)
+    {
+        if (!peekIs(c))
+        {
+            const std::string message = std::string("expected '") + c + "'";
+            return fail(message.c_str());
+        }
+        m_cur++;
+        return true;
+    }
+
+    // after a member or element: true if another one follows, false at close
+    // (left unconsumed) or on a syntax error (with m_error set)
+    bool next(char close)
+    {
+        skipWhitespace();
+        if (m_cur != m_end && *m_cur == ',')
+        {
+            m_cur++;
+            return true;
+        }
+        if (m_cur == m_end || *m_cur != close)
+        {
+            fail(close == '}' ? "expected ',' or '}'" : "expected ',' or ']'");
+        }
+        return false;
+    }
+
+    bool consume(const char *literal)
+    {
+        const char *cur = m_cur;
+        for (; *literal; literal++, cur++)
+        {
+            if (cur == m_end || *cur != *literal)
+            {
+                return false;
+            }
+        }
+        m_cur = cur;
+        return true;
+    }
+
+    // reads an object key and its ':' into m_key
+    bool parseKey()
+    {
+        skipWhitespace();
+        if (m_cur == m_end || *m_cur != '"')
+        {
+            return fail("expected object key");
+        }
+        return parseString(m_key) && expect(':');
+    }
+
+    bool parseString(std::string &out)
+    {
+        out.clear();
+        m_cur++;
+        while (m_cur != m_end && *m_cur != '"')
+        {
+            // copy the run up to the next quote or escape in one go
+            const char *run = m_cur;
+            while (m_cur != m_end && *m_cur != '"' && *m_cur != '\\')
+            {
+                m_cur++;
+            }
+            out.append(run, m_cur);
+            if (m_cur == m_end || *m_cur == '"')
+            {
+                break;
+            }
+
+            m_cur++;
+            if (m_cur == m_end)
+            {
+                break;
+            }
+            switch (*m_cur)
+            {
+            case 'n':
+                out.push_back('\n');
+                break;
+            case 't':
+                out.push_back('\t');
+                break;
+            case 'r':
+                out.push_back('\r');
+                break;
+            case 'b':
+                out.push_back('\b');
+                break;
+            case 'f':
+                out.push_back('\f');
+                break;
+            case 'u':
+                // none of the keys or values we read use escaped code
+                // points, keep a placeholder so the length stays sane
+                if (m_end - m_cur < 5)
+                {
+                    return fail("truncated \\u escape");
+                }
+                m_cur += 4;
+                out.push_back('?');
+                break;
+            default:
+                out.push_back(*m_cur);
+                break;
+            }
+            m_cur++;
+        }
+
+        if (m_cur == m_end)
+        {
+            return fail("unterminated string");
+        }
+        m_cur++;
+        return true;
+    }
+
+    bool parseNumber(double &value)
+    {
+        skipWhitespace();
+        const char *start = m_cur;
+        if (m_cur != m_end && *m_cur == '-')
+        {
+            m_cur++;
+        }
+        if (m_cur == m_end || !std::isdigit((unsigned char)*m_cur))
+        {
+            m_cur = start;
+            return fail("expected a number");
+        }
+
+        // JSON number: -?digits(.digits)?([eE][+-]?digits)?
+        skipDigits();
+        if (m_cur != m_end && *m_cur == '.')
+        {
+            m_cur++;
+            skipDigits();
+        }
+        if (m_cur != m_end && (*m_cur == 'e' || *m_cur == 'E'))
+        {
+            m_cur++;
+            if (m_cur != m_end && (*m_cur == '+' || *m_cur == '-'))
+            {
+                m_cur++;
+            }
+            skipDigits();
+        }
+
+        // strtod needs a terminated string and the buffer may not be one;
+        // std::from_chars for double is missing from emscripten's libc++
+        const size_t length = m_cur - start;
+        char buffer[const_maxNumberLength + 1];
+        std::string longNumber;
+        char *number = buffer;
+        if (length > const_maxNumberLength)
+        {
+            longNumber.assign(start, length);
+            number = longNumber.data();
+        }
+        else
+        {
+            memcpy(buffer, start, length);
+            buffer[length] = '\0';
+        }
+
+        char *end = nullptr;
+        errno = 0;
+        value = strtod(number, &end);
+        if (end != number + length || (errno == ERANGE && std::isinf(value)))
+        {
+            m_cur = start;
+            return fail("invalid number");
+        }
+        return true;
+    }
+
+    void skipDigits()
+    {
+        while (m_cur != m_end && std::isdigit((unsigned char)*m_cur))
+        {
+            m_cur++;
+        }
+    }
+
+    bool skipValue(int depth)
+    {
+        // scenarios are only a few levels deep, anything beyond this is garbage
+        if (depth > 64)
+        {
+            return fail("nesting too deep");
+        }
+
+        skipWhitespace();
+        if (m_cur == m_end)
+        {
+            return fail("unexpected end of input");
+        }
+
+        switch (*m_cur)
+        {
+        case '{':
+            m_cur++;
+            if (peekIs('}'))
+            {
+                m_cur++;
+                return true;
+            }
+            do
+            {
+                if (!parseKey() || !skipValue(depth + 1))
+                {
+                    return false;
+                }
+            } while (next('}'));
+            return m_error.empty() && expect('}');
+        case '[':
+            m_cur++;
+            if (peekIs(']'))
+            {
+                m_cur++;
+                return true;
+            }
+            do
+            {
+                if (!skipValue(depth + 1))
+                {
+                    return false;
+                }
+            } while (next(']'));
+            return m_error.empty() && expect(']');
+        case '"':
+            return parseString(m_skipped);
+        case 't':
+            return consume("true") || fail("invalid literal");
+        case 'f':
+            return consume("false") || fail("invalid literal");
+        case 'n':
+            return consume("null") || fail("invalid literal");
+        default:
+            double number;
+            return parseNumber(number);
+        }
+    }
+
+    bool parseInitData(bool isAi, std::vector<BattalionSpawnInfo> &out)
+    {
+        bool seenBattalions = false;
+        if (!expect('{'))
+        {
+            return false;
+        }
+        if (!peekIs('}'))
+        {
+            do
+            {
+                if (!parseKey())
+                {
+                    return false;
+                }
+                if (m_key != "battalions")
+                {
+                    if (!skipValue(1))
+                    {
+                        return false;
+                    }
+                    continue;
+                }
+
+                seenBattalions = true;
+                if (!expect('['))
+                {
+                    return fail("battalions must be an array");
+                }
+                if (peekIs(']'))
+                {
+                    m_cur++;
+                    continue;
+                }
+                do
+                {
+                    BattalionSpawnInfo info;
+                    if (!parseBattalion(isAi, info))
+                    {
+                        return false;
+                    }
+                    out.push_back(std::move(info));
+                } while (next(']'));
+                if (!m_error.empty() || !expect(']'))
+                {
+                    return false;
+                }
+            } while (next('}'));
+        }
+        if (!m_error.empty() || !expect('}'))
+        {
+            return false;
+        }
+        return seenBattalions || fail("battalions is missing");
+    }
+
+    bool parseBattalion(bool isAi, BattalionSpawnInfo &info)
+    {
+        bool seenType = false;
+        bool seenTroops = false;
+        bool isWarrior = false;
+        if (!expect('{'))
+        {
+            return false;
+        }
+        if (!peekIs('}'))
+        {
+            do
+            {
+                if (!parseKey())
+                {
+                    return false;
+                }
+
+                if (m_key == "type")
+                {
+                    skipWhitespace();
+                    if (m_cur == m_end || *m_cur != '"' || !parseString(m_skipped))
+                    {
+                        return m_error.empty() ? fail("battalion 'type' must be a string") : false;
+                    }
+                    std::transform(m_skipped.begin(), m_skipped.end(), m_skipped.begin(), [](unsigned char c)
+                                   { return std::tolower(c); });
+                    isWarrior = (m_skipped == "warrior");
+                    seenType = true;
+                }
+                else if (m_key == "troops")
+                {
+                    if (!parseTroops(info.troops))
+                    {
+                        return false;
+                    }
+                    seenTroops = true;
+                }
+                else if (!skipValue(3))
+                {
+                    return false;
+                }
+            } while (next('}'));
+        }
+        if (!m_error.empty() || !expect('}'))
+        {
+            return false;
+        }
+        if (!seenType || !seenTroops)
+        {
+            return fail("battalion needs a string 'type' and a 'troops' array");
+        }
+
+        // matches parsePackedGameState, the ai side has its type ids swapped
+        info.btype = isWarrior ? (isAi ? 1 : 0) : (isAi ? 0 : 1);
+        return true;
+    }
+
+    bool parseTroops(std::vector<Vector2> &troops)
+    {
+        if (!expect('['))
+        {
+            return fail("'troops' must be an array");
+        }
+        // without troops the battalion would have no center
+        if (peekIs(']'))
+        {
+            return fail("a battalion needs at least one troop");
+        }
+        do
+        {
+            // [x, y], anything after y is ignored
+            double x, y;
+            if (!expect('[') || !parseNumber(x) || !expect(',') || !parseNumber(y))
+            {
+                return fail("troop positions must be [x, y] number pairs");
+            }
+            while (next(']'))
+            {
+                if (!skipValue(5))
+                {
+                    return false;
+                }
+            }
+            if (!m_error.empty() || !expect(']'))
+            {
+                return false;
+            }
+            troops.push_back({(float)x, (float)y});
+        } while (next(']'));
+        return m_error.empty() && expect(']');
+    }
+
+private:
+    const char *m_cur;
+    const char *m_begin;
+    const char *m_end;
+    std::string m_error;
+    // buffers reused for every key and string value
+    std::string m_key;
+    std::string m_skipped;
+};
+
+} // namespace
+
+bool parseInitialGameStateJSON(const char *data, size_t size, InitialGameState &state, std::string &error)
+{
+    state = InitialGameState();
+    ScenarioReader reader(data, size);
+    if (!reader.parse(state))
+    {
+        error = reader.error();
+        state = InitialGameState();
+        return false;
+    }
+    return true;
+}
+
+bool parseInitialGameStateJSON(const std::string &text, InitialGameState &state, std::string &error)
+{
+    return parseInitialGameStateJSON(text.data(), text.size(), state, error);
+}
+
+bool loadInitialGameStateFile(const char *path, InitialGameState &state, std::string &error)
+{
+#ifdef __unix__
+    // the file is parsed straight from the page cache
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        close(fd);
+        error = std::string("cannot stat ") + path;
+        return false;
+    }
+    if (info.st_size == 0)
+    {
+        // nothing to map, the parser reports the empty input
+        close(fd);
+        return parseInitialGameStateJSON("", 0, state, error);
+    }
+
+    void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        error = std::string("cannot map ") + path;
+        return false;
+    }
+
+    const bool ok = parseInitialGameStateJSON((const char *)data, info.st_size, state, error);
+    munmap(data, info.st_size);
+    return ok;
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return parseInitialGameStateJSON(buffer.str(), state, error);
+#endif
+}
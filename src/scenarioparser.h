@@ -0,0 +1,17 @@
+
+#pragma once
+
+#include "src/battalionspawninfo.h"
+#include <string>
+
+// Native counterpart of `parsePackedGameState` (src/gameparser.h) that reads
+// the same `/api/init` JSON directly, in a single pass over the text.
+
+/// @brief parses the JSON text of an initial game state
+/// keys outside the schema are skipped, the battalions get their ids attackers first
+/// @return false if the text is not a valid scenario, `error` says why and where (line:column)
+bool parseInitialGameStateJSON(const char *data, size_t size, InitialGameState &state, std::string &error);
+bool parseInitialGameStateJSON(const std::string &text, InitialGameState &state, std::string &error);
+
+/// @brief maps the file at path (reads it where mmap is not available) and parses it with parseInitialGameStateJSON
+bool loadInitialGameStateFile(const char *path, InitialGameState &state, std::string &error);
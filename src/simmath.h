@@ -0,0 +1,86 @@
+
+#pragma once
+
+// The simulation only needs raylib's vector types and a handful of raymath
+// helpers. The game build takes them straight from raylib, the headless build
+// (compiled with HEADLESS) gets a raylib-free copy with identical arithmetic so
+// both builds produce the same battles.
+
+#ifndef HEADLESS
+
+#include <raylib/raylib.h>
+#include <raylib/raymath.h>
+
+#else
+
+#include <cmath>
+
+#define PI 3.14159265358979323846f
+#define DEG2RAD (PI / 180.0f)
+#define RAD2DEG (180.0f / PI)
+
+struct Vector2
+{
+    float x;
+    float y;
+};
+
+struct Rectangle
+{
+    float x;
+    float y;
+    float width;
+    float height;
+};
+
+inline Vector2 Vector2Add(Vector2 v1, Vector2 v2)
+{
+    return Vector2{v1.x + v2.x, v1.y + v2.y};
+}
+
+inline Vector2 Vector2Subtract(Vector2 v1, Vector2 v2)
+{
+    return Vector2{v1.x - v2.x, v1.y - v2.y};
+}
+
+inline Vector2 Vector2Scale(Vector2 v, float scale)
+{
+    return Vector2{v.x * scale, v.y * scale};
+}
+
+inline float Vector2Length(Vector2 v)
+{
+    return sqrtf((v.x * v.x) + (v.y * v.y));
+}
+
+inline Vector2 Vector2Normalize(Vector2 v)
+{
+    Vector2 result = {0.0f, 0.0f};
+    const float length = Vector2Length(v);
+    if (length > 0)
+    {
+        const float ilength = 1.0f / length;
+        result.x = v.x * ilength;
+        result.y = v.y * ilength;
+    }
+    return result;
+}
+
+inline float Vector2DistanceSqr(Vector2 v1, Vector2 v2)
+{
+    return ((v1.x - v2.x) * (v1.x - v2.x) + (v1.y - v2.y) * (v1.y - v2.y));
+}
+
+inline float Vector2Distance(Vector2 v1, Vector2 v2)
+{
+    return sqrtf(Vector2DistanceSqr(v1, v2));
+}
+
+inline Vector2 Vector2Rotate(Vector2 v, float angle)
+{
+    const float cosres = cosf(angle);
+    const float sinres = sinf(angle);
+    return Vector2{v.x * cosres - v.y * sinres, v.x * sinres + v.y * cosres};
+}
+
+#endif
@@ -0,0 +1,271 @@
+
+#include "src/battalionhandler.h"
+#include "src/bytestream.h"
+#include <cstring>
+
+// Snapshots are meant to be restored by the same build, the fixed size
+// parts are copied as they are laid out in memory.
+
+namespace
+{
+
+const char const_snapshotMagic[4] = {'B', 'S', 'S', 'N'};
+const uint32_t const_snapshotVersion = 4;
+
+struct HandlerState
+{
+    Vector2 worldBounds;
+    uint64_t seed;
+    int32_t tick;
+    float castleHealth;
+    float wallHealth;
+    int32_t wallsUp;
+    // size of m_centerBattalions, the next key to hand out
+    int32_t keyCount;
+    int32_t selectedKey;
+    int32_t attackerCount;
+    int32_t defenderCount;
+};
+
+struct BattalionState
+{
+    int32_t key;
+    int32_t id;
+    int32_t group;
+    int32_t btype;
+    // key of the target battalion, -1 if none
+    int32_t target;
+    // index of the targeted wall segment, -1 if none
+    int32_t targetWall;
+    int32_t initialTroopCount;
+    int32_t troopCount;
+    Vector2 center;
+    Vector2 startCenter;
+    Vector2 prevCenter;
+    float rotation;
+    float cooldown;
+    int32_t centerDrift;
+    uint8_t wallsUp;
+    uint8_t movedToCastle;
+    // whether the battalion saw the walls and the castle in its last update
+    uint8_t seesWalls;
+    uint8_t seesCastle;
+};
+
+template <typename T>
+void writeState(ByteWriter &writer, const T &state)
+{
+    writer.writeBytes(&state, sizeof(T));
+}
+
+} // namespace
+
+SimulationSnapshot BattalionHandler::saveSnapshot() const
+{
+    ByteWriter writer;
+    writer.writeBytes(const_snapshotMagic, sizeof(const_snapshotMagic));
+    writer.writeU32(const_snapshotVersion);
+
+    const Battalion *selected = m_battalions.get(m_selectedBattalion);
+    HandlerState handler;
+    memset(&handler, 0, sizeof(handler));
+    handler.worldBounds = m_worldBounds;
+    handler.seed = m_seed;
+    handler.tick = m_tick;
+    handler.castleHealth = getCastle().health;
+    handler.wallHealth = m_wallHealth;
+    handler.wallsUp = areWallsUp();
+    handler.keyCount = m_centerBattalions.size();
+    handler.selectedKey = selected ? selected->m_key : -1;
+    handler.attackerCount = m_attackerBattalions.size();
+    handler.defenderCount = m_defenderBattalions.size();
+    writeState(writer, handler);
+
+    auto saveBattalions = [&](const std::vector<Handle> &vec)
+    {
+        for (Handle handle : vec)
+        {
+            const Battalion *b = m_battalions.get(handle);
+            const Battalion *target = b->getTarget();
+            // the segments are only ever removed all at once, so they keep their index
+            int targetWall = -1;
+            for (int i = 0; i < m_defenderWalls.size(); i++)
+            {
+                targetWall = (m_defenderWalls.getHandle(i) == b->m_target_wall) ? i : targetWall;
+            }
+
+            BattalionState state;
+            memset(&state, 0, sizeof(state));
+            state.key = b->m_key;
+            state.id = b->m_id;
+            state.group = (int32_t)b->m_group;
+            state.btype = (int32_t)b->m_btype;
+            state.target = target ? target->m_key : -1;
+            state.targetWall = targetWall;
+            state.initialTroopCount = b->m_initialTroopCount;
+            state.troopCount = b->getTroopCount();
+            state.center = b->m_center;
+            state.startCenter = b->m_startCenter;
+            state.prevCenter = b->m_prevCenter;
+            state.rotation = b->m_rotation;
+            state.cooldown = b->m_cooldown;
+            state.centerDrift = b->m_centerDrift;
+            state.wallsUp = b->m_wallsUp;
+            state.movedToCastle = b->movedToCastle;
+            state.seesWalls = b->m_walls && !b->m_walls->empty();
+            state.seesCastle = b->getTargetCastle() != nullptr;
+            writeState(writer, state);
+            b->m_troops.save(writer);
+        }
+    };
+    saveBattalions(m_attackerBattalions);
+    saveBattalions(m_defenderBattalions);
+
+    SimulationSnapshot snapshot;
+    snapshot.data = std::make_shared<const std::vector<uint8_t>>(writer.getData());
+    return snapshot;
+}
+
+void BattalionHandler::resetBattle()
+{
+    m_battalions.clear();
+    m_attackerBattalions.clear();
+    m_defenderBattalions.clear();
+    m_centerBattalions.clear();
+    m_gridBattalions.clear();
+    m_selectedBattalion = const_nullHandle;
+    m_attackerCenters.clear();
+    m_defenderCenters.clear();
+    m_tick = 0;
+
+    initCastle();
+    initWalls();
+}
+
+bool BattalionHandler::restoreSnapshot(const SimulationSnapshot &snapshot, std::string &error)
+{
+    resetBattle();
+    if (snapshot.empty())
+    {
+        error = "empty snapshot";
+        return false;
+    }
+
+    ByteReader reader(snapshot.data->data(), snapshot.data->size());
+    char magic[4];
+    if (!reader.readBytes(magic, sizeof(magic)) || memcmp(magic, const_snapshotMagic, sizeof(magic)) != 0 ||
+        reader.readU32() != const_snapshotVersion)
+    {
+        error = "not a snapshot";
+        return false;
+    }
+
+    HandlerState handler;
+    if (!reader.readBytes(&handler, sizeof(handler)) || handler.keyCount < 0 || handler.attackerCount < 0 ||
+        handler.defenderCount < 0 || handler.attackerCount + handler.defenderCount > handler.keyCount)
+    {
+        error = "corrupt snapshot";
+        return false;
+    }
+
+    // the castle sits in a corner of the world
+    m_worldBounds = handler.worldBounds;
+    initCastle();
+    getCastle().health = handler.castleHealth;
+    m_wallHealth = handler.wallHealth;
+    if (!handler.wallsUp)
+    {
+        m_defenderWalls.clear();
+    }
+    m_seed = handler.seed;
+    m_tick = handler.tick;
+    m_centerBattalions.assign(handler.keyCount, const_nullHandle);
+
+    // targets can point either way, they are linked once every battalion exists
+    std::vector<BattalionState> states(handler.attackerCount + handler.defenderCount);
+    for (int i = 0; i < (int)states.size(); i++)
+    {
+        BattalionState &state = states[i];
+        if (!reader.readBytes(&state, sizeof(state)) || state.key < 0 || state.key >= handler.keyCount ||
+            m_centerBattalions[state.key] != const_nullHandle || state.troopCount <= 0 || state.group != (i >= handler.attackerCount) ||
+            state.btype < 0 || state.btype > 1 || state.initialTroopCount < state.troopCount)
+        {
+            resetBattle();
+            error = "corrupt snapshot";
+            return false;
+        }
+
+        const Handle handle = m_battalions.insert(Battalion());
+        Battalion *b = m_battalions.get(handle);
+        if (!b->m_troops.load(reader, state.troopCount))
+        {
+            resetBattle();
+            error = "truncated or corrupt snapshot";
+            return false;
+        }
+
+        b->m_battalions = &m_battalions;
+        b->m_handle = handle;
+        b->m_key = state.key;
+        b->m_id = state.id;
+        b->m_group = (Group)state.group;
+        b->m_btype = (BType)state.btype;
+        b->m_initialTroopCount = state.initialTroopCount;
+        b->m_center = state.center;
+        b->m_startCenter = state.startCenter;
+        b->m_prevCenter = state.prevCenter;
+        b->m_rotation = state.rotation;
+        b->m_cooldown = state.cooldown;
+        b->m_centerDrift = state.centerDrift;
+        b->m_wallsUp = state.wallsUp;
+        b->movedToCastle = state.movedToCastle;
+        if (state.seesWalls)
+        {
+            b->m_walls = &m_defenderWalls;
+        }
+        if (state.seesCastle)
+        {
+            b->m_castles = &m_castles;
+            b->m_target_castle = m_defenderCastle;
+        }
+        if (state.targetWall >= 0 && state.targetWall < m_defenderWalls.size())
+        {
+            b->m_target_wall = m_defenderWalls.getHandle(state.targetWall);
+        }
+
+        m_centerBattalions[state.key] = handle;
+        (b->m_group == Group::Attacker ? m_attackerBattalions : m_defenderBattalions).push_back(handle);
+        (b->m_group == Group::Attacker ? m_attackerCenters : m_defenderCenters).insert(b->m_key, b->m_center);
+    }
+
+    for (const BattalionState &state : states)
+    {
+        if (state.target >= 0 && state.target < handler.keyCount)
+        {
+            m_battalions.get(m_centerBattalions[state.key])->m_target = m_centerBattalions[state.target];
+        }
+    }
+    if (handler.selectedKey >= 0 && handler.selectedKey < handler.keyCount)
+    {
+        m_selectedBattalion = m_centerBattalions[handler.selectedKey];
+    }
+
+    m_attackerCenters.update();
+    m_defenderCenters.update();
+    return true;
+}
+
+std::unique_ptr<BattalionHandler> BattalionHandler::fork() const
+{
+    std::unique_ptr<BattalionHandler> copy = std::make_unique<BattalionHandler>(m_worldBounds);
+    copy->m_interpolated = m_interpolated;
+
+    // a snapshot of a live battle always restores, failing means save and
+    // restore disagree on the format; hand back nothing rather than an empty battle
+    std::string error;
+    if (!copy->restoreSnapshot(saveSnapshot(), error))
+    {
+        return nullptr;
+    }
+    return copy;
+}
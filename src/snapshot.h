@@ -0,0 +1,19 @@
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/// @brief the complete state of a battle between two ticks, in one flat buffer
+/// Copies share the buffer, it is never modified once taken, so one snapshot
+/// can seed any number of continuations. Random numbers only depend on the
+/// seed, the tick and the battalion keys, all of which are part of it, so a
+/// restored battle plays out exactly like the original would have.
+struct SimulationSnapshot
+{
+    std::shared_ptr<const std::vector<uint8_t>> data;
+
+    bool empty() const { return !data || data->empty(); }
+    size_t size() const { return data ? data->size() : 0; }
+};
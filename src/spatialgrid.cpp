@@ -0,0 +1,264 @@
+
+#include "src/spatialgrid.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+
+// keeps the cell tables small when a few troops are very far apart
+const int const_maxCellsPerAxis = 1024;
+// points per cell the cell size aims for
+const float const_pointsPerCell = 4.0f;
+
+uint32_t spreadBits(uint32_t v)
+{
+    v &= 0x0000ffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+uint32_t compactBits(uint32_t v)
+{
+    v &= 0x55555555;
+    v = (v | (v >> 1)) & 0x33333333;
+    v = (v | (v >> 2)) & 0x0f0f0f0f;
+    v = (v | (v >> 4)) & 0x00ff00ff;
+    v = (v | (v >> 8)) & 0x0000ffff;
+    return v;
+}
+
+uint32_t mortonCode(int x, int y)
+{
+    return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+bool isCloser(const GridHit &a, const GridHit &b)
+{
+    if (a.distSqr != b.distSqr)
+    {
+        return a.distSqr < b.distSqr;
+    }
+    if (a.owner != b.owner)
+    {
+        return a.owner < b.owner;
+    }
+    return a.troop < b.troop;
+}
+
+} // namespace
+
+void SpatialGrid::clear(float maxCellSize)
+{
+    m_maxCellSize = maxCellSize;
+    m_points.clear();
+}
+
+void SpatialGrid::add(int owner, int troop, float x, float y)
+{
+    m_points.push_back(Point{x, y, owner, troop});
+}
+
+void SpatialGrid::build()
+{
+    const int count = m_points.size();
+    if (count == 0)
+    {
+        m_cellsX = 0;
+        m_cellsY = 0;
+        m_cellStart.clear();
+        m_cellCount.clear();
+        return;
+    }
+
+    Vector2 min = {m_points[0].x, m_points[0].y};
+    Vector2 max = min;
+    for (const Point &p : m_points)
+    {
+        min.x = std::min(min.x, p.x);
+        min.y = std::min(min.y, p.y);
+        max.x = std::max(max.x, p.x);
+        max.y = std::max(max.y, p.y);
+    }
+
+    // dense troops get smaller cells, so that the first rings around a
+    // query already hold the closest point but not many more
+    const float area = (max.x - min.x) * (max.y - min.y);
+    m_cellSize = std::clamp(sqrtf(area * const_pointsPerCell / count), m_maxCellSize * 1e-3f, m_maxCellSize);
+
+    const float extent = std::max(max.x - min.x, max.y - min.y);
+    if (extent / m_cellSize >= const_maxCellsPerAxis - 1)
+    {
+        m_cellSize = extent / (const_maxCellsPerAxis - 2);
+    }
+
+    m_origin = min;
+    m_cellsX = std::min((int)((max.x - min.x) / m_cellSize) + 1, const_maxCellsPerAxis);
+    m_cellsY = std::min((int)((max.y - min.y) / m_cellSize) + 1, const_maxCellsPerAxis);
+
+    // every point is inside the bounds here, so plain truncation gives the
+    // same cell as cellX/cellY without the floor and clamp
+    m_invCellSize = 1.0f / m_cellSize;
+    uint32_t maxKey = 0;
+    m_keys.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        const int cx = std::min((int)((m_points[i].x - min.x) * m_invCellSize), m_cellsX - 1);
+        const int cy = std::min((int)((m_points[i].y - min.y) * m_invCellSize), m_cellsY - 1);
+        m_keys[i] = mortonCode(cx, cy);
+        maxKey = std::max(maxKey, m_keys[i]);
+    }
+
+    // stable LSD radix sort on the morton key, the points of a cell keep the
+    // owner/troop order they were added in
+    m_scratch.resize(count);
+    m_scratchKeys.resize(count);
+    for (int shift = 0; shift < 32 && (maxKey >> shift) != 0; shift += 8)
+    {
+        int offsets[257] = {0};
+        for (int i = 0; i < count; i++)
+        {
+            offsets[((m_keys[i] >> shift) & 0xff) + 1]++;
+        }
+        for (int i = 0; i < 256; i++)
+        {
+            offsets[i + 1] += offsets[i];
+        }
+        for (int i = 0; i < count; i++)
+        {
+            const int dst = offsets[(m_keys[i] >> shift) & 0xff]++;
+            m_scratch[dst] = m_points[i];
+            m_scratchKeys[dst] = m_keys[i];
+        }
+        m_points.swap(m_scratch);
+        m_keys.swap(m_scratchKeys);
+    }
+
+    m_cellStart.assign(m_cellsX * m_cellsY, 0);
+    m_cellCount.assign(m_cellsX * m_cellsY, 0);
+    for (int i = 0; i < count;)
+    {
+        const uint32_t key = m_keys[i];
+        const int cell = compactBits(key) + compactBits(key >> 1) * m_cellsX;
+        m_cellStart[cell] = i;
+        for (; i < count && m_keys[i] == key; i++)
+        {
+            m_cellCount[cell]++;
+        }
+    }
+}
+
+bool SpatialGrid::getOwnerRun(int cell, int owner, const Point *&begin, const Point *&end) const
+{
+    if (m_cellCount[cell] == 0)
+    {
+        return false;
+    }
+
+    begin = m_points.data() + m_cellStart[cell];
+    end = begin + m_cellCount[cell];
+    // most cells hold a single battalion, only search the mixed ones
+    if (owner >= 0 && (begin->owner != owner || (end - 1)->owner != owner))
+    {
+        if (begin->owner > owner || (end - 1)->owner < owner)
+        {
+            return false;
+        }
+        begin = std::lower_bound(begin, end, owner, [](const Point &p, int o)
+                                 { return p.owner < o; });
+        end = std::upper_bound(begin, end, owner, [](int o, const Point &p)
+                               { return o < p.owner; });
+    }
+    return begin != end;
+}
+
+bool SpatialGrid::nearest(Vector2 position, float radius, int owner, GridHit &hit) const
+{
+    if (m_points.empty())
+    {
+        return false;
+    }
+
+    // The cells are searched ring by ring around the cell of position and the
+    // search stops once the next ring is farther away than the closest point
+    // found so far, or than radius. Ties are settled by isCloser, so the hit
+    // does not depend on the order the cells are visited in.
+    const float radiusSqr = radius * radius;
+    const float fx = (position.x - m_origin.x) * m_invCellSize;
+    const float fy = (position.y - m_origin.y) * m_invCellSize;
+    const int cx = (int)std::clamp(floorf(fx), (float)-const_maxCellsPerAxis, (float)const_maxCellsPerAxis);
+    const int cy = (int)std::clamp(floorf(fy), (float)-const_maxCellsPerAxis, (float)const_maxCellsPerAxis);
+    // keeps rounding in the ring distances from ending the search a ring early
+    const float margin = m_cellSize * 1e-3f;
+    bool found = false;
+
+    auto searchCell = [&](int x, int y)
+    {
+        const Point *begin;
+        const Point *end;
+        if (!getOwnerRun(x + y * m_cellsX, owner, begin, end))
+        {
+            return;
+        }
+        for (const Point *p = begin; p != end; p++)
+        {
+            const float dx = p->x - position.x;
+            const float dy = p->y - position.y;
+            const GridHit candidate = {p->owner, p->troop, dx * dx + dy * dy};
+            if (candidate.distSqr < radiusSqr && (!found || isCloser(candidate, hit)))
+            {
+                hit = candidate;
+                found = true;
+            }
+        }
+    };
+
+    for (int ring = 0;; ring++)
+    {
+        const int x0 = cx - ring;
+        const int x1 = cx + ring;
+        const int y0 = cy - ring;
+        const int y1 = cy + ring;
+
+        if (ring > 0)
+        {
+            // every point of this ring lies outside the square of the rings before it
+            const float edge = std::min(std::min(fx - (x0 + 1), x1 - fx), std::min(fy - (y0 + 1), y1 - fy)) * m_cellSize - margin;
+            if (edge > 0.0f && edge * edge >= (found ? hit.distSqr : radiusSqr))
+            {
+                break;
+            }
+        }
+
+        for (int y = std::max(y0, 0); y <= std::min(y1, m_cellsY - 1); y++)
+        {
+            if (y == y0 || y == y1)
+            {
+                for (int x = std::max(x0, 0); x <= std::min(x1, m_cellsX - 1); x++)
+                {
+                    searchCell(x, y);
+                }
+                continue;
+            }
+            if (x0 >= 0 && x0 < m_cellsX)
+            {
+                searchCell(x0, y);
+            }
+            if (x1 >= 0 && x1 < m_cellsX)
+            {
+                searchCell(x1, y);
+            }
+        }
+
+        if (x0 <= 0 && y0 <= 0 && x1 >= m_cellsX - 1 && y1 >= m_cellsY - 1)
+        {
+            break;
+        }
+    }
+
+    return found;
+}
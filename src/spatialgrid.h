@@ -0,0 +1,67 @@
+
+#pragma once
+
+#include "src/simmath.h"
+#include <cstdint>
+#include <vector>
+
+/// @brief a troop found by a SpatialGrid query
+struct GridHit
+{
+    int owner;
+    int troop;
+    float distSqr;
+};
+
+/// @brief uniform grid over the troops of every battalion, rebuilt once per tick
+/// Points are added per owner (battalion) in ascending owner/troop order.
+/// `build` sorts them by the Morton code of their cell, so neighbouring cells
+/// are close in memory, while inside a cell they stay grouped by owner and a
+/// query for a single owner only touches that owner's run.
+class SpatialGrid
+{
+
+public:
+    /// @brief drops every point and sets the largest cell size for the next build
+    /// the cells get smaller where the points are dense
+    void clear(float maxCellSize);
+    /// @brief adds a point, owners and troops must come in ascending order
+    void add(int owner, int troop, float x, float y);
+    /// @brief sorts the points added since `clear` into cells
+    void build();
+
+    bool empty() const { return m_points.empty(); }
+    float getCellSize() const { return m_cellSize; }
+
+    /// @brief finds the closest point of owner (any owner if -1) closer than radius
+    /// ties are broken by the lower troop index
+    bool nearest(Vector2 position, float radius, int owner, GridHit &hit) const;
+
+private:
+    struct Point
+    {
+        float x, y;
+        int owner;
+        int troop;
+    };
+
+    /// @brief sets [begin, end) to the points of owner (any owner if -1) in cell, false if there are none
+    bool getOwnerRun(int cell, int owner, const Point *&begin, const Point *&end) const;
+
+private:
+    float m_maxCellSize = 1.0f;
+    float m_cellSize = 1.0f;
+    float m_invCellSize = 1.0f;
+    Vector2 m_origin = {0.0f, 0.0f};
+    int m_cellsX = 0;
+    int m_cellsY = 0;
+
+    std::vector<Point> m_points;
+    std::vector<Point> m_scratch;
+    std::vector<uint32_t> m_keys;
+    std::vector<uint32_t> m_scratchKeys;
+    // first point and number of points of every cell, indexed row major
+    // (the points themselves are stored in morton order)
+    std::vector<int> m_cellStart;
+    std::vector<int> m_cellCount;
+};
@@ -0,0 +1,70 @@
+
+#include "src/spritebatch.h"
+#include <algorithm>
+#include <raylib/rlgl.h>
+
+// quads handed to rlgl at once, well below the size of its default render
+// batch so that a run never has to be split
+const int const_quadsPerRun = 1024;
+
+SpriteUV GetSpriteUV(Texture2D texture, Rectangle source, bool flipHorizontal)
+{
+    SpriteUV uv;
+    uv.u0 = source.x / texture.width;
+    uv.v0 = source.y / texture.height;
+    uv.u1 = (source.x + source.width) / texture.width;
+    uv.v1 = (source.y + source.height) / texture.height;
+    if (flipHorizontal)
+    {
+        std::swap(uv.u0, uv.u1);
+    }
+    return uv;
+}
+
+void SpriteBatch::clear()
+{
+    m_positions.clear();
+    m_texcoords.clear();
+}
+
+void SpriteBatch::add(Vector2 position, Vector2 size, const SpriteUV &uv)
+{
+    const float left = position.x - size.x / 2;
+    const float top = position.y - size.y / 2;
+    const float right = left + size.x;
+    const float bottom = top + size.y;
+
+    m_positions.push_back(Vector2{left, top});
+    m_positions.push_back(Vector2{left, bottom});
+    m_positions.push_back(Vector2{right, bottom});
+    m_positions.push_back(Vector2{right, top});
+
+    m_texcoords.push_back(Vector2{uv.u0, uv.v0});
+    m_texcoords.push_back(Vector2{uv.u0, uv.v1});
+    m_texcoords.push_back(Vector2{uv.u1, uv.v1});
+    m_texcoords.push_back(Vector2{uv.u1, uv.v0});
+}
+
+void SpriteBatch::draw(Texture2D texture) const
+{
+    const int count = m_positions.size();
+    for (int begin = 0; begin < count; begin += 4 * const_quadsPerRun)
+    {
+        const int end = std::min(begin + 4 * const_quadsPerRun, count);
+
+        // flushes the current render batch first if the run does not fit
+        rlCheckRenderBatchLimit(end - begin);
+
+        rlSetTexture(texture.id);
+        rlBegin(RL_QUADS);
+        rlColor4ub(255, 255, 255, 255);
+        rlNormal3f(0.0f, 0.0f, 1.0f);
+        for (int i = begin; i < end; i++)
+        {
+            rlTexCoord2f(m_texcoords[i].x, m_texcoords[i].y);
+            rlVertex2f(m_positions[i].x, m_positions[i].y);
+        }
+        rlEnd();
+        rlSetTexture(0);
+    }
+}
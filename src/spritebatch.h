@@ -0,0 +1,36 @@
+
+#pragma once
+
+#include <raylib/raylib.h>
+#include <vector>
+
+/// @brief texture coordinates [0.0 to 1.0] of a sprite, u1 < u0 flips it
+struct SpriteUV
+{
+    float u0, v0;
+    float u1, v1;
+};
+
+/// @brief returns the texture coordinates of the pixel rectangle source of texture
+SpriteUV GetSpriteUV(Texture2D texture, Rectangle source, bool flipHorizontal);
+
+/// @brief collects axis aligned sprites of one texture and draws them together
+/// Instead of one DrawTexturePro per sprite, the quads are written into flat
+/// vertex/UV arrays and handed to rlgl in large runs, so they end up in as few
+/// draw calls as its render batch allows.
+class SpriteBatch
+{
+
+public:
+    void clear();
+    /// @brief adds a sprite of size centered on position
+    void add(Vector2 position, Vector2 size, const SpriteUV &uv);
+    int size() const { return m_positions.size() / 4; }
+    /// @brief draws every sprite added since the last clear with texture
+    void draw(Texture2D texture) const;
+
+private:
+    // 4 corners per sprite, counter clockwise from the top left
+    std::vector<Vector2> m_positions;
+    std::vector<Vector2> m_texcoords;
+};
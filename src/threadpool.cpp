@@ -0,0 +1,118 @@
+
+#include "src/threadpool.h"
+#include <algorithm>
+
+#ifdef THREADPOOL_SERIAL
+
+ThreadPool::ThreadPool(int threadCount)
+    : m_threadCount(1)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)> &task)
+{
+    for (int i = 0; i < count; i++)
+    {
+        task(i);
+    }
+}
+
+#else
+
+ThreadPool::ThreadPool(int threadCount)
+{
+    if (threadCount <= 0)
+    {
+        threadCount = std::max((int)std::thread::hardware_concurrency(), 1);
+    }
+    m_threadCount = threadCount;
+
+    for (int i = 1; i < threadCount; i++)
+    {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+
+    for (std::thread &worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)> &task)
+{
+    // not worth waking anybody up
+    if (m_workers.empty() || count <= 1)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            task(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = &task;
+        m_count = count;
+        m_next = 0;
+        m_busyWorkers = m_workers.size();
+        m_generation++;
+    }
+    m_wake.notify_all();
+
+    runTasks();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]
+                { return m_busyWorkers == 0; });
+    m_task = nullptr;
+}
+
+void ThreadPool::runTasks()
+{
+    for (int i = m_next++; i < m_count; i = m_next++)
+    {
+        (*m_task)(i);
+    }
+}
+
+void ThreadPool::workerLoop()
+{
+    long seenGeneration = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&]
+                        { return m_stop || m_generation != seenGeneration; });
+            if (m_stop)
+            {
+                return;
+            }
+            seenGeneration = m_generation;
+        }
+
+        runTasks();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busyWorkers--;
+        }
+        m_done.notify_one();
+    }
+}
+
+#endif
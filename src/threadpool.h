@@ -0,0 +1,63 @@
+
+#pragma once
+
+#include <functional>
+
+// web builds without pthreads have no threads to start, the pool then runs
+// every task on the calling thread
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define THREADPOOL_SERIAL
+#endif
+
+#ifndef THREADPOOL_SERIAL
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#endif
+
+/// @brief fixed set of worker threads running parallel loops
+/// The calling thread takes part in every loop, so a pool of N threads
+/// starts N - 1 workers.
+class ThreadPool
+{
+
+public:
+    /// @brief starts the workers, 0 uses one thread per hardware thread
+    explicit ThreadPool(int threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int getThreadCount() const { return m_threadCount; }
+
+    /// @brief calls task(i) for every i in [0, count) and returns once all calls finished
+    /// indices are handed out one by one, in no particular order and to any thread
+    void parallelFor(int count, const std::function<void(int)> &task);
+
+private:
+#ifndef THREADPOOL_SERIAL
+    void workerLoop();
+    void runTasks();
+#endif
+
+private:
+    int m_threadCount;
+
+#ifndef THREADPOOL_SERIAL
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    bool m_stop = false;
+    // bumped for every loop so the workers can tell a new loop from a spurious wake up
+    long m_generation = 0;
+    int m_busyWorkers = 0;
+
+    const std::function<void(int)> *m_task = nullptr;
+    int m_count = 0;
+    std::atomic<int> m_next{0};
+#endif
+};
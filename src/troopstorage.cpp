@@ -0,0 +1,540 @@
+
+#include "src/troopstorage.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define TROOP_SIMD
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define TROOP_SIMD
+#endif
+
+// The kernels below process 4 troops per iteration and finish the remainder
+// with the scalar code. Each lane performs exactly the same float operations
+// as the scalar path, so results do not depend on which path ran.
+
+#ifdef TROOP_SIMD
+
+namespace
+{
+
+#if defined(__SSE2__)
+
+typedef __m128 f32x4;
+
+inline f32x4 load4(const float *p) { return _mm_loadu_ps(p); }
+inline void store4(float *p, f32x4 v) { _mm_storeu_ps(p, v); }
+inline f32x4 splat4(float v) { return _mm_set1_ps(v); }
+inline f32x4 add4(f32x4 a, f32x4 b) { return _mm_add_ps(a, b); }
+inline f32x4 sub4(f32x4 a, f32x4 b) { return _mm_sub_ps(a, b); }
+inline f32x4 mul4(f32x4 a, f32x4 b) { return _mm_mul_ps(a, b); }
+// one bit per lane
+inline int lessMask4(f32x4 a, f32x4 b) { return _mm_movemask_ps(_mm_cmplt_ps(a, b)); }
+inline int lessEqualMask4(f32x4 a, f32x4 b) { return _mm_movemask_ps(_mm_cmple_ps(a, b)); }
+
+#else
+
+typedef v128_t f32x4;
+
+inline f32x4 load4(const float *p) { return wasm_v128_load(p); }
+inline void store4(float *p, f32x4 v) { wasm_v128_store(p, v); }
+inline f32x4 splat4(float v) { return wasm_f32x4_splat(v); }
+inline f32x4 add4(f32x4 a, f32x4 b) { return wasm_f32x4_add(a, b); }
+inline f32x4 sub4(f32x4 a, f32x4 b) { return wasm_f32x4_sub(a, b); }
+inline f32x4 mul4(f32x4 a, f32x4 b) { return wasm_f32x4_mul(a, b); }
+// one bit per lane
+inline int lessMask4(f32x4 a, f32x4 b) { return wasm_i32x4_bitmask(wasm_f32x4_lt(a, b)); }
+inline int lessEqualMask4(f32x4 a, f32x4 b) { return wasm_i32x4_bitmask(wasm_f32x4_le(a, b)); }
+
+#endif
+
+} // namespace
+
+#endif
+
+void TroopStorage::reserve(int count)
+{
+    offsetX.reserve(count);
+    offsetY.reserve(count);
+    health.reserve(count);
+    engaged.reserve(count);
+    frameCounter.reserve(count);
+    currentFrame.reserve(count);
+    flipHorizontal.reserve(count);
+}
+
+void TroopStorage::push(Vector2 position, float troopHealth)
+{
+    const Vector2 offset = toFormation(position);
+    offsetX.push_back(offset.x);
+    offsetY.push_back(offset.y);
+    health.push_back(troopHealth);
+    engaged.push_back(0);
+    frameCounter.push_back(0.0f);
+    currentFrame.push_back(0);
+    flipHorizontal.push_back(false);
+
+    offsetMin = Vector2{std::min(offsetMin.x, offset.x), std::min(offsetMin.y, offset.y)};
+    offsetMax = Vector2{std::max(offsetMax.x, offset.x), std::max(offsetMax.y, offset.y)};
+    healthTotal += troopHealth;
+    worldCached = false;
+}
+
+void TroopStorage::setOrigin(Vector2 position)
+{
+    // the old origin seen from the new one, in the frame of the formation
+    const float dx = origin.x - position.x;
+    const float dy = origin.y - position.y;
+    const Vector2 shift = {dx * cosAngle + dy * sinAngle, dy * cosAngle - dx * sinAngle};
+
+    const int count = size();
+    for (int i = 0; i < count; i++)
+    {
+        offsetX[i] += shift.x;
+        offsetY[i] += shift.y;
+    }
+    offsetMin = Vector2Add(offsetMin, shift);
+    offsetMax = Vector2Add(offsetMax, shift);
+    origin = position;
+    worldCached = false;
+}
+
+void TroopStorage::setState(TroopState troopState)
+{
+    formationState = troopState;
+    if (troopState != TroopState::ATTACKING)
+    {
+        rejoin();
+    }
+}
+
+void TroopStorage::setFlip(bool flip)
+{
+    formationFlip = flip;
+}
+
+void TroopStorage::rejoin()
+{
+    if (engagedCount > 0)
+    {
+        std::fill(engaged.begin(), engaged.end(), 0);
+        engagedCount = 0;
+    }
+}
+
+void TroopStorage::countEngaged()
+{
+    engagedCount = 0;
+    for (uint8_t e : engaged)
+    {
+        engagedCount += e != 0;
+    }
+}
+
+void TroopStorage::savePositions()
+{
+    prevOrigin = origin;
+    prevCosAngle = cosAngle;
+    prevSinAngle = sinAngle;
+}
+
+namespace
+{
+
+// frames of the walk/attack animation, currentFrame stays below this
+const int const_animationFrames = 5;
+
+void advanceFrame(float deltaTime, float &frameCounter, uint8_t &currentFrame)
+{
+    frameCounter += deltaTime * 5; // Adjust speed of animation
+    if (frameCounter >= const_animationFrames)
+    {
+        frameCounter = 0;
+    }
+    currentFrame = static_cast<uint8_t>(frameCounter);
+}
+
+} // namespace
+
+void TroopStorage::animate(float deltaTime)
+{
+    if (formationState == TroopState::IDLE)
+    {
+        formationFrame = 0;
+        formationFrameCounter = 0;
+    }
+    else
+    {
+        advanceFrame(deltaTime, formationFrameCounter, formationFrame);
+    }
+
+    // troops out of formation are attacking, they never idle
+    const int count = engagedCount > 0 ? size() : 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (engaged[i])
+        {
+            advanceFrame(deltaTime, frameCounter[i], currentFrame[i]);
+        }
+    }
+}
+
+void TroopStorage::cacheWorldPositions()
+{
+    if (worldCached)
+    {
+        return;
+    }
+
+    // the same operations as toWorld, so cached and computed positions match
+    const int count = size();
+    worldX.resize(count);
+    worldY.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        worldX[i] = origin.x + (offsetX[i] * cosAngle - offsetY[i] * sinAngle);
+        worldY[i] = origin.y + (offsetX[i] * sinAngle + offsetY[i] * cosAngle);
+    }
+    worldCached = true;
+}
+
+void TroopStorage::translate(Vector2 delta)
+{
+    origin = Vector2Add(origin, delta);
+    worldCached = false;
+}
+
+void TroopStorage::rotate(Vector2 center, float angleStep)
+{
+    // same math as Vector2Rotate, only applied to the origin of the frame
+    const float cosres = cosf(angleStep);
+    const float sinres = sinf(angleStep);
+    const float rx = origin.x - center.x;
+    const float ry = origin.y - center.y;
+    origin = Vector2{center.x + (rx * cosres - ry * sinres), center.y + (rx * sinres + ry * cosres)};
+
+    angle += angleStep;
+    cosAngle = cosf(angle);
+    sinAngle = sinf(angle);
+    worldCached = false;
+}
+
+int TroopStorage::countInRange(Vector2 position, float range) const
+{
+    // distances are the same in the frame of the formation, so the query
+    // point is turned into it instead of every troop into the world
+    const Vector2 local = toFormation(position);
+    const float rangeSqr = range * range;
+    const int n = size();
+    const float *px = offsetX.data();
+    const float *py = offsetY.data();
+    int count = 0;
+    int i = 0;
+
+#ifdef TROOP_SIMD
+    const f32x4 posX = splat4(local.x);
+    const f32x4 posY = splat4(local.y);
+    const f32x4 limit = splat4(rangeSqr);
+    for (; i + 4 <= n; i += 4)
+    {
+        const f32x4 dx = sub4(load4(px + i), posX);
+        const f32x4 dy = sub4(load4(py + i), posY);
+        const f32x4 distSqr = add4(mul4(dx, dx), mul4(dy, dy));
+        count += __builtin_popcount(lessMask4(distSqr, limit));
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        const float dx = px[i] - local.x;
+        const float dy = py[i] - local.y;
+        count += (dx * dx + dy * dy) < rangeSqr;
+    }
+
+    return count;
+}
+
+int TroopStorage::countInRangeByBounds(Vector2 position, float range) const
+{
+    // The differences, squares and sums below are monotonic in the offsets,
+    // so a troop inside the bounds can be no closer than the nearest point of
+    // the bounds and no farther than the farthest corner, even after rounding;
+    // the answer is the same as countInRange would give.
+    const Vector2 local = toFormation(position);
+    const float rangeSqr = range * range;
+    const float farX = std::max(fabsf(offsetMin.x - local.x), fabsf(offsetMax.x - local.x));
+    const float farY = std::max(fabsf(offsetMin.y - local.y), fabsf(offsetMax.y - local.y));
+    if (farX * farX + farY * farY < rangeSqr)
+    {
+        return size();
+    }
+
+    const float nearX = std::max(std::max(offsetMin.x - local.x, local.x - offsetMax.x), 0.0f);
+    const float nearY = std::max(std::max(offsetMin.y - local.y, local.y - offsetMax.y), 0.0f);
+    if (nearX * nearX + nearY * nearY >= rangeSqr)
+    {
+        return 0;
+    }
+    return -1;
+}
+
+int TroopStorage::nearest(Vector2 position, float &distSqr) const
+{
+    // measured between world positions, the same way SpatialGrid::nearest
+    // does, so that both find the same troop
+    int closest = -1;
+    distSqr = std::numeric_limits<float>::max();
+
+    const int count = size();
+    for (int i = 0; i < count; i++)
+    {
+        const Vector2 p = this->position(i);
+        const float dx = p.x - position.x;
+        const float dy = p.y - position.y;
+        const float d = dx * dx + dy * dy;
+        if (d < distSqr)
+        {
+            distSqr = d;
+            closest = i;
+        }
+    }
+
+    return closest;
+}
+
+Rectangle TroopStorage::getBounds(bool previous) const
+{
+    const Vector2 frameOrigin = previous ? prevOrigin : origin;
+    if (empty())
+    {
+        return Rectangle{frameOrigin.x, frameOrigin.y, 0.0f, 0.0f};
+    }
+
+    const float cosres = previous ? prevCosAngle : cosAngle;
+    const float sinres = previous ? prevSinAngle : sinAngle;
+    Vector2 min = {INFINITY, INFINITY};
+    Vector2 max = {-INFINITY, -INFINITY};
+    for (const Vector2 corner : {offsetMin, offsetMax, Vector2{offsetMin.x, offsetMax.y}, Vector2{offsetMax.x, offsetMin.y}})
+    {
+        const Vector2 p = {frameOrigin.x + (corner.x * cosres - corner.y * sinres),
+                           frameOrigin.y + (corner.x * sinres + corner.y * cosres)};
+        min = Vector2{std::min(min.x, p.x), std::min(min.y, p.y)};
+        max = Vector2{std::max(max.x, p.x), std::max(max.y, p.y)};
+    }
+
+    // the troops round differently than the corners, grow the box by far more than that
+    const float margin = 1e-4f * (fabsf(frameOrigin.x) + fabsf(frameOrigin.y) + (max.x - min.x) + (max.y - min.y) + 1.0f);
+    return Rectangle{min.x - margin, min.y - margin, max.x - min.x + 2 * margin, max.y - min.y + 2 * margin};
+}
+
+RemovedTroops TroopStorage::removeDead()
+{
+    RemovedTroops removed;
+    if (deadCount == 0)
+    {
+        return removed;
+    }
+
+    // look for the first dead troop with the vector compare and only compact from there on
+    const int count = size();
+    const float *ph = health.data();
+    int first = 0;
+
+#ifdef TROOP_SIMD
+    const f32x4 zero = splat4(0.0f);
+    for (; first + 4 <= count; first += 4)
+    {
+        const int mask = lessEqualMask4(load4(ph + first), zero);
+        if (mask)
+        {
+            first += __builtin_ctz(mask);
+            break;
+        }
+    }
+#endif
+
+    while (first < count && ph[first] > 0.0f)
+    {
+        first++;
+    }
+
+    int alive = first;
+    for (int i = first; i < count; i++)
+    {
+        if (health[i] <= 0.0f)
+        {
+            const Vector2 p = position(i);
+            removed.count++;
+            removed.positionSum.x += p.x;
+            removed.positionSum.y += p.y;
+            removed.healthSum += health[i];
+            continue;
+        }
+        offsetX[alive] = offsetX[i];
+        offsetY[alive] = offsetY[i];
+        health[alive] = health[i];
+        if (worldCached)
+        {
+            worldX[alive] = worldX[i];
+            worldY[alive] = worldY[i];
+        }
+        engaged[alive] = engaged[i];
+        frameCounter[alive] = frameCounter[i];
+        currentFrame[alive] = currentFrame[i];
+        flipHorizontal[alive] = flipHorizontal[i];
+        alive++;
+    }
+
+    offsetX.resize(alive);
+    offsetY.resize(alive);
+    health.resize(alive);
+    if (worldCached)
+    {
+        worldX.resize(alive);
+        worldY.resize(alive);
+    }
+    engaged.resize(alive);
+    frameCounter.resize(alive);
+    currentFrame.resize(alive);
+    flipHorizontal.resize(alive);
+    if (engagedCount > 0)
+    {
+        countEngaged();
+    }
+
+    // the bounds stay as they are, they still contain every troop left
+    healthTotal -= removed.healthSum;
+    deadCount = 0;
+    return removed;
+}
+
+Vector2 TroopStorage::positionSum() const
+{
+    // summed in order on purpose, a lane-wise sum would round differently
+    Vector2 sum = {0.0f, 0.0f};
+    const int count = size();
+    for (int i = 0; i < count; i++)
+    {
+        const Vector2 p = position(i);
+        sum.x += p.x;
+        sum.y += p.y;
+    }
+    return sum;
+}
+
+void TroopStorage::refreshAggregates()
+{
+    offsetMin = Vector2{INFINITY, INFINITY};
+    offsetMax = Vector2{-INFINITY, -INFINITY};
+    healthTotal = 0.0f;
+    deadCount = 0;
+    engagedCount = 0;
+    for (int i = 0; i < size(); i++)
+    {
+        offsetMin = Vector2{std::min(offsetMin.x, offsetX[i]), std::min(offsetMin.y, offsetY[i])};
+        offsetMax = Vector2{std::max(offsetMax.x, offsetX[i]), std::max(offsetMax.y, offsetY[i])};
+        healthTotal += health[i];
+        deadCount += health[i] <= 0.0f;
+        engagedCount += engaged[i] != 0;
+    }
+}
+
+namespace
+{
+
+template <typename T>
+void saveArray(ByteWriter &writer, const std::vector<T> &values)
+{
+    writer.writeBytes(values.data(), values.size() * sizeof(T));
+}
+
+template <typename T>
+bool loadArray(ByteReader &reader, std::vector<T> &values, int count)
+{
+    values.resize(count);
+    return reader.readBytes(values.data(), count * sizeof(T));
+}
+
+} // namespace
+
+void TroopStorage::save(ByteWriter &writer) const
+{
+    saveArray(writer, offsetX);
+    saveArray(writer, offsetY);
+    saveArray(writer, health);
+    saveArray(writer, engaged);
+    saveArray(writer, frameCounter);
+    saveArray(writer, currentFrame);
+    saveArray(writer, flipHorizontal);
+
+    writer.writeBytes(&formationState, sizeof(formationState));
+    const uint8_t flip = formationFlip;
+    writer.writeBytes(&flip, sizeof(flip));
+    writer.writeBytes(&formationFrameCounter, sizeof(formationFrameCounter));
+    writer.writeBytes(&formationFrame, sizeof(formationFrame));
+
+    writer.writeBytes(&origin, sizeof(origin));
+    writer.writeBytes(&angle, sizeof(angle));
+    writer.writeBytes(&cosAngle, sizeof(cosAngle));
+    writer.writeBytes(&sinAngle, sizeof(sinAngle));
+    writer.writeBytes(&prevOrigin, sizeof(prevOrigin));
+    writer.writeBytes(&prevCosAngle, sizeof(prevCosAngle));
+    writer.writeBytes(&prevSinAngle, sizeof(prevSinAngle));
+}
+
+bool TroopStorage::load(ByteReader &reader, int count)
+{
+    // checked up front so that a corrupt count cannot allocate much
+    const size_t bytesPerTroop = 4 * sizeof(float) + 3 * sizeof(uint8_t);
+    if ((size_t)count * bytesPerTroop > reader.remaining())
+    {
+        return false;
+    }
+
+    uint8_t flip;
+    if (!loadArray(reader, offsetX, count) ||
+        !loadArray(reader, offsetY, count) ||
+        !loadArray(reader, health, count) ||
+        !loadArray(reader, engaged, count) ||
+        !loadArray(reader, frameCounter, count) ||
+        !loadArray(reader, currentFrame, count) ||
+        !loadArray(reader, flipHorizontal, count) ||
+        !reader.readBytes(&formationState, sizeof(formationState)) ||
+        !reader.readBytes(&flip, sizeof(flip)) ||
+        !reader.readBytes(&formationFrameCounter, sizeof(formationFrameCounter)) ||
+        !reader.readBytes(&formationFrame, sizeof(formationFrame)) ||
+        !reader.readBytes(&origin, sizeof(origin)) ||
+        !reader.readBytes(&angle, sizeof(angle)) ||
+        !reader.readBytes(&cosAngle, sizeof(cosAngle)) ||
+        !reader.readBytes(&sinAngle, sizeof(sinAngle)) ||
+        !reader.readBytes(&prevOrigin, sizeof(prevOrigin)) ||
+        !reader.readBytes(&prevCosAngle, sizeof(prevCosAngle)) ||
+        !reader.readBytes(&prevSinAngle, sizeof(prevSinAngle)))
+    {
+        return false;
+    }
+
+    // the animation indexes the sprite tables, a corrupt value must not reach them
+    auto validFrame = [](float counter, uint8_t frame)
+    { return counter >= 0.0f && counter < const_animationFrames && frame < const_animationFrames; };
+    if (flip > 1 || (uint8_t)formationState > (uint8_t)TroopState::ATTACKING_UP ||
+        !validFrame(formationFrameCounter, formationFrame))
+    {
+        return false;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (engaged[i] > 1 || flipHorizontal[i] > 1 || !validFrame(frameCounter[i], currentFrame[i]))
+        {
+            return false;
+        }
+    }
+
+    formationFlip = flip != 0;
+    worldCached = false;
+    refreshAggregates();
+    return true;
+}
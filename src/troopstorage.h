@@ -0,0 +1,179 @@
+
+#pragma once
+
+#include "src/simmath.h"
+#include "src/bytestream.h"
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+enum class TroopState : uint8_t
+{
+    MOVING,
+    ATTACKING,
+    IDLE,
+    MOVING_UP,
+    MOVING_DOWN,
+    ATTACKING_DOWN,
+    ATTACKING_UP
+};
+
+/// @brief what TroopStorage::removeDead took out
+struct RemovedTroops
+{
+    int count = 0;
+    Vector2 positionSum = {0.0f, 0.0f};
+    // health left on the removed troops, zero or below
+    float healthSum = 0.0f;
+};
+
+/// @brief the troops of a battalion, stored as a structure of arrays
+/// Troops keep their place in the formation, so they are stored as offsets
+/// in the frame of the formation and moving or turning the battalion only
+/// moves the frame. World positions are worked out from the frame, or read
+/// from the cache that cacheWorldPositions fills for the troops in combat.
+/// The formation shares one state, flip and animation; a troop breaks from
+/// it only when it engages an enemy troop and gets its own flip and
+/// animation until it rejoins, so a marching battalion costs the same
+/// whatever its size.
+struct TroopStorage
+{
+    // hot
+    std::vector<float> offsetX;
+    std::vector<float> offsetY;
+    std::vector<float> health;
+
+    // cold (combat), world positions of the frame they were cached for
+    std::vector<float> worldX;
+    std::vector<float> worldY;
+    bool worldCached = false;
+
+    // cold (animation), troops out of formation (engaged != 0) attack and
+    // animate on their own, the others show the formation's values
+    std::vector<uint8_t> engaged;
+    std::vector<float> frameCounter;
+    std::vector<uint8_t> currentFrame;
+    std::vector<uint8_t> flipHorizontal;
+    TroopState formationState = TroopState::IDLE;
+    bool formationFlip = false;
+    float formationFrameCounter = 0.0f;
+    uint8_t formationFrame = 0;
+    int engagedCount = 0;
+
+    // frame of the formation, a troop is at origin + its offset turned by
+    // the angle whose cosine and sine are kept
+    Vector2 origin = {0.0f, 0.0f};
+    float angle = 0.0f;
+    float cosAngle = 1.0f;
+    float sinAngle = 0.0f;
+    // cold (drawing), frame at the start of the previous tick
+    Vector2 prevOrigin = {0.0f, 0.0f};
+    float prevCosAngle = 1.0f;
+    float prevSinAngle = 0.0f;
+
+    // aggregates, kept up to date by the methods below instead of being
+    // recounted; the bounds contain every offset, after deaths they can be
+    // larger than needed until refreshAggregates
+    Vector2 offsetMin = {INFINITY, INFINITY};
+    Vector2 offsetMax = {-INFINITY, -INFINITY};
+    float healthTotal = 0.0f;
+    // troops without health that removeDead has not removed yet
+    int deadCount = 0;
+
+    int size() const { return (int)offsetX.size(); }
+    bool empty() const { return offsetX.empty(); }
+    /// @brief returns the world position of the troop, the cached one is the same bit for bit
+    Vector2 position(int index) const
+    {
+        return worldCached ? Vector2{worldX[index], worldY[index]} : toWorld(origin, cosAngle, sinAngle, index);
+    }
+    /// @brief returns the position of the troop at the start of the previous tick
+    Vector2 prevPosition(int index) const { return toWorld(prevOrigin, prevCosAngle, prevSinAngle, index); }
+    TroopState getState(int index) const { return engaged[index] ? TroopState::ATTACKING : formationState; }
+    bool getFlip(int index) const { return engaged[index] ? flipHorizontal[index] != 0 : formationFlip; }
+    int getFrame(int index) const { return engaged[index] ? currentFrame[index] : formationFrame; }
+
+    void reserve(int count);
+    /// @brief appends an idle troop at position
+    void push(Vector2 position, float troopHealth);
+    /// @brief moves the origin of the frame to position without moving any troop
+    void setOrigin(Vector2 position);
+    /// @brief sets the state of the formation, every troop rejoins it unless it attacks
+    void setState(TroopState troopState);
+    /// @brief sets the horizontal flip of the formation
+    void setFlip(bool flip);
+    /// @brief takes the troop at index out of the formation to attack, facing left if flip
+    /// it keeps the animation of the formation where it is; touches only that troop
+    void engage(int index, bool flip)
+    {
+        if (!engaged[index])
+        {
+            engaged[index] = 1;
+            frameCounter[index] = formationFrameCounter;
+            currentFrame[index] = formationFrame;
+        }
+        flipHorizontal[index] = flip;
+    }
+    /// @brief puts the troop at index back into the formation; touches only that troop
+    void disengage(int index) { engaged[index] = 0; }
+    /// @brief puts every troop back into the formation
+    void rejoin();
+    /// @brief recounts engagedCount after engage and disengage
+    void countEngaged();
+    /// @brief keeps the current frame as the frame of the previous tick
+    void savePositions();
+    /// @brief advances the walk/attack animation of the formation and of the troops out of it
+    void animate(float deltaTime);
+    /// @brief fills worldX and worldY from the current frame, does nothing if they are filled
+    /// moving or turning the formation drops them again
+    void cacheWorldPositions();
+
+    /// @brief moves every troop by delta
+    void translate(Vector2 delta);
+    /// @brief rotates every troop around center by angleStep (in radians)
+    void rotate(Vector2 center, float angleStep);
+    /// @brief takes amount of health from the troop at index
+    void damage(int index, float amount)
+    {
+        deadCount += health[index] > 0.0f && health[index] - amount <= 0.0f;
+        health[index] -= amount;
+        healthTotal -= amount;
+    }
+    /// @brief returns the number of troops closer than range to position
+    int countInRange(Vector2 position, float range) const;
+    /// @brief returns 0 or size() when the bounds alone show that no troop or every troop is closer than range
+    /// to position, -1 when the troops have to be counted
+    int countInRangeByBounds(Vector2 position, float range) const;
+    /// @brief returns the index of the troop closest to position, -1 if empty
+    /// ties are broken by the lower index
+    int nearest(Vector2 position, float &distSqr) const;
+    /// @brief returns the smallest rectangle that contains every troop, see offsetMin and offsetMax
+    /// @param previous if true, of the frame at the start of the previous tick
+    Rectangle getBounds(bool previous) const;
+    /// @brief removes the troops without health, keeps the order of the others
+    RemovedTroops removeDead();
+    /// @brief returns the sum of all troop positions
+    Vector2 positionSum() const;
+    /// @brief recomputes the aggregates from the troops, shrinking the bounds to fit
+    void refreshAggregates();
+
+    /// @brief appends every array and the frames to writer as raw bytes
+    void save(ByteWriter &writer) const;
+    /// @brief reads count troops written by save
+    /// @return false if reader runs out of bytes or a state, flag or animation frame is out of range
+    bool load(ByteReader &reader, int count);
+
+private:
+    Vector2 toWorld(Vector2 frameOrigin, float cosres, float sinres, int index) const
+    {
+        return Vector2{frameOrigin.x + (offsetX[index] * cosres - offsetY[index] * sinres),
+                       frameOrigin.y + (offsetX[index] * sinres + offsetY[index] * cosres)};
+    }
+    /// @brief turns position into the frame of the formation
+    Vector2 toFormation(Vector2 position) const
+    {
+        const float dx = position.x - origin.x;
+        const float dy = position.y - origin.y;
+        return Vector2{dx * cosAngle + dy * sinAngle, dy * cosAngle - dx * sinAngle};
+    }
+};
@@ -1,41 +1,35 @@
-#include "wall.h"
+#include "src/wall.h"
 
 Rectangle Wall::getBoundingBox() const
 {
     return Rectangle{position.x - size.x / 2, position.y - size.y / 2, size.x, size.y};
 }
 
-void Wall::setHP(float hp)
+Rectangle Wall::getFootprint() const
 {
-    Wall::health = hp;
+    const Rectangle box = getBoundingBox();
+    const float c = cosf(rotation * DEG2RAD);
+    const float s = sinf(rotation * DEG2RAD);
+
+    // corners of the box relative to the top left one, turned
+    const float xs[] = {0.0f, box.width * c, -box.height * s, box.width * c - box.height * s};
+    const float ys[] = {0.0f, box.width * s, box.height * c, box.width * s + box.height * c};
+    const float minX = *std::min_element(xs, xs + 4);
+    const float minY = *std::min_element(ys, ys + 4);
+    return Rectangle{box.x + minX, box.y + minY, *std::max_element(xs, xs + 4) - minX, *std::max_element(ys, ys + 4) - minY};
 }
 
-void Wall::takeDamage(float damage)
+void Wall::setHP(float hp)
 {
-    Wall::health -= damage;
+    *health = hp;
 }
 
-float Wall::getHP()
+void Wall::takeDamage(float damage)
 {
-    return Wall::health;
+    *health -= damage;
 }
 
-void Wall::draw(Texture2D spritesheet) const
+float Wall::getHP() const
 {
-
-    float baseX = 0;
-    float baseY = 96;
-
-    if (Wall::health < TOTAL_HEALTH * 0.66)
-    {
-        baseX = 32;
-    }
-    else if (Wall::health < TOTAL_HEALTH * 0.33)
-    {
-        baseX = 64;
-    }
-
-    Rectangle wallSourceRec = {baseX, baseY, 32, 16}; // Assuming wall sprite starts at 0,0 in the texture
-    Rectangle wallDestRec = getBoundingBox();
-    DrawTexturePro(spritesheet, wallSourceRec, wallDestRec, Vector2{0, 0}, rotation, WHITE);
-}
\ No newline at end of file
+    return *health;
+}
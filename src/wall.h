@@ -1,6 +1,5 @@
 #pragma once
-#include <raylib/raylib.h>
-#include <raylib/raymath.h>
+#include "src/simmath.h"
 #include <algorithm>
 
 #define TOTAL_HEALTH 1250.0f
@@ -10,16 +9,23 @@ struct Wall
     Vector2 position, size;
     float rotation;
     // Use size for width and height
-    static inline float health;
+    // every segment of a battle's wall shares the same health, owned by the BattalionHandler
+    float *health;
 
     // Constructor
-    Wall(Vector2 pos, Vector2 sz, float rotation) : position(pos), size(sz), rotation(rotation) { Wall::setHP(TOTAL_HEALTH); }
+    Wall(Vector2 pos, Vector2 sz, float rotation, float *health) : position(pos), size(sz), rotation(rotation), health(health) {}
 
     // Function to set the health
-    static void takeDamage(float damage);
-    static float getHP();
-    static void setHP(float hp);
+    void takeDamage(float damage);
+    float getHP() const;
+    void setHP(float hp);
     Rectangle getBoundingBox() const;
+    /// @brief returns the area the wall covers, its bounding box turned by rotation around the top left corner as drawn
+    Rectangle getFootprint() const;
+#ifndef HEADLESS
+    /// @brief returns which of the damaged wall sprites [0 to 2] is drawn
+    int getDamageTier() const;
     void draw(Texture2D spritesheet) const;
+#endif
     // Function to get the bounding box
-};
\ No newline at end of file
+};
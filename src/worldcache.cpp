@@ -0,0 +1,175 @@
+#include "src/worldcache.h"
+#include "src/bytestream.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+#endif
+
+const char const_worldCacheMagic[4] = {'B', 'S', 'W', 'C'};
+const int const_worldCacheVersion = 2;
+#ifdef __EMSCRIPTEN__
+// mount point of the IndexedDB file system, see prefix.js
+const char *const_worldCacheDir = "/worldcache";
+#else
+const char *const_worldCacheDir = "worldcache";
+#endif
+
+namespace
+{
+std::string cachePath(const WorldKey &key)
+{
+    // TextFormat shares its buffers between threads
+    char path[256];
+    snprintf(path, sizeof(path), "%s/world-%llu-%dx%d-v%d-%d-%d.bin", const_worldCacheDir,
+             (unsigned long long)key.seed, key.boundX, key.boundY, const_worldAssetVersion, key.chunkX, key.chunkY);
+    return path;
+}
+
+void writeCompressed(ByteWriter &writer, const void *data, int size)
+{
+    int compressedSize = 0;
+    unsigned char *compressed = CompressData((const unsigned char *)data, size, &compressedSize);
+    writer.writeVarint(size);
+    writer.writeVarint(compressedSize);
+    writer.writeBytes(compressed, compressedSize);
+    MemFree(compressed);
+}
+
+bool readCompressed(ByteReader &reader, void *data, int size)
+{
+    const int expectedSize = (int)reader.readVarint();
+    const int compressedSize = (int)reader.readVarint();
+    if (reader.failed() || expectedSize != size || compressedSize > (int)reader.remaining())
+    {
+        return false;
+    }
+
+    int decompressedSize = 0;
+    unsigned char *decompressed = DecompressData(reader.position(), compressedSize, &decompressedSize);
+    const bool ok = decompressed != nullptr && decompressedSize == size;
+    if (ok)
+    {
+        memcpy(data, decompressed, size);
+    }
+    MemFree(decompressed);
+    return ok && reader.skip(compressedSize);
+}
+} // namespace
+
+bool loadCachedWorld(const WorldKey &key, std::vector<Tile> &tiles, Image &image, std::string &error)
+{
+    const std::string path = cachePath(key);
+    if (!FileExists(path.c_str()))
+    {
+        error = "not cached";
+        return false;
+    }
+
+    std::vector<uint8_t> data;
+    if (!readBinaryFile(path.c_str(), data, error))
+    {
+        return false;
+    }
+
+    ByteReader reader(data.data(), data.size());
+    char magic[4];
+    if (!reader.readBytes(magic, sizeof(magic)) || memcmp(magic, const_worldCacheMagic, sizeof(magic)) != 0 ||
+        reader.readVarint() != const_worldCacheVersion)
+    {
+        error = "not a world cache entry of this version";
+        return false;
+    }
+    if (reader.readVarint() != key.seed || (int)reader.readVarint() != key.boundX ||
+        (int)reader.readVarint() != key.boundY || (int)reader.readVarint() != const_worldAssetVersion ||
+        (int)reader.readVarint() != key.chunkX || (int)reader.readVarint() != key.chunkY)
+    {
+        error = "cache entry is for another world";
+        return false;
+    }
+    const int width = (int)reader.readVarint();
+    const int height = (int)reader.readVarint();
+    if (reader.failed() || width <= 0 || height <= 0 || width > 16384 || height > 16384 ||
+        width % const_tileSize != 0 || height % const_tileSize != 0)
+    {
+        error = "invalid image size";
+        return false;
+    }
+
+    std::vector<uint8_t> tileData((width / const_tileSize) * (height / const_tileSize));
+    if (!readCompressed(reader, tileData.data(), tileData.size()))
+    {
+        error = "invalid tiles";
+        return false;
+    }
+
+    Image loaded = GenImageColor(width, height, BLANK);
+    if (!readCompressed(reader, loaded.data, width * height * 4))
+    {
+        UnloadImage(loaded);
+        error = "invalid image";
+        return false;
+    }
+
+    tiles.resize(tileData.size());
+    for (size_t i = 0; i < tileData.size(); i++)
+    {
+        tiles[i] = (Tile)tileData[i];
+    }
+    image = loaded;
+    return true;
+}
+
+bool saveCachedWorld(const WorldKey &key, const std::vector<Tile> &tiles, const Image &image, std::string &error)
+{
+    if (image.format != PIXELFORMAT_UNCOMPRESSED_R8G8B8A8)
+    {
+        error = "only RGBA images are cached";
+        return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(const_worldCacheDir, ec);
+    if (ec)
+    {
+        error = ec.message();
+        return false;
+    }
+
+    ByteWriter writer;
+    writer.writeBytes(const_worldCacheMagic, sizeof(const_worldCacheMagic));
+    writer.writeVarint(const_worldCacheVersion);
+    writer.writeVarint(key.seed);
+    writer.writeVarint(key.boundX);
+    writer.writeVarint(key.boundY);
+    writer.writeVarint(const_worldAssetVersion);
+    writer.writeVarint(key.chunkX);
+    writer.writeVarint(key.chunkY);
+    writer.writeVarint(image.width);
+    writer.writeVarint(image.height);
+
+    std::vector<uint8_t> tileData(tiles.size());
+    for (size_t i = 0; i < tiles.size(); i++)
+    {
+        tileData[i] = (uint8_t)tiles[i];
+    }
+    writeCompressed(writer, tileData.data(), tileData.size());
+    writeCompressed(writer, image.data, image.width * image.height * 4);
+
+    if (!writeBinaryFile(cachePath(key).c_str(), writer.getData(), error))
+    {
+        return false;
+    }
+
+#ifdef __EMSCRIPTEN__
+    // IndexedDB only sees the file once the file system is synced back
+    MAIN_THREAD_ASYNC_EM_ASM({
+        if (Module.persistWorldCache)
+        {
+            Module.persistWorldCache();
+        }
+    });
+#endif
+    return true;
+}
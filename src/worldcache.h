@@ -0,0 +1,31 @@
+#pragma once
+
+#include "src/worldgen.h"
+#include <raylib/raylib.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Generated world chunks are kept on disk so that loading the same world
+// again skips generation entirely. On the web the cache directory is an IndexedDB
+// backed file system, mounted and filled by prefix.js before main runs.
+
+/// @brief bump whenever the world spritesheet or the way worlds are generated changes
+inline constexpr int const_worldAssetVersion = 2;
+
+/// @brief what a generated chunk of a world depends on
+struct WorldKey
+{
+    uint64_t seed;
+    int boundX;
+    int boundY;
+    int chunkX;
+    int chunkY;
+};
+
+/// @brief reads the tiles and the composited image of the chunk from the cache
+/// @return false if the chunk is not cached or the entry is unusable, `error` says why
+bool loadCachedWorld(const WorldKey &key, std::vector<Tile> &tiles, Image &image, std::string &error);
+/// @brief writes the tiles and the composited image of the chunk to the cache
+/// safe to call from any thread
+bool saveCachedWorld(const WorldKey &key, const std::vector<Tile> &tiles, const Image &image, std::string &error);
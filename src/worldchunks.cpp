@@ -0,0 +1,256 @@
+#include "src/worldchunks.h"
+#include "src/worldcache.h"
+#include <algorithm>
+#include <cmath>
+
+// bytes of chunk textures kept at most, the chunks close to the view are kept regardless
+const size_t const_chunkBudget = 256u << 20;
+// chunks around the view that are asked for before they are seen
+const int const_prefetchChunks = 1;
+
+ChunkedWorld::ChunkedWorld(int boundX, int boundY, uint64_t seed)
+    : m_worldGen(boundX, boundY, seed),
+      m_chunksX((boundX + const_chunkTiles - 1) / const_chunkTiles),
+      m_chunksY((boundY + const_chunkTiles - 1) / const_chunkTiles)
+{
+#ifndef THREADPOOL_SERIAL
+    m_worker = std::thread(&ChunkedWorld::workerLoop, this);
+#endif
+}
+
+ChunkedWorld::~ChunkedWorld()
+{
+#ifndef THREADPOOL_SERIAL
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    m_worker.join();
+#endif
+
+    for (auto &finished : m_finished)
+    {
+        UnloadImage(finished.image);
+    }
+    for (auto &[index, chunk] : m_chunks)
+    {
+        UnloadTexture(chunk.texture);
+    }
+}
+
+void ChunkedWorld::getChunkRange(Rectangle area, int &x0, int &y0, int &x1, int &y1) const
+{
+    x0 = std::clamp((int)floorf(area.x / const_chunkTiles), 0, m_chunksX);
+    y0 = std::clamp((int)floorf(area.y / const_chunkTiles), 0, m_chunksY);
+    x1 = std::clamp((int)ceilf((area.x + area.width) / const_chunkTiles), 0, m_chunksX);
+    y1 = std::clamp((int)ceilf((area.y + area.height) / const_chunkTiles), 0, m_chunksY);
+}
+
+void ChunkedWorld::update(Rectangle view)
+{
+    m_frame++;
+
+    const float margin = const_prefetchChunks * const_chunkTiles;
+    const Rectangle area = {view.x - margin, view.y - margin, view.width + 2 * margin, view.height + 2 * margin};
+    int x0, y0, x1, y1;
+    getChunkRange(area, x0, y0, x1, y1);
+
+    // the chunks close to the view are kept, the missing ones asked for closest first
+    std::vector<int> missing;
+    for (int y = y0; y < y1; y++)
+    {
+        for (int x = x0; x < x1; x++)
+        {
+            const int index = y * m_chunksX + x;
+            auto it = m_chunks.find(index);
+            if (it != m_chunks.end())
+            {
+                it->second.lastUsed = m_frame;
+            }
+            else
+            {
+                missing.push_back(index);
+            }
+        }
+    }
+
+    const float centerX = (view.x + view.width / 2) / const_chunkTiles - 0.5f;
+    const float centerY = (view.y + view.height / 2) / const_chunkTiles - 0.5f;
+    auto distance = [&](int index)
+    {
+        const float dx = index % m_chunksX - centerX;
+        const float dy = index / m_chunksX - centerY;
+        return dx * dx + dy * dy;
+    };
+    std::sort(missing.begin(), missing.end(), [&](int a, int b)
+              { return distance(a) < distance(b); });
+
+    std::vector<FinishedChunk> finished;
+    {
+#ifndef THREADPOOL_SERIAL
+        std::lock_guard<std::mutex> lock(m_mutex);
+#endif
+        // requests that are not close anymore are dropped before the worker gets to them
+        m_requests.erase(std::remove_if(m_requests.begin(), m_requests.end(), [&](int index)
+                                        {
+                                            const int x = index % m_chunksX;
+                                            const int y = index / m_chunksX;
+                                            if (x >= x0 && x < x1 && y >= y0 && y < y1)
+                                            {
+                                                return false;
+                                            }
+                                            m_pending.erase(index);
+                                            return true; }),
+                         m_requests.end());
+        for (int index : missing)
+        {
+            if (m_pending.insert(index).second)
+            {
+                m_requests.push_back(index);
+            }
+        }
+        std::sort(m_requests.begin(), m_requests.end(), [&](int a, int b)
+                  { return distance(a) < distance(b); });
+        finished.swap(m_finished);
+    }
+#ifndef THREADPOOL_SERIAL
+    m_wake.notify_one();
+#else
+    // without threads one chunk per frame is generated on the render thread
+    if (!m_requests.empty())
+    {
+        const int index = m_requests.front();
+        m_requests.erase(m_requests.begin());
+        finished.push_back({index, generateChunk(index, nullptr)});
+    }
+#endif
+
+    for (auto &chunk : finished)
+    {
+        m_pending.erase(chunk.index);
+        // a chunk dropped from the requests while the worker had it can be generated twice
+        if (m_chunks.count(chunk.index) > 0)
+        {
+            UnloadImage(chunk.image);
+            continue;
+        }
+        Texture2D texture = LoadTextureFromImage(chunk.image);
+        UnloadImage(chunk.image);
+        SetTextureFilter(texture, m_filter);
+        m_chunks[chunk.index] = {texture, m_frame};
+        m_revision++;
+    }
+
+    evictOverBudget();
+}
+
+void ChunkedWorld::evictOverBudget()
+{
+    const size_t chunkBytes = (size_t)const_chunkTiles * const_tileSize * const_chunkTiles * const_tileSize * 4;
+    while (m_chunks.size() * chunkBytes > const_chunkBudget)
+    {
+        auto oldest = std::min_element(m_chunks.begin(), m_chunks.end(), [](const auto &a, const auto &b)
+                                       { return a.second.lastUsed < b.second.lastUsed; });
+        if (oldest->second.lastUsed == m_frame)
+        {
+            return;
+        }
+        UnloadTexture(oldest->second.texture);
+        m_chunks.erase(oldest);
+        m_revision++;
+    }
+}
+
+void ChunkedWorld::draw(Rectangle view) const
+{
+    int x0, y0, x1, y1;
+    getChunkRange(view, x0, y0, x1, y1);
+    for (int y = y0; y < y1; y++)
+    {
+        for (int x = x0; x < x1; x++)
+        {
+            auto it = m_chunks.find(y * m_chunksX + x);
+            if (it == m_chunks.end())
+            {
+                continue;
+            }
+
+            const Texture2D &texture = it->second.texture;
+            const Rectangle srcRect = {0, 0, (float)texture.width, (float)texture.height};
+            const Rectangle destRect = {(float)x * const_chunkTiles, (float)y * const_chunkTiles,
+                                        (float)texture.width / const_tileSize, (float)texture.height / const_tileSize};
+            DrawTexturePro(texture, srcRect, destRect, {0, 0}, 0, WHITE);
+        }
+    }
+}
+
+void ChunkedWorld::setFilter(int filter)
+{
+    if (filter == m_filter)
+    {
+        return;
+    }
+
+    m_filter = filter;
+    for (auto &[index, chunk] : m_chunks)
+    {
+        SetTextureFilter(chunk.texture, filter);
+    }
+}
+
+Image ChunkedWorld::generateChunk(int index, ThreadPool *pool) const
+{
+    const int chunkX = index % m_chunksX;
+    const int chunkY = index / m_chunksX;
+    const int x = chunkX * const_chunkTiles;
+    const int y = chunkY * const_chunkTiles;
+    const int width = std::min(const_chunkTiles, m_worldGen.getBoundX() - x);
+    const int height = std::min(const_chunkTiles, m_worldGen.getBoundY() - y);
+
+    const WorldKey key = {m_worldGen.getSeed(), m_worldGen.getBoundX(), m_worldGen.getBoundY(), chunkX, chunkY};
+    std::vector<Tile> tiles;
+    Image image;
+    std::string error;
+    if (loadCachedWorld(key, tiles, image, error))
+    {
+        return image;
+    }
+
+    tiles.resize(width * height);
+    image = m_worldGen.composeRegion(x, y, width, height, tiles.data(), pool);
+    if (!saveCachedWorld(key, tiles, image, error))
+    {
+        TraceLog(LOG_WARNING, "WORLDGEN: Could not cache chunk %d, %d: %s", chunkX, chunkY, error.c_str());
+    }
+    return image;
+}
+
+#ifndef THREADPOOL_SERIAL
+void ChunkedWorld::workerLoop()
+{
+    ThreadPool pool(0);
+    while (true)
+    {
+        int index;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this]
+                        { return m_stop || !m_requests.empty(); });
+            if (m_stop)
+            {
+                return;
+            }
+            index = m_requests.front();
+            m_requests.erase(m_requests.begin());
+        }
+
+        // one chunk at a time, its rows split over the pool: the closest
+        // chunk shows up first and camera moves are picked up between chunks
+        Image image = generateChunk(index, &pool);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finished.push_back({index, image});
+    }
+}
+#endif
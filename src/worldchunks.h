@@ -0,0 +1,92 @@
+#pragma once
+
+#include "src/threadpool.h"
+#include "src/worldgen.h"
+#include <raylib/raylib.h>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifndef THREADPOOL_SERIAL
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+// tiles along each side of a chunk
+inline constexpr int const_chunkTiles = 32;
+
+/// @brief world split into chunks whose textures only exist while the camera is close to them
+/// Chunks near the view are generated (or read from the world cache) on a
+/// worker thread and uploaded on the render thread once they are done. Past a
+/// memory budget the least recently seen chunks are dropped again.
+class ChunkedWorld
+{
+
+public:
+    /// @brief loads the world spritesheet, so it has to be created after the window
+    ChunkedWorld(int boundX, int boundY, uint64_t seed);
+    /// @brief stops the worker and unloads every chunk
+    ~ChunkedWorld();
+
+    ChunkedWorld(const ChunkedWorld &) = delete;
+    ChunkedWorld &operator=(const ChunkedWorld &) = delete;
+
+    /// @brief asks for the chunks around view, uploads the finished ones and drops the ones over budget
+    /// call once per frame from the render thread
+    void update(Rectangle view);
+    /// @brief draws the loaded chunks that overlap view
+    void draw(Rectangle view) const;
+    /// @brief sets the texture filter of every chunk
+    void setFilter(int filter);
+    /// @brief changes whenever a chunk was uploaded or dropped
+    int getRevision() const { return m_revision; }
+
+private:
+    struct Chunk
+    {
+        Texture2D texture;
+        // frame the chunk was last close to the view
+        long lastUsed;
+    };
+
+    // a generated chunk waiting to be uploaded
+    struct FinishedChunk
+    {
+        int index;
+        Image image;
+    };
+
+    /// @brief returns the chunk range [x0, x1) by [y0, y1) that overlaps area
+    void getChunkRange(Rectangle area, int &x0, int &y0, int &x1, int &y1) const;
+    /// @brief returns the image of the chunk, from the world cache if it is there
+    /// composed in row bands on pool if it is not null
+    Image generateChunk(int index, ThreadPool *pool) const;
+    void evictOverBudget();
+#ifndef THREADPOOL_SERIAL
+    void workerLoop();
+#endif
+
+private:
+    WorldGen m_worldGen;
+    int m_chunksX;
+    int m_chunksY;
+    std::unordered_map<int, Chunk> m_chunks;
+    // asked for, not uploaded yet, only used on the render thread
+    std::unordered_set<int> m_pending;
+    long m_frame = 0;
+    int m_revision = 0;
+    int m_filter = TEXTURE_FILTER_POINT;
+
+    // closest first, guarded by m_mutex when there is a worker
+    std::vector<int> m_requests;
+    std::vector<FinishedChunk> m_finished;
+#ifndef THREADPOOL_SERIAL
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stop = false;
+    std::thread m_worker;
+#endif
+};
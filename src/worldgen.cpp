@@ -1,11 +1,98 @@
 
 #include "src/worldgen.h"
+#include "src/counterrng.h"
+#include "src/noise.h"
+#include <algorithm>
+#include <array>
+#include <functional>
 
-Texture WorldGen::createWorldTexture(int boundX, int boundY)
+// noise units per tile, sets how large the patches of dirt, weed and grass are
+const float const_noiseFrequency = 0.04f;
+const int const_noiseOctaves = 6;
+// opacity of the grass overlay on dirt next to other tiles
+const int const_overlayAlpha = 235;
+// tile rows composed per task when a region is split over a pool
+const int const_bandTiles = 4;
+
+namespace
+{
+using TilePixels = std::array<Color, const_tileSize * const_tileSize>;
+
+TilePixels copyTile(const Image &sheet, Rectangle source)
+{
+    const Color *pixels = (const Color *)sheet.data;
+    TilePixels tile;
+    for (int y = 0; y < const_tileSize; y++)
+    {
+        for (int x = 0; x < const_tileSize; x++)
+        {
+            tile[y * const_tileSize + x] = pixels[((int)source.y + y) * sheet.width + (int)source.x + x];
+        }
+    }
+    return tile;
+}
+
+// turns the tile by quarter turns clockwise
+TilePixels rotateTile(const TilePixels &tile, int quarterTurns)
+{
+    TilePixels rotated = tile;
+    for (int turn = 0; turn < quarterTurns; turn++)
+    {
+        const TilePixels src = rotated;
+        for (int y = 0; y < const_tileSize; y++)
+        {
+            for (int x = 0; x < const_tileSize; x++)
+            {
+                rotated[y * const_tileSize + x] = src[(const_tileSize - 1 - x) * const_tileSize + y];
+            }
+        }
+    }
+    return rotated;
+}
+
+// draws src with opacity alpha [0 to 255] over dst
+Color blendOver(Color dst, Color src, int alpha)
+{
+    const int a = src.a * alpha / 255;
+    const int outA = a + dst.a * (255 - a) / 255;
+    if (outA == 0)
+    {
+        return BLANK;
+    }
+
+    Color out;
+    out.r = (unsigned char)((src.r * a + dst.r * dst.a * (255 - a) / 255) / outA);
+    out.g = (unsigned char)((src.g * a + dst.g * dst.a * (255 - a) / 255) / outA);
+    out.b = (unsigned char)((src.b * a + dst.b * dst.a * (255 - a) / 255) / outA);
+    out.a = (unsigned char)outA;
+    return out;
+}
+/// @brief calls task(band) for every band of const_bandTiles rows in [0, rows), on pool if there is one
+void forEachBand(ThreadPool *pool, int rows, const std::function<void(int)> &task)
+{
+    const int bands = (rows + const_bandTiles - 1) / const_bandTiles;
+    if (pool)
+    {
+        pool->parallelFor(bands, task);
+        return;
+    }
+    for (int band = 0; band < bands; band++)
+    {
+        task(band);
+    }
+}
+} // namespace
+
+WorldGen::WorldGen(int boundX, int boundY, uint64_t seed)
+    : m_boundX(boundX), m_boundY(boundY), m_seed(seed)
 {
-    // how crisp the texture is (16 is a good number for now)
-    const float crispFactor = 16;
-    Texture worldSpriteSheet = LoadTexture("assets/spritesheets/world.png");
+    const uint32_t counter[4] = {0, 0, (uint32_t)RngStream::WorldNoise, 0};
+    uint32_t random[4];
+    philox4x32(counter, seed, random);
+    m_noiseKey = random[0];
+
+    Image sheet = LoadImage("assets/spritesheets/world.png");
+    ImageFormat(&sheet, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
 
     // dirt texture: 0 to 1
     // weed texture: 2 to 3
@@ -22,69 +109,156 @@ Texture WorldGen::createWorldTexture(int boundX, int boundY)
         {0, 48, 16, 16},
         {0, 112, 16, 16},
     };
+    for (int i = 0; i < 8; i++)
+    {
+        m_tiles[i] = copyTile(sheet, srcRects[i]);
+    }
+    UnloadImage(sheet);
 
-    const std::vector<Tile> worldData = WorldGen::createWorld(boundX, boundY);
-    // the world will be drawn into this
-    RenderTexture renderTex = LoadRenderTexture(boundX * crispFactor, boundY * crispFactor);
-
-    BeginTextureMode(renderTex);
-
-    for (int y = 0; y < boundY; y++)
+    // grass overlay of a dirt tile, bit i of the index is set when neighbor i
+    // (below, right, left, above) is not dirt and adds the overlay turned towards it
+    const int quarterTurns[4] = {3, 2, 0, 1};
+    for (int mask = 0; mask < 16; mask++)
     {
-        for (int x = 0; x < boundX; x++)
+        m_overlays[mask].fill(BLANK);
+        for (int i = 0; i < 4; i++)
         {
-            if (x < 8 && y >= boundY - 8) {
-                DrawTexturePro(worldSpriteSheet, srcRects[7], {x * crispFactor, y * crispFactor, crispFactor, crispFactor}, {0, 0}, 0, WHITE);
-                continue;
-            }
-            // const Tile tile = worldData[x + y * boundX];
-            // const int texIndex = GetRandomValue((int)tile * 2, (int)tile * 2 + 1);
-            // const Texture tex = assets[texIndex];
-            // const Rectangle srcRect = {0, 0, (float)tex.width, (float)tex.height};
-            // const Rectangle destRect = {x * crispFactor, y * crispFactor, crispFactor, crispFactor};
-            // DrawTexturePro(tex, srcRect, destRect, {0, 0}, 0, WHITE);
-
-            const Tile tile = worldData[x + y * boundX];
-            const int texIndex = GetRandomValue((int)tile * 2, (int)tile * 2 + 1);
-            const Rectangle destRect = {x * crispFactor, y * crispFactor, crispFactor, crispFactor};
-            DrawTexturePro(worldSpriteSheet, srcRects[texIndex], destRect, {0, 0}, 0, WHITE);
-
-            if (tile == Tile::Dirt)
+            if (mask & (1 << i))
             {
-                const int offsets[4][2] = {{0, -1}, {-1, 0}, {1, 0}, {0, 1}};
-                for (int i = 0; i < 4; i++)
+                const TilePixels turned = rotateTile(m_tiles[6], quarterTurns[i]);
+                for (int p = 0; p < const_tileSize * const_tileSize; p++)
                 {
-                    const int dx = x - offsets[i][0];
-                    const int dy = y - offsets[i][1];
-                    if (dx < 0 || dx > boundX || dy < 0 || dy > boundY || worldData[dx + dy * boundX] == Tile::Dirt)
-                    {
-                        continue;
-                    }
+                    m_overlays[mask][p] = blendOver(m_overlays[mask][p], turned[p], 255);
+                }
+            }
+        }
+    }
+}
 
-                    const int quads[4] = {3, 2, 0, 1};
-                    const int quad = quads[i];
-                    // the X origin changes when the angle is 180 or 270 degrees
-                    const float originX = (quad == 2 || quad == 3) ? 1 : 0;
-                    // the Y origin changes when the angle is 90 or 180 degrees
-                    const float originY = (quad == 1 || quad == 2) ? 1 : 0;
-                    const Vector2 origin = {originX * crispFactor, originY * crispFactor};
+Tile WorldGen::getTile(int x, int y) const
+{
+    Tile tile;
+    getTiles(x, y, 1, 1, &tile);
+    return tile;
+}
 
-                    DrawTexturePro(worldSpriteSheet, srcRects[6], destRect, origin, quad * 90, {255, 255, 255, 235});
-                }
+void WorldGen::getTiles(int x, int y, int width, int height, Tile *out) const
+{
+    // shown row [x, x + width) is composed row [boundX - x - width, boundX - x) mirrored
+    std::vector<Tile> row(width);
+    for (int ty = 0; ty < height; ty++)
+    {
+        getComposedRow(m_boundX - x - width, y + ty, width, row.data());
+        std::reverse_copy(row.begin(), row.end(), out + ty * width);
+    }
+}
+
+// The world is composed the way it always was and then mirrored, which puts
+// the golden tiles (and the castle) on the right. Composed tile x is shown
+// at boundX - 1 - x, its pixels mirrored too.
+void WorldGen::getComposedRow(int x, int y, int count, Tile *out) const
+{
+    std::vector<float> noise(count);
+    fbmNoiseRow(x, y, count, const_noiseFrequency, m_noiseKey, const_noiseOctaves, noise.data());
+    for (int i = 0; i < count; i++)
+    {
+        const float val = (noise[i] + 1) / 2;
+        if (val < 0.3)
+        {
+            out[i] = Tile::Dirt;
+        }
+        else if (val < 0.7)
+        {
+            out[i] = Tile::Weed;
+        }
+        else
+        {
+            out[i] = Tile::Grass;
+        }
+    }
+}
+
+Image WorldGen::composeRegion(int x, int y, int width, int height, Tile *shownTiles, ThreadPool *pool) const
+{
+    // the composed tiles of the region and the ones around it
+    const int x0 = m_boundX - x - width;
+    const int stride = width + 2;
+    std::vector<Tile> tiles(stride * (height + 2));
+    forEachBand(pool, height + 2, [&](int band)
+                {
+        for (int ty = band * const_bandTiles; ty < std::min((band + 1) * const_bandTiles, height + 2); ty++)
+        {
+            getComposedRow(x0 - 1, y + ty - 1, stride, &tiles[ty * stride]);
+        } });
+    auto tileAt = [&](int cx, int cy)
+    { return tiles[(cy - y + 1) * stride + (cx - x0 + 1)]; };
+
+    if (shownTiles != nullptr)
+    {
+        for (int ty = 0; ty < height; ty++)
+        {
+            for (int tx = 0; tx < width; tx++)
+            {
+                shownTiles[ty * width + tx] = tileAt(x0 + width - 1 - tx, y + ty);
             }
         }
     }
 
-    EndTextureMode();
+    const int neighbors[4][2] = {{0, 1}, {1, 0}, {-1, 0}, {0, -1}};
+    const int imageWidth = width * const_tileSize;
+    Image image = GenImageColor(imageWidth, height * const_tileSize, BLANK);
+    Color *pixels = (Color *)image.data;
 
-    Texture out = renderTex.texture;
+    // every band writes its own rows of pixels, once all the tiles are known
+    forEachBand(pool, height, [&](int band)
+                {
+        const int bandEnd = std::min(y + (band + 1) * const_bandTiles, y + height);
+        for (int cy = y + band * const_bandTiles; cy < bandEnd; cy++)
+        {
+            for (int cx = x0; cx < x0 + width; cx++)
+            {
+                const Tile tile = tileAt(cx, cy);
+                int texIndex;
+                int mask = 0;
+                if (cx < 8 && cy >= m_boundY - 8)
+                {
+                    texIndex = 7;
+                }
+                else
+                {
+                    // which of the two variants a tile gets only depends on the seed and where it is
+                    const uint32_t counter[4] = {(uint32_t)cx, (uint32_t)cy, (uint32_t)RngStream::TileVariant, 0};
+                    uint32_t random[4];
+                    philox4x32(counter, m_seed, random);
+                    texIndex = (int)tile * 2 + (random[0] & 1);
 
-    // unloading stuff
-    renderTex.texture.id = 0;
-    UnloadRenderTexture(renderTex);
-    UnloadTexture(worldSpriteSheet);
+                    for (int i = 0; tile == Tile::Dirt && i < 4; i++)
+                    {
+                        const int nx = cx + neighbors[i][0];
+                        const int ny = cy + neighbors[i][1];
+                        if (nx >= 0 && nx < m_boundX && ny >= 0 && ny < m_boundY && tileAt(nx, ny) != Tile::Dirt)
+                        {
+                            mask |= 1 << i;
+                        }
+                    }
+                }
 
-    return out;
+                const TilePixels &base = m_tiles[texIndex];
+                const TilePixels &overlay = m_overlays[mask];
+                for (int ty = 0; ty < const_tileSize; ty++)
+                {
+                    Color *row = pixels + ((cy - y) * const_tileSize + ty) * imageWidth + (cx - x0) * const_tileSize;
+                    for (int tx = 0; tx < const_tileSize; tx++)
+                    {
+                        const int p = ty * const_tileSize + tx;
+                        row[tx] = mask ? blendOver(base[p], overlay[p], const_overlayAlpha) : base[p];
+                    }
+                }
+            }
+        } });
+
+    ImageFlipHorizontal(&image);
+    return image;
 }
 
 Texture WorldGen::createCloudTexture()
@@ -99,38 +273,3 @@ Texture WorldGen::createCloudTexture()
 
     return cloudTexture;
 }
-
-std::vector<Tile> WorldGen::createWorld(int boundX, int boundY)
-{
-    // creating a vec of fixed size
-    std::vector<Tile> tiles(boundX * boundY);
-
-    const int offset = GetRandomValue(0, 100) * 100;
-    Image noiseImage = GenImagePerlinNoise(boundX, boundY, offset, offset, 3);
-    Color *noiseData = (Color *)noiseImage.data;
-
-    for (int y = 0; y < boundY; y++)
-    {
-        for (int x = 0; x < boundX; x++)
-        {
-            const float val = noiseData[x + y * boundX].r / 255.0f;
-            Tile tile;
-            if (val < 0.3)
-            {
-                tile = Tile::Dirt;
-            }
-            else if (val < 0.7)
-            {
-                tile = Tile::Weed;
-            }
-            else
-            {
-                tile = Tile::Grass;
-            }
-            tiles[x + y * boundX] = tile;
-        }
-    }
-
-    UnloadImage(noiseImage);
-    return tiles;
-}
@@ -1,7 +1,9 @@
-
 #pragma once
 
+#include "src/threadpool.h"
 #include <raylib/raylib.h>
+#include <array>
+#include <cstdint>
 #include <vector>
 
 enum class Tile
@@ -11,13 +13,48 @@ enum class Tile
     Grass = 2,
 };
 
+// pixels per tile in the spritesheet and in the world images
+inline constexpr int const_tileSize = 16;
+
 class WorldGen
 {
 
 public:
-    static Texture createWorldTexture(int boundX, int boundY);
+    /// @brief world of boundX by boundY tiles, the same seed and bounds always give the same world
+    /// loads the world spritesheet, so it has to be created after the window
+    WorldGen(int boundX, int boundY, uint64_t seed);
+
+    /// @brief returns the tile shown at (x, y)
+    Tile getTile(int x, int y) const;
+    /// @brief writes the tiles shown in [x, x + width) by [y, y + height) to out, row by row
+    /// rows only depend on the seed and where they are, so they can be filled on several threads
+    void getTiles(int x, int y, int width, int height, Tile *out) const;
+    /// @brief draws the tiles shown in [x, x + width) by [y, y + height) into an RGBA image
+    /// and writes the tiles to shownTiles (if not null) like getTiles does
+    /// with a pool the region is composed in bands of rows on its threads, the
+    /// image is the same either way; only reads the generator, so regions can
+    /// also be composed on several threads at once
+    Image composeRegion(int x, int y, int width, int height, Tile *shownTiles = nullptr, ThreadPool *pool = nullptr) const;
+
+    int getBoundX() const { return m_boundX; }
+    int getBoundY() const { return m_boundY; }
+    uint64_t getSeed() const { return m_seed; }
+
     static Texture createCloudTexture();
 
 private:
-    static std::vector<Tile> createWorld(int boundX, int boundY);
+    using TilePixels = std::array<Color, const_tileSize * const_tileSize>;
+
+    /// @brief writes the tiles [x, x + count) of composed row y to out
+    void getComposedRow(int x, int y, int count, Tile *out) const;
+
+private:
+    int m_boundX;
+    int m_boundY;
+    uint64_t m_seed;
+    uint32_t m_noiseKey;
+    // the tiles of the spritesheet, see the constructor
+    std::array<TilePixels, 8> m_tiles;
+    // grass overlays by which neighbors of a dirt tile are not dirt
+    std::array<TilePixels, 16> m_overlays;
 };
@@ -0,0 +1,123 @@
+// Runs the initial game state loader from prefix.js against the stub server
+// and checks its retry path: one request in flight, a fresh timeout per
+// attempt that also covers the body, backoff between attempts, and how
+// success and giving up are reported.
+//
+//   node tools/check-loader.mjs
+
+import { readFile } from "node:fs/promises";
+import { fileURLToPath } from "node:url";
+import vm from "node:vm";
+import { defaultScenario, startStubServer } from "./stubserver.mjs";
+
+const prefix = await readFile(fileURLToPath(new URL("../prefix.js", import.meta.url)), "utf8");
+
+let failures = 0;
+function check(condition, what) {
+    console.log((condition ? "ok    " : "FAIL  ") + what);
+    if (!condition) {
+        failures++;
+    }
+}
+
+// prefix.js in a context of its own, as the page would run it, with the
+// timers it starts and the warnings it prints recorded
+function loadPrefix(options) {
+    const timers = [];
+    const warnings = [];
+    const context = {
+        Module: { initLoaderOptions: options },
+        fetch,
+        AbortController,
+        TextDecoder,
+        Math,
+        setTimeout: (fn, ms) => {
+            const timer = { ms, cleared: false, id: setTimeout(fn, ms) };
+            timers.push(timer);
+            return timer;
+        },
+        clearTimeout: (timer) => {
+            if (timer) {
+                timer.cleared = true;
+                clearTimeout(timer.id);
+            }
+        },
+        console: { log: () => {}, warn: (...args) => warnings.push(args.map(String).join(" ")) },
+    };
+    vm.createContext(context);
+    vm.runInContext(prefix, context);
+    return { Module: context.Module, timers, warnings };
+}
+
+function load(Module) {
+    return new Promise((resolve) => Module.loadInitialGameState(resolve));
+}
+
+const retryDelayMs = 40;
+const timeoutMs = 200;
+
+{
+    // one of every failure, then the scenario
+    const stub = await startStubServer({ script: ["fail", "stall", "hang", "ok"] });
+    const { Module, timers, warnings } = loadPrefix({
+        url: stub.url + "/api/init", timeoutMs, maxAttempts: 5, retryDelayMs, maxRetryDelayMs: 1000,
+    });
+
+    const first = load(Module);
+    let secondCalls = 0;
+    Module.loadInitialGameState(() => secondCalls++);
+    check(Module.initLoad.running, "a load is running after the first call");
+    const ok = await first;
+    Module.loadInitialGameState(() => secondCalls++);
+
+    check(ok === true, "onDone(true) after fail, stall, hang, ok");
+    check(secondCalls === 0 && stub.stats.requests === 4, "calls while running or after it is done start no requests (" + stub.stats.requests + " requests)");
+    check(stub.stats.maxInFlight === 1, "at most one request in flight (" + stub.stats.maxInFlight + ")");
+    check(Module.initLoad.done && !Module.initLoad.running && !Module.initLoad.failed && Module.initLoad.attempt === 4, "initLoad reports done on attempt 4");
+
+    const attemptTimers = timers.filter((t) => t.ms === timeoutMs);
+    check(attemptTimers.length === 4 && new Set(attemptTimers).size === 4, "a fresh timeout for each of the 4 attempts");
+    check(attemptTimers.every((t) => t.cleared), "every attempt clears its timeout");
+
+    check(warnings.length === 3, "one warning per failed attempt (" + warnings.length + ")");
+    check(/HTTP 500/.test(warnings[0] || ""), "the failure reports the status: " + warnings[0]);
+    check(/timed out/.test(warnings[1] || ""), "the stall reports a timeout: " + warnings[1]);
+    check(/timed out/.test(warnings[2] || ""), "the stalled body reports a timeout: " + warnings[2]);
+
+    const gaps = stub.stats.startTimes.slice(1).map((t, i) => t - stub.stats.startTimes[i]);
+    // the gap after a timeout also holds the timeout itself
+    const spent = [0, timeoutMs, timeoutMs];
+    gaps.forEach((gap, i) => {
+        const nominal = retryDelayMs * 2 ** i;
+        check(gap >= spent[i] + nominal / 2 - 5, "retry " + (i + 1) + " waits at least half of " + nominal + " ms (" + gap + " ms)");
+    });
+
+    const sides = [defaultScenario.userInitData.battalions, defaultScenario.aiInitData.battalions];
+    const battalions = sides.flat().length;
+    const troops = sides.flat().reduce((n, b) => n + b.troops.length, 0);
+    const { header, coords } = Module.initialGameState;
+    check(header[0] === battalions && header[1] === troops && coords.length === 2 * troops, "the packed state holds " + battalions + " battalions and " + troops + " troops");
+
+    await stub.close();
+}
+
+{
+    // the endpoint never works, the loader gives up after maxAttempts
+    const stub = await startStubServer({ script: ["fail"] });
+    const { Module, warnings } = loadPrefix({
+        url: stub.url + "/api/init", timeoutMs, maxAttempts: 3, retryDelayMs, maxRetryDelayMs: 1000,
+    });
+
+    const ok = await load(Module);
+    check(ok === false, "onDone(false) once all attempts failed");
+    check(stub.stats.requests === 3 && warnings.length === 3, "exactly maxAttempts requests (" + stub.stats.requests + ")");
+    check(Module.initLoad.failed && !Module.initLoad.running && !Module.initLoad.done && Module.initLoad.attempt === 3, "initLoad reports failed after attempt 3");
+    check(Module.initialGameState === null, "no state is set");
+    await stub.close();
+}
+
+if (failures > 0) {
+    console.log(failures + " check(s) failed");
+    process.exit(1);
+}
+console.log("all loader checks passed");
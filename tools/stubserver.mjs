@@ -0,0 +1,125 @@
+// Local stand-in for the backend: serves the game from the repository root
+// with the headers the threaded build needs, and answers /api/init from a
+// script of responses so the loader in prefix.js can be tried against
+// failures, stalls and slow bodies.
+//
+//   node tools/stubserver.mjs [--port 8000] [--scenario file.json] [--script fail,stall,ok]
+//
+// Each request to /api/init takes the next step of the script, the last step
+// repeats. Steps:
+//   ok     the scenario as JSON
+//   fail   HTTP 500
+//   stall  never answers
+//   hang   sends the headers and half the body, then never finishes
+
+import { createServer } from "node:http";
+import { readFile } from "node:fs/promises";
+import { extname, join, normalize } from "node:path";
+import { fileURLToPath } from "node:url";
+
+const root = fileURLToPath(new URL("..", import.meta.url));
+
+const contentTypes = {
+    ".html": "text/html",
+    ".js": "text/javascript",
+    ".wasm": "application/wasm",
+    ".data": "application/octet-stream",
+    ".json": "application/json",
+};
+
+// two battalions a side, a few troops each
+export const defaultScenario = {
+    userInitData: {
+        battalions: [
+            { type: "warrior", troops: [[10, 10], [11, 10], [10, 11]] },
+            { type: "archer", troops: [[12, 20], [13, 20]] },
+        ],
+    },
+    aiInitData: {
+        battalions: [
+            { type: "archer", troops: [[80, 30], [81, 30]] },
+            { type: "warrior", troops: [[85, 40]] },
+        ],
+    },
+};
+
+/// starts the server, resolves once it listens; `stats` counts the requests
+/// to /api/init and the most that were ever in flight at once
+export function startStubServer({ port = 0, scenario = defaultScenario, script = ["ok"] } = {}) {
+    const body = Buffer.from(JSON.stringify(scenario));
+    const stats = { requests: 0, inFlight: 0, maxInFlight: 0, startTimes: [] };
+    const open = new Set();
+
+    const server = createServer(async (req, res) => {
+        res.setHeader("Cross-Origin-Opener-Policy", "same-origin");
+        res.setHeader("Cross-Origin-Embedder-Policy", "require-corp");
+
+        if (req.url.split("?")[0] === "/api/init") {
+            const step = script[Math.min(stats.requests, script.length - 1)];
+            stats.requests++;
+            stats.startTimes.push(Date.now());
+            stats.inFlight++;
+            stats.maxInFlight = Math.max(stats.maxInFlight, stats.inFlight);
+            res.on("close", () => stats.inFlight--);
+            open.add(res);
+            res.on("close", () => open.delete(res));
+
+            if (step === "fail") {
+                res.writeHead(500).end("stub failure");
+            } else if (step === "stall") {
+                // nothing is sent until the client gives up
+            } else if (step === "hang") {
+                res.writeHead(200, { "Content-Type": "application/json", "Content-Length": body.length });
+                res.write(body.subarray(0, body.length >> 1));
+            } else {
+                res.writeHead(200, { "Content-Type": "application/json", "Content-Length": body.length });
+                res.end(body);
+            }
+            return;
+        }
+
+        const path = normalize(join(root, decodeURIComponent(req.url.split("?")[0])));
+        if (!path.startsWith(root)) {
+            res.writeHead(403).end();
+            return;
+        }
+        try {
+            const file = await readFile(path.endsWith("/") ? join(path, "emscripten-build.html") : path);
+            res.writeHead(200, { "Content-Type": contentTypes[extname(path)] || "application/octet-stream" });
+            res.end(file);
+        } catch {
+            res.writeHead(404).end();
+        }
+    });
+
+    return new Promise((resolve) => {
+        server.listen(port, "127.0.0.1", () => {
+            resolve({
+                url: "http://127.0.0.1:" + server.address().port,
+                stats,
+                close: () => {
+                    for (const res of open) {
+                        res.destroy();
+                    }
+                    return new Promise((done) => server.close(done));
+                },
+            });
+        });
+    });
+}
+
+if (process.argv[1] === fileURLToPath(import.meta.url)) {
+    const args = process.argv.slice(2);
+    const option = (name, fallback) => {
+        const i = args.indexOf(name);
+        return i >= 0 && i + 1 < args.length ? args[i + 1] : fallback;
+    };
+    const scenarioPath = option("--scenario", null);
+    const scenario = scenarioPath ? JSON.parse(await readFile(scenarioPath, "utf8")) : defaultScenario;
+    const stub = await startStubServer({
+        port: Number(option("--port", 8000)),
+        scenario,
+        script: option("--script", "ok").split(","),
+    });
+    console.log("serving the game and /api/init on " + stub.url);
+}